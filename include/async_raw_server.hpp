@@ -16,12 +16,17 @@
 #ifndef ASIO_RAW_LL_ASYNC_RAW_SERVER_HPP
 #define ASIO_RAW_LL_ASYNC_RAW_SERVER_HPP
 
+#include <memory>
 #include <vector>
 
 #include <boost/noncopyable.hpp>
 #include <boost/system/error_code.hpp>
 
+#include "frame_dedup.hpp"
+#include "handler_allocator.hpp"
 #include "ll_protocol.hpp"
+#include "socket_profile.hpp"
+#include "vlan_dispatcher.hpp"
 
 namespace asio
 {
@@ -41,9 +46,25 @@ namespace asio
            * \param ios Boost.Asio IO service.
            * \param ifname interface or empty string to listen on all interface.
            * \param protocol network layer protocol number.
+           * \param profile socket options to apply, i.e.
+           * socket_profile::capture().
+           * \throw boost::system::system_error if an option is refused.
            */
           async_raw_server(boost::asio::io_service& ios,
                   const std::string& ifname,
+              int protocol = ETH_P_ALL,
+              const socket_profile& profile = socket_profile());
+
+          /**
+           * \brief Constructor, adopting an already opened socket.
+           * \param ios Boost.Asio IO service.
+           * \param fd socket descriptor, i.e. a packet socket received from
+           * a privileged process or one end of a socketpair. Ownership is
+           * transferred.
+           * \param protocol network layer protocol number.
+           * \throw boost::system::system_error if descriptor is invalid.
+           */
+          async_raw_server(boost::asio::io_service& ios, int fd,
               int protocol = ETH_P_ALL);
 
           /**
@@ -61,6 +82,10 @@ namespace asio
            * \brief Start send operation.
            * \param data data to send.
            * \param data_len data length.
+           * \note data is copied to one of send_slots preallocated
+           * buffers, it can be reused as soon as this returns. Only frames
+           * larger than send_slot_size or sent while all slots are in
+           * flight allocate.
            */
           void async_send(const char* data, size_t data_len);
 
@@ -70,6 +95,47 @@ namespace asio
            */
           const std::array<char, 1500>& buffer() const;
 
+          /**
+           * \brief Enables or disables PACKET_AUXDATA on receive.
+           * \param enable true to receive out-of-band metadata.
+           * \note when enabled, frames are read with recvmsg() and VLAN
+           * tags stripped by the NIC are available from vlan().
+           */
+          void set_auxdata(bool enable);
+
+          /**
+           * \brief Returns VLAN tag of the last received frame, as
+           * reported out-of-band by PACKET_AUXDATA.
+           * \return tag, not valid if auxdata is disabled or frame was
+           * untagged.
+           */
+          const vlan_tag& vlan() const;
+
+          /**
+           * \brief Sets the duplicate filter applied before handle_recv().
+           * \param dedup filter, nullptr to deliver every frame. It must
+           * outlive the server or be reset.
+           * \note duplicates are not reported to handle_recv(), their
+           * number is in the filter statistics.
+           */
+          void set_dedup(frame_dedup* dedup);
+
+          /**
+           * \brief Returns the underlying socket, i.e. to set options.
+           * \return socket.
+           */
+          asio::raw::ll::ll_protocol::socket& socket();
+
+          /**
+           * \brief Number of preallocated send buffers.
+           */
+          static const size_t send_slots = 64;
+
+          /**
+           * \brief Size of a preallocated send buffer.
+           */
+          static const size_t send_slot_size = 2048;
+
         protected:
           /**
            * \brief Receive callback.
@@ -88,20 +154,74 @@ namespace asio
                   size_t nb) = 0;
 
         private:
+          /**
+           * \brief Send completion of an allocated copy.
+           * \param error error value.
+           * \param nb number of bytes transferred.
+           * \param data copy, released after the send.
+           */
+          void on_send(const boost::system::error_code& error, size_t nb,
+              std::shared_ptr<std::vector<char>> data);
+
+          /**
+           * \brief Socket readable callback, reads frame and auxiliary
+           * data with recvmsg().
+           * \param error error value.
+           */
+          void handle_readable(const boost::system::error_code& error);
+
+          /**
+           * \brief Passes a received frame to handle_recv(), unless it is a
+           * duplicate.
+           * \param error error value.
+           * \param nb number of bytes transferred.
+           */
+          void deliver(const boost::system::error_code& error, size_t nb);
+
           /**
            * \brief Buffer for receive.
            */
           std::array<char, 1500> m_buffer;
 
+          /**
+           * \brief Whether PACKET_AUXDATA is enabled.
+           */
+          bool m_auxdata;
+
+          /**
+           * \brief VLAN tag of the last received frame.
+           */
+          vlan_tag m_vlan;
+
+          /**
+           * \brief Duplicate filter, nullptr if none.
+           */
+          frame_dedup* m_dedup;
+
           /**
            * \brief Link-layer endpoint.
            */
           asio::raw::ll::ll_protocol::endpoint m_endpoint;
 
+          /**
+           * \brief Sender of the frame being received.
+           */
+          asio::raw::ll::ll_protocol::endpoint m_remote;
+
           /**
            * \brief Raw link-layer socket.
            */
           asio::raw::ll::ll_protocol::socket m_socket;
+
+          /**
+           * \brief Memory of the pending receive operation.
+           */
+          handler_memory m_recv_memory;
+
+          /**
+           * \brief Send buffers.
+           */
+          send_pool m_send_pool;
       };
     } /* namespace ll */
   } /* namespace raw */
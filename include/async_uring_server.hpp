@@ -0,0 +1,394 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file async_uring_server.hpp
+ * \brief Raw socket server with io_uring backend.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef ASIO_RAW_LL_ASYNC_URING_SERVER_HPP
+#define ASIO_RAW_LL_ASYNC_URING_SERVER_HPP
+
+#include <cstdint>
+
+#include <memory>
+#include <vector>
+
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/system/error_code.hpp>
+
+#include "handler_allocator.hpp"
+#include "ll_protocol.hpp"
+#include "uring.hpp"
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \class async_uring_server
+       * \brief Asynchronous raw link-layer server socket on io_uring.
+       *
+       * Same handler interface as async_raw_server, but frames are
+       * received by a single multishot recvmsg into a ring of provided
+       * buffers, and sent with write operations on a fixed file from
+       * registered buffers. The ring file descriptor is watched by the
+       * Boost.Asio reactor, so one wakeup delivers every frame completed
+       * since the previous one, and receiving does not need any system
+       * call while the multishot request stays armed.
+       *
+       * On kernels without the needed io_uring features (multishot
+       * recvmsg and provided buffer rings, Linux 6.0) or when io_uring is
+       * disabled, the server silently uses the Boost.Asio reactor instead,
+       * see uring_enabled().
+       */
+      class async_uring_server : private boost::noncopyable
+      {
+        public:
+          /**
+           * \struct statistics
+           * \brief Backend counters.
+           */
+          struct statistics
+          {
+            /**
+             * \brief Frames delivered to handle_recv().
+             */
+            uint64_t frames;
+
+            /**
+             * \brief Ring wakeups from the reactor.
+             */
+            uint64_t wakeups;
+
+            /**
+             * \brief io_uring_enter() calls.
+             */
+            uint64_t submits;
+
+            /**
+             * \brief Times the multishot receive ran out of buffers.
+             */
+            uint64_t no_buffers;
+          };
+
+          /**
+           * \brief Constructor.
+           * \param ios Boost.Asio IO service.
+           * \param ifname interface or empty string to listen on all interface.
+           * \param protocol network layer protocol number.
+           * \param buffers number of receive (and send) buffers, power of 2
+           * up to 32768.
+           * \param frame_size size of one buffer.
+           * \throw std::invalid_argument if buffers or frame_size is invalid.
+           */
+          async_uring_server(boost::asio::io_service& ios,
+              const std::string& ifname, int protocol = ETH_P_ALL,
+              size_t buffers = 256, size_t frame_size = 2048);
+
+          /**
+           * \brief Destructor.
+           */
+          virtual ~async_uring_server();
+
+          /**
+           * \brief Start receive operation.
+           * \note the multishot request is armed on first call and stays
+           * armed, next calls just allow delivery of one more frame.
+           */
+          void async_recv();
+
+          /**
+           * \brief Start send operation.
+           * \param data data to send.
+           */
+          void async_send(const std::vector<char>& data);
+
+          /**
+           * \brief Start send operation.
+           * \param data data to send.
+           * \param data_len data length.
+           * \note data is copied to a registered buffer, handle_send()
+           * reports no_buffer_space if all of them are in flight.
+           */
+          void async_send(const char* data, size_t data_len);
+
+          /**
+           * \brief Returns the frame being received.
+           * \return frame, only valid in handle_recv().
+           */
+          const char* buffer() const;
+
+          /**
+           * \brief Returns whether io_uring backend is used.
+           * \return true for io_uring, false for the reactor fallback.
+           */
+          bool uring_enabled() const;
+
+          /**
+           * \brief Returns backend counters.
+           * \return counters.
+           */
+          const statistics& stats() const;
+
+          /**
+           * \brief Returns the underlying socket, i.e. to set options.
+           * \return socket.
+           */
+          asio::raw::ll::ll_protocol::socket& socket();
+
+        protected:
+          /**
+           * \brief Receive callback.
+           * \param error error value.
+           * \param nb number of bytes transferred.
+           */
+          virtual void handle_recv(const boost::system::error_code& error,
+                  size_t nb) = 0;
+
+          /**
+           * \brief Send callback.
+           * \param error error value.
+           * \param nb number of bytes transferred.
+           */
+          virtual void handle_send(const boost::system::error_code& error,
+                  size_t nb) = 0;
+
+        private:
+          /**
+           * \struct completion
+           * \brief Received frame waiting for async_recv().
+           */
+          struct completion
+          {
+            /**
+             * \brief Buffer identifier.
+             */
+            uint16_t bid;
+
+            /**
+             * \brief Whether frame was truncated.
+             */
+            bool truncated;
+
+            /**
+             * \brief Offset of frame in buffer.
+             */
+            uint32_t offset;
+
+            /**
+             * \brief Frame length.
+             */
+            uint32_t len;
+          };
+
+          /**
+           * \brief Sets up ring, buffers and registrations.
+           * \throw boost::system::system_error if io_uring cannot be used.
+           */
+          void setup_uring();
+
+          /**
+           * \brief Ring readable callback.
+           * \param error error value.
+           */
+          void handle_ring(const boost::system::error_code& error);
+
+          /**
+           * \brief Posted callback, see schedule().
+           */
+          void handle_posted();
+
+          /**
+           * \brief Reaps completions, delivers frames and submits.
+           */
+          void process();
+
+          /**
+           * \brief Reaps all available completions.
+           */
+          void reap();
+
+          /**
+           * \brief Calls handle_recv() while frames are pending and
+           * requested.
+           */
+          void deliver();
+
+          /**
+           * \brief Arms receive if needed, submits queued entries and waits
+           * for completions.
+           */
+          void flush();
+
+          /**
+           * \brief Runs process() from the IO service, once.
+           */
+          void schedule();
+
+          /**
+           * \brief Gives a buffer back to the kernel.
+           * \param bid buffer identifier.
+           */
+          void recycle(uint16_t bid);
+
+          /**
+           * \brief Send completion in fallback mode.
+           * \param error error value.
+           * \param nb number of bytes transferred.
+           * \param data data sent, kept alive until completion.
+           */
+          void on_send(const boost::system::error_code& error, size_t nb,
+              std::shared_ptr<std::vector<char>> data);
+
+          /**
+           * \brief Boost.Asio IO service.
+           */
+          boost::asio::io_service& m_ios;
+
+          /**
+           * \brief Link-layer endpoint.
+           */
+          asio::raw::ll::ll_protocol::endpoint m_endpoint;
+
+          /**
+           * \brief Raw link-layer socket.
+           */
+          asio::raw::ll::ll_protocol::socket m_socket;
+
+          /**
+           * \brief Number of buffers.
+           */
+          size_t m_buffers;
+
+          /**
+           * \brief Size of one buffer.
+           */
+          size_t m_frame_size;
+
+          /**
+           * \brief io_uring instance, null in fallback mode.
+           */
+          std::unique_ptr<uring> m_ring;
+
+          /**
+           * \brief Ring file descriptor (duplicate) for the reactor.
+           */
+          boost::asio::posix::stream_descriptor m_ring_desc;
+
+          /**
+           * \brief Receive buffers, or receive buffer in fallback mode.
+           */
+          std::vector<char> m_rx;
+
+          /**
+           * \brief Send buffers, registered, with the memory of their
+           * operation in fallback mode.
+           */
+          send_pool m_tx;
+
+          /**
+           * \brief Memory of the pending receive in fallback mode.
+           */
+          handler_memory m_recv_memory;
+
+          /**
+           * \brief Provided buffer ring (page aligned mapping).
+           */
+          struct io_uring_buf_ring* m_buf_ring;
+
+          /**
+           * \brief Provided buffer ring mapping size.
+           */
+          size_t m_buf_ring_size;
+
+          /**
+           * \brief Provided buffer ring tail.
+           */
+          uint16_t m_buf_tail;
+
+          /**
+           * \brief Message header template for multishot recvmsg.
+           */
+          struct msghdr m_msg;
+
+          /**
+           * \brief Received frames not yet delivered (ring of m_buffers).
+           */
+          std::vector<completion> m_pending;
+
+          /**
+           * \brief First pending frame.
+           */
+          size_t m_pending_head;
+
+          /**
+           * \brief Number of pending frames.
+           */
+          size_t m_pending_count;
+
+          /**
+           * \brief Receive error to deliver.
+           */
+          boost::system::error_code m_recv_error;
+
+          /**
+           * \brief Frame being delivered.
+           */
+          const char* m_frame;
+
+          /**
+           * \brief Whether async_recv() was called at least once.
+           */
+          bool m_recv_active;
+
+          /**
+           * \brief Whether a frame is requested by async_recv().
+           */
+          bool m_recv_wanted;
+
+          /**
+           * \brief Whether multishot receive is armed.
+           */
+          bool m_armed;
+
+          /**
+           * \brief Whether async_wait() on ring is pending.
+           */
+          bool m_waiting;
+
+          /**
+           * \brief Whether deliver() is running.
+           */
+          bool m_delivering;
+
+          /**
+           * \brief Whether handle_posted() is scheduled.
+           */
+          bool m_posted;
+
+          /**
+           * \brief Sends in flight.
+           */
+          size_t m_tx_inflight;
+
+          /**
+           * \brief Backend counters.
+           */
+          statistics m_stats;
+      };
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
+
+#endif /* ASIO_RAW_LL_ASYNC_URING_SERVER_HPP */
@@ -0,0 +1,403 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file async_vnet_server.hpp
+ * \brief Raw socket server with GSO/GRO offload (PACKET_VNET_HDR).
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef ASIO_RAW_LL_ASYNC_VNET_SERVER_HPP
+#define ASIO_RAW_LL_ASYNC_VNET_SERVER_HPP
+
+#include <memory>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+#include <boost/system/error_code.hpp>
+
+#include "handler_allocator.hpp"
+#include "ll_protocol.hpp"
+
+// <linux/virtio_net.h> cannot be compiled as C++ (field named "class"),
+// so the bits of the legacy header used by PACKET_VNET_HDR live here
+
+#ifndef VIRTIO_NET_HDR_F_NEEDS_CSUM
+/**
+ * \def VIRTIO_NET_HDR_F_NEEDS_CSUM
+ * \brief Checksum is partial, use csum_start and csum_offset.
+ */
+#define VIRTIO_NET_HDR_F_NEEDS_CSUM 1
+#endif
+
+#ifndef VIRTIO_NET_HDR_F_DATA_VALID
+/**
+ * \def VIRTIO_NET_HDR_F_DATA_VALID
+ * \brief Checksum is valid.
+ */
+#define VIRTIO_NET_HDR_F_DATA_VALID 2
+#endif
+
+#ifndef VIRTIO_NET_HDR_GSO_NONE
+/**
+ * \def VIRTIO_NET_HDR_GSO_NONE
+ * \brief Not a GSO frame.
+ */
+#define VIRTIO_NET_HDR_GSO_NONE 0
+#endif
+
+#ifndef VIRTIO_NET_HDR_GSO_TCPV4
+/**
+ * \def VIRTIO_NET_HDR_GSO_TCPV4
+ * \brief GSO frame, IPv4 TCP (TSO).
+ */
+#define VIRTIO_NET_HDR_GSO_TCPV4 1
+#endif
+
+#ifndef VIRTIO_NET_HDR_GSO_TCPV6
+/**
+ * \def VIRTIO_NET_HDR_GSO_TCPV6
+ * \brief GSO frame, IPv6 TCP.
+ */
+#define VIRTIO_NET_HDR_GSO_TCPV6 4
+#endif
+
+#ifndef VIRTIO_NET_HDR_GSO_UDP_L4
+/**
+ * \def VIRTIO_NET_HDR_GSO_UDP_L4
+ * \brief GSO frame, UDP segmentation (USO).
+ */
+#define VIRTIO_NET_HDR_GSO_UDP_L4 5
+#endif
+
+#ifndef VIRTIO_NET_HDR_GSO_ECN
+/**
+ * \def VIRTIO_NET_HDR_GSO_ECN
+ * \brief TCP has ECN set.
+ */
+#define VIRTIO_NET_HDR_GSO_ECN 0x80
+#endif
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \struct virtio_net_hdr
+       * \brief Header prefixing frames on a PACKET_VNET_HDR socket, fields
+       * in host byte order.
+       */
+      struct virtio_net_hdr
+      {
+        /**
+         * \brief Flags (VIRTIO_NET_HDR_F_*).
+         */
+        uint8_t flags;
+
+        /**
+         * \brief GSO type (VIRTIO_NET_HDR_GSO_*).
+         */
+        uint8_t gso_type;
+
+        /**
+         * \brief Ethernet + IP + TCP/UDP headers length.
+         */
+        uint16_t hdr_len;
+
+        /**
+         * \brief Bytes to append to hdr_len per segment.
+         */
+        uint16_t gso_size;
+
+        /**
+         * \brief Position to start checksumming from.
+         */
+        uint16_t csum_start;
+
+        /**
+         * \brief Offset after csum_start to place checksum.
+         */
+        uint16_t csum_offset;
+      };
+
+      /**
+       * \class gso_info
+       * \brief Segmentation and checksum offload metadata of a
+       * super-frame, host-order view of struct virtio_net_hdr.
+       */
+      class gso_info
+      {
+        public:
+          /**
+           * \brief Constructor, describes a plain frame.
+           */
+          gso_info();
+
+          /**
+           * \brief Builds metadata for a TCP super-frame to be segmented.
+           * \param ipv6 true for TCP over IPv6.
+           * \param l4_offset offset of the TCP header in the frame.
+           * \param l4_len TCP header length (with options).
+           * \param mss payload size of each segment.
+           * \return metadata.
+           * \note TCP checksum field must be seeded with the pseudo-header
+           * checksum (without length), not complemented.
+           */
+          static gso_info tcp(bool ipv6, uint16_t l4_offset, uint16_t l4_len,
+              uint16_t mss);
+
+          /**
+           * \brief Builds metadata for a UDP super-frame to be segmented
+           * (UDP_L4, kernel 4.18+).
+           * \param l4_offset offset of the UDP header in the frame.
+           * \param mss payload size of each datagram.
+           * \return metadata.
+           * \note UDP checksum field must be seeded with the pseudo-header
+           * checksum (without length), not complemented.
+           */
+          static gso_info udp(uint16_t l4_offset, uint16_t mss);
+
+          /**
+           * \brief Builds metadata for checksum offload only.
+           * \param l4_offset offset where checksumming starts.
+           * \param csum_field offset of the checksum field from l4_offset.
+           * \return metadata.
+           */
+          static gso_info csum(uint16_t l4_offset, uint16_t csum_field);
+
+          /**
+           * \brief Parses a received header.
+           * \param hdr header from kernel.
+           */
+          void from_hdr(const struct virtio_net_hdr& hdr);
+
+          /**
+           * \brief Fills a header to send.
+           * \param hdr header to fill.
+           */
+          void to_hdr(struct virtio_net_hdr& hdr) const;
+
+          /**
+           * \brief Returns whether frame is a GSO/GRO super-frame.
+           * \return true if frame carries several segments.
+           */
+          bool is_gso() const;
+
+          /**
+           * \brief Returns number of segments in a frame.
+           * \param frame_len length of the frame.
+           * \return number of segments, 1 if not a super-frame.
+           */
+          size_t segments(size_t frame_len) const;
+
+          /**
+           * \brief GSO type (VIRTIO_NET_HDR_GSO_*, without ECN bit).
+           */
+          uint8_t gso_type;
+
+          /**
+           * \brief Whether TCP segments carry ECN CWR.
+           */
+          bool ecn;
+
+          /**
+           * \brief Length of headers replicated in every segment.
+           */
+          uint16_t hdr_len;
+
+          /**
+           * \brief Payload size of each segment.
+           */
+          uint16_t gso_size;
+
+          /**
+           * \brief Whether checksum is partial and must be completed
+           * (csum_start/csum_offset are valid).
+           */
+          bool needs_csum;
+
+          /**
+           * \brief Whether checksum was already verified (receive only).
+           */
+          bool data_valid;
+
+          /**
+           * \brief Offset where checksumming starts.
+           */
+          uint16_t csum_start;
+
+          /**
+           * \brief Offset of the checksum field from csum_start.
+           */
+          uint16_t csum_offset;
+      };
+
+      /**
+       * \class async_vnet_server
+       * \brief Asynchronous raw link-layer server socket exchanging
+       * super-frames (up to 64 KB) with the kernel.
+       *
+       * PACKET_VNET_HDR is enabled on the socket: received frames may be
+       * GRO'd super-frames whose segmentation is described by gso(), and
+       * sent frames may be TCP/UDP super-frames segmented and checksummed
+       * by the kernel or the NIC.
+       */
+      class async_vnet_server : private boost::noncopyable
+      {
+        public:
+          /**
+           * \brief Maximum super-frame size.
+           */
+          static const size_t max_frame_size = 65536 + ETH_HLEN + 4;
+
+          /**
+           * \brief Constructor.
+           * \param ios Boost.Asio IO service.
+           * \param ifname interface or empty string to listen on all interface.
+           * \param protocol network layer protocol number.
+           */
+          async_vnet_server(boost::asio::io_service& ios,
+              const std::string& ifname, int protocol = ETH_P_ALL);
+
+          /**
+           * \brief Start receive operation.
+           */
+          void async_recv();
+
+          /**
+           * \brief Start send operation.
+           * \param info segmentation and checksum offload metadata.
+           * \param data frame to send, starting with the ethernet header.
+           * \param data_len frame length.
+           * \note data is copied to one of send_slots preallocated
+           * buffers, it can be reused as soon as this returns. Only frames
+           * larger than send_slot_size (super-frames) or sent while all
+           * slots are in flight allocate.
+           */
+          void async_send(const gso_info& info, const char* data,
+              size_t data_len);
+
+          /**
+           * \brief Start send operation of a plain frame.
+           * \param data frame to send.
+           * \param data_len frame length.
+           */
+          void async_send(const char* data, size_t data_len);
+
+          /**
+           * \brief Returns receive buffer (without virtio_net_hdr).
+           * \return buffer.
+           */
+          const std::vector<char>& buffer() const;
+
+          /**
+           * \brief Returns metadata of the last received frame.
+           * \return metadata.
+           */
+          const gso_info& gso() const;
+
+          /**
+           * \brief Number of preallocated send buffers.
+           */
+          static const size_t send_slots = 64;
+
+          /**
+           * \brief Largest frame sent from a preallocated buffer.
+           */
+          static const size_t send_slot_size = 2048;
+
+        protected:
+          /**
+           * \brief Receive callback.
+           * \param error error value.
+           * \param nb number of frame bytes in buffer().
+           */
+          virtual void handle_recv(const boost::system::error_code& error,
+                  size_t nb) = 0;
+
+          /**
+           * \brief Send callback.
+           * \param error error value.
+           * \param nb number of frame bytes transferred.
+           */
+          virtual void handle_send(const boost::system::error_code& error,
+                  size_t nb) = 0;
+
+        private:
+          /**
+           * \brief Internal receive completion, strips header.
+           * \param error error value.
+           * \param nb number of bytes transferred.
+           */
+          void on_recv(const boost::system::error_code& error, size_t nb);
+
+          /**
+           * \brief Internal send completion, strips header.
+           * \param error error value.
+           * \param nb number of bytes transferred.
+           * \param data sent data, held until completion.
+           */
+          void on_send(const boost::system::error_code& error, size_t nb,
+              std::shared_ptr<std::vector<char>> data);
+
+          /**
+           * \brief Internal send completion of a preallocated buffer,
+           * strips header.
+           * \param error error value.
+           * \param nb number of bytes transferred.
+           */
+          void on_send_slot(const boost::system::error_code& error, size_t nb);
+
+          /**
+           * \brief Header of the received frame.
+           */
+          struct virtio_net_hdr m_hdr;
+
+          /**
+           * \brief Buffer for receive.
+           */
+          std::vector<char> m_buffer;
+
+          /**
+           * \brief Metadata of the received frame.
+           */
+          gso_info m_gso;
+
+          /**
+           * \brief Link-layer endpoint.
+           */
+          asio::raw::ll::ll_protocol::endpoint m_endpoint;
+
+          /**
+           * \brief Sender of the frame being received.
+           */
+          asio::raw::ll::ll_protocol::endpoint m_remote;
+
+          /**
+           * \brief Raw link-layer socket.
+           */
+          asio::raw::ll::ll_protocol::socket m_socket;
+
+          /**
+           * \brief Memory of the pending receive operation.
+           */
+          handler_memory m_recv_memory;
+
+          /**
+           * \brief Send buffers, header and send_slot_size bytes each.
+           */
+          send_pool m_send_pool;
+      };
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
+
+#endif /* ASIO_RAW_LL_ASYNC_VNET_SERVER_HPP */
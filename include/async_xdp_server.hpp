@@ -0,0 +1,428 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file async_xdp_server.hpp
+ * \brief AF_XDP socket server.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef ASIO_RAW_LL_ASYNC_XDP_SERVER_HPP
+#define ASIO_RAW_LL_ASYNC_XDP_SERVER_HPP
+
+#include <cstdint>
+
+#include <memory>
+#include <vector>
+
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/system/error_code.hpp>
+
+#include "xdp_protocol.hpp"
+#include "xdp_program.hpp"
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \class async_xdp_server
+       * \brief Asynchronous AF_XDP server socket.
+       *
+       * Drop-in alternative to async_raw_server: same handler interface,
+       * but frames are redirected by an XDP program into a UMEM shared
+       * with the kernel and exchanged through four rings (fill and RX to
+       * receive, TX and completion to send) instead of system calls.
+       * handle_recv() reads the frame in place from the UMEM.
+       *
+       * The socket binds in zero-copy mode when the program runs in the
+       * driver and the driver supports it, in copy mode otherwise (i.e.
+       * generic XDP on veth or lo).
+       * \code
+       *  class listener : public async_xdp_server
+       *  {
+       *    // same handle_recv()/handle_send() as with async_raw_server,
+       *    // buffer() returns the frame in the UMEM
+       *  };
+       * \endcode
+       */
+      class async_xdp_server : private boost::noncopyable
+      {
+        public:
+          /**
+           * \brief Constructor, attaches an XDP program for one queue.
+           * \param ios Boost.Asio IO service.
+           * \param ifname interface.
+           * \param protocol ethertype redirected to the socket.
+           * \param queue_id interface queue.
+           * \param mode XDP attach mode.
+           * \param frames number of UMEM frames, power of 2, half for
+           * receive and half for send.
+           * \param frame_size UMEM frame size (2048 or 4096).
+           * \throw boost::system::system_error if AF_XDP is not available.
+           */
+          async_xdp_server(boost::asio::io_service& ios,
+              const std::string& ifname, int protocol = ETH_P_ALL,
+              uint32_t queue_id = 0,
+              xdp_program::attach_mode mode = xdp_program::mode_auto,
+              uint32_t frames = 4096, uint32_t frame_size = 2048);
+
+          /**
+           * \brief Constructor, with an XDP program shared between queues.
+           * \param ios Boost.Asio IO service.
+           * \param program XDP program of the interface.
+           * \param queue_id interface queue.
+           * \param frames number of UMEM frames, power of 2.
+           * \param frame_size UMEM frame size (2048 or 4096).
+           * \throw boost::system::system_error if AF_XDP is not available.
+           */
+          async_xdp_server(boost::asio::io_service& ios,
+              const std::shared_ptr<xdp_program>& program,
+              uint32_t queue_id = 0, uint32_t frames = 4096,
+              uint32_t frame_size = 2048);
+
+          /**
+           * \brief Destructor.
+           */
+          virtual ~async_xdp_server();
+
+          /**
+           * \brief Start receive operation.
+           */
+          void async_recv();
+
+          /**
+           * \brief Start send operation.
+           * \param data data to send.
+           */
+          void async_send(const std::vector<char>& data);
+
+          /**
+           * \brief Start send operation.
+           * \param data data to send.
+           * \param data_len data length.
+           * \note data is copied to a UMEM frame, handle_send() reports
+           * no_buffer_space if all of them are in flight. Once the kernel
+           * refused to transmit (i.e. interface down), frames in flight and
+           * later sends complete with that error.
+           */
+          void async_send(const char* data, size_t data_len);
+
+          /**
+           * \brief Returns the frame being received.
+           * \return frame in the UMEM, only valid in handle_recv().
+           */
+          const char* buffer() const;
+
+          /**
+           * \brief Returns whether the socket is in zero-copy mode.
+           * \return true for zero-copy, false for copy mode.
+           */
+          bool zero_copy() const;
+
+          /**
+           * \brief Returns kernel counters of the socket (drops, ring
+           * full, fill ring empty, ...).
+           * \return counters.
+           */
+          struct xdp_statistics xdp_stats();
+
+          /**
+           * \brief Returns the underlying socket.
+           * \return socket.
+           */
+          asio::raw::ll::xdp_protocol::socket& socket();
+
+        protected:
+          /**
+           * \brief Receive callback.
+           * \param error error value.
+           * \param nb number of bytes transferred.
+           */
+          virtual void handle_recv(const boost::system::error_code& error,
+                  size_t nb) = 0;
+
+          /**
+           * \brief Send callback.
+           * \param error error value.
+           * \param nb number of bytes transferred.
+           */
+          virtual void handle_send(const boost::system::error_code& error,
+                  size_t nb) = 0;
+
+        private:
+          /**
+           * \struct ring
+           * \brief Single producer, single consumer ring shared with the
+           * kernel.
+           */
+          struct ring
+          {
+            /**
+             * \brief Producer index.
+             */
+            uint32_t* producer;
+
+            /**
+             * \brief Consumer index.
+             */
+            uint32_t* consumer;
+
+            /**
+             * \brief Ring flags (XDP_RING_NEED_WAKEUP).
+             */
+            uint32_t* flags;
+
+            /**
+             * \brief Descriptors (struct xdp_desc or UMEM address).
+             */
+            void* desc;
+
+            /**
+             * \brief Number of descriptors minus one.
+             */
+            uint32_t mask;
+
+            /**
+             * \brief Local producer or consumer index.
+             */
+            uint32_t cached;
+
+            /**
+             * \brief Ring mapping.
+             */
+            void* map;
+
+            /**
+             * \brief Ring mapping size.
+             */
+            size_t map_size;
+          };
+
+          /**
+           * \brief Sets up UMEM, rings and binds the socket.
+           * \param eth_protocol ethertype redirected to the socket.
+           * \throw boost::system::system_error on error.
+           */
+          void setup(uint16_t eth_protocol);
+
+          /**
+           * \brief Closes socket and unmaps rings and UMEM.
+           */
+          void release();
+
+          /**
+           * \brief Maps a ring.
+           * \param r ring.
+           * \param off ring offsets.
+           * \param count number of descriptors.
+           * \param desc_size descriptor size.
+           * \param pgoff mapping offset.
+           * \throw boost::system::system_error on error.
+           */
+          void map_ring(ring& r, const struct xdp_ring_offset& off,
+              uint32_t count, size_t desc_size, uint64_t pgoff);
+
+          /**
+           * \brief Socket readable callback.
+           * \param error error value.
+           */
+          void handle_readable(const boost::system::error_code& error);
+
+          /**
+           * \brief Posted callback, see schedule().
+           */
+          void handle_posted();
+
+          /**
+           * \brief Kicks TX, reaps completions, delivers frames and waits.
+           */
+          void process();
+
+          /**
+           * \brief Calls handle_recv() while frames are available and
+           * requested, then gives their frames back to the fill ring.
+           */
+          void deliver();
+
+          /**
+           * \brief Frees sent frames and calls handle_send().
+           * \return number of frames completed.
+           */
+          uint32_t reap_tx();
+
+          /**
+           * \brief Fails frames in flight, their descriptors may never
+           * complete.
+           * \param error error reported to handle_send().
+           */
+          void fail_tx(const boost::system::error_code& error);
+
+          /**
+           * \brief Polls the completion ring again, which does not wake
+           * the socket up: posted a few times, then from a timer.
+           */
+          void poll_tx();
+
+          /**
+           * \brief Timer callback, see poll_tx().
+           * \param error error value.
+           */
+          void handle_tx_timer(const boost::system::error_code& error);
+
+          /**
+           * \brief Runs process() from the IO service, once.
+           */
+          void schedule();
+
+          /**
+           * \brief Completion polls posted before falling back to the
+           * timer.
+           */
+          static const uint32_t tx_spin_polls = 64;
+
+          /**
+           * \brief Completion poll timer period in microseconds.
+           */
+          static const long tx_poll_interval = 100;
+
+          /**
+           * \brief Boost.Asio IO service.
+           */
+          boost::asio::io_service& m_ios;
+
+          /**
+           * \brief Endpoint (interface and queue).
+           */
+          asio::raw::ll::xdp_protocol::endpoint m_endpoint;
+
+          /**
+           * \brief XDP program redirecting to this socket.
+           */
+          std::shared_ptr<xdp_program> m_program;
+
+          /**
+           * \brief XDP socket.
+           */
+          asio::raw::ll::xdp_protocol::socket m_socket;
+
+          /**
+           * \brief Number of UMEM frames.
+           */
+          uint32_t m_frames;
+
+          /**
+           * \brief UMEM frame size.
+           */
+          uint32_t m_frame_size;
+
+          /**
+           * \brief UMEM area.
+           */
+          char* m_umem;
+
+          /**
+           * \brief Fill ring.
+           */
+          ring m_fill;
+
+          /**
+           * \brief Completion ring.
+           */
+          ring m_comp;
+
+          /**
+           * \brief RX ring.
+           */
+          ring m_rx;
+
+          /**
+           * \brief TX ring.
+           */
+          ring m_tx;
+
+          /**
+           * \brief Free send frames (UMEM addresses).
+           */
+          std::vector<uint64_t> m_tx_free;
+
+          /**
+           * \brief Length of frame in flight, per send frame.
+           */
+          std::vector<uint32_t> m_tx_len;
+
+          /**
+           * \brief Frames sent but not completed.
+           */
+          uint32_t m_tx_outstanding;
+
+          /**
+           * \brief Whether TX ring has descriptors the kernel was not
+           * told about.
+           */
+          bool m_tx_kick;
+
+          /**
+           * \brief Completion polls without progress.
+           */
+          uint32_t m_tx_polls;
+
+          /**
+           * \brief Completion poll timer.
+           */
+          boost::asio::deadline_timer m_tx_timer;
+
+          /**
+           * \brief Whether m_tx_timer is pending.
+           */
+          bool m_tx_timer_armed;
+
+          /**
+           * \brief Transmit error, sticky.
+           */
+          boost::system::error_code m_tx_error;
+
+          /**
+           * \brief Frame being delivered.
+           */
+          const char* m_frame;
+
+          /**
+           * \brief Whether a frame is requested by async_recv().
+           */
+          bool m_recv_wanted;
+
+          /**
+           * \brief Whether async_wait() is pending.
+           */
+          bool m_waiting;
+
+          /**
+           * \brief Whether deliver() is running.
+           */
+          bool m_delivering;
+
+          /**
+           * \brief Whether handle_posted() is scheduled.
+           */
+          bool m_posted;
+
+          /**
+           * \brief Whether socket is in zero-copy mode.
+           */
+          bool m_zero_copy;
+      };
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
+
+#endif /* ASIO_RAW_LL_ASYNC_XDP_SERVER_HPP */
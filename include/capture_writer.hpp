@@ -0,0 +1,400 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file capture_writer.hpp
+ * \brief Rotating pcap capture writer.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef ASIO_RAW_LL_CAPTURE_WRITER_HPP
+#define ASIO_RAW_LL_CAPTURE_WRITER_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \class capture_writer
+       * \brief Writes received frames to rotating pcap files (nanosecond
+       * resolution) without going through the page cache.
+       *
+       * Frames are appended to aligned blocks in memory. Each full block
+       * is handed to a writer thread, which writes it with O_DIRECT, so
+       * that disk writeback never stalls the receiving thread nor evicts
+       * useful pages. The number of blocks bounds the memory used and the
+       * writes in flight: when the disk cannot keep up and no block is
+       * free, frames are dropped and counted instead of blocking the
+       * caller.
+       *
+       * Files are named prefix-NNNNNN.pcap, preallocated with fallocate()
+       * and rotated when they reach the maximum size; only the most recent
+       * ones are kept if a maximum number of files is given. On file
+       * systems without O_DIRECT (i.e. tmpfs), buffered writes are used
+       * and written pages are dropped from the cache after writeback.
+       * \code
+       *  capture_writer writer("/data/eth0", 1024 * 1024 * 1024, 16);
+       *
+       *  // in handle_recv()
+       *  writer.write(buffer().data(), nb);
+       *
+       *  // on exit
+       *  writer.close();
+       * \endcode
+       * \note write(), rotate(), close() and stats() must be called from
+       * one thread.
+       */
+      class capture_writer : private boost::noncopyable
+      {
+        public:
+          /**
+           * \class statistics
+           * \brief Capture statistics.
+           */
+          class statistics
+          {
+            public:
+              /**
+               * \brief Constructor.
+               */
+              statistics();
+
+              /**
+               * \brief Number of frames written.
+               */
+              uint64_t frames;
+
+              /**
+               * \brief Number of frame bytes written (after snaplen).
+               */
+              uint64_t bytes;
+
+              /**
+               * \brief Number of frames dropped because no block was free.
+               */
+              uint64_t dropped;
+
+              /**
+               * \brief Number of blocks written to disk.
+               */
+              uint64_t blocks;
+
+              /**
+               * \brief Number of files completed.
+               */
+              uint64_t files;
+          };
+
+          /**
+           * \brief Constructor, creates the first file.
+           * \param prefix file name prefix, may contain a directory.
+           * \param file_size maximum file size in bytes.
+           * \param max_files number of files kept, 0 to keep all.
+           * \param block_size write size, multiple of 4096.
+           * \param blocks number of blocks (memory used and writes in
+           * flight).
+           * \param snaplen maximum number of bytes saved per frame.
+           * \throw std::invalid_argument if sizes are invalid.
+           * \throw boost::system::system_error if file cannot be created.
+           */
+          capture_writer(const std::string& prefix,
+              uint64_t file_size = 1024 * 1024 * 1024, size_t max_files = 0,
+              size_t block_size = 1024 * 1024, size_t blocks = 32,
+              uint32_t snaplen = 65535);
+
+          /**
+           * \brief Destructor, writes pending blocks and completes the
+           * current file.
+           */
+          ~capture_writer();
+
+          /**
+           * \brief Writes a frame, time-stamped now.
+           * \param data frame.
+           * \param len frame length.
+           * \return false if frame was dropped.
+           * \throw boost::system::system_error if a previous disk write
+           * failed.
+           */
+          bool write(const char* data, size_t len);
+
+          /**
+           * \brief Writes a frame.
+           * \param data frame.
+           * \param len frame length.
+           * \param ts_ns receive time (CLOCK_REALTIME) in nanoseconds.
+           * \return false if frame was dropped.
+           * \throw boost::system::system_error if a previous disk write
+           * failed.
+           */
+          bool write(const char* data, size_t len, uint64_t ts_ns);
+
+          /**
+           * \brief Completes the current file, next frame starts a new
+           * one.
+           */
+          void rotate();
+
+          /**
+           * \brief Writes pending blocks, completes the current file and
+           * stops the writer thread.
+           * \throw boost::system::system_error if a disk write failed.
+           */
+          void close();
+
+          /**
+           * \brief Returns statistics.
+           * \return statistics.
+           */
+          statistics stats() const;
+
+          /**
+           * \brief Returns whether files are written with O_DIRECT.
+           * \return true if page cache is bypassed.
+           */
+          bool direct() const;
+
+          /**
+           * \brief Returns name of a file.
+           * \param index file index, from 0.
+           * \return file name.
+           */
+          std::string file_name(uint64_t index) const;
+
+        private:
+          /**
+           * \brief Write request, from the caller to the writer thread.
+           */
+          struct request
+          {
+            /**
+             * \brief Block index, npos for none.
+             */
+            size_t block;
+
+            /**
+             * \brief Number of bytes used in block.
+             */
+            size_t len;
+
+            /**
+             * \brief Whether file is complete after this block.
+             */
+            bool last;
+          };
+
+          /**
+           * \brief Takes a free block.
+           * \return block index or npos if none is free.
+           */
+          size_t acquire();
+
+          /**
+           * \brief Checks that n bytes can be appended, taking a block if
+           * needed.
+           * \param n number of bytes.
+           * \return false if not enough free blocks.
+           */
+          bool reserve(size_t n);
+
+          /**
+           * \brief Appends bytes to blocks, submitting full ones.
+           * \param data data.
+           * \param n number of bytes, previously reserved.
+           */
+          void append(const void* data, size_t n);
+
+          /**
+           * \brief Queues a request to the writer thread.
+           * \param block block index or npos.
+           * \param len number of bytes used in block.
+           * \param last whether file is complete.
+           */
+          void submit(size_t block, size_t len, bool last);
+
+          /**
+           * \brief Throws the writer thread error, if any.
+           */
+          void check_error() const;
+
+          /**
+           * \brief Stops the writer thread after pending requests.
+           */
+          void shutdown();
+
+          /**
+           * \brief Writer thread loop.
+           */
+          void run();
+
+          /**
+           * \brief Writes one request, writer thread.
+           * \param req request.
+           */
+          void process(const request& req);
+
+          /**
+           * \brief Creates and preallocates the next file.
+           * \throw boost::system::system_error if file cannot be created.
+           */
+          void open_file();
+
+          /**
+           * \brief Truncates the current file to the bytes written and
+           * closes it, removes it if nothing was written.
+           */
+          void finish_file();
+
+          /**
+           * \brief File name prefix.
+           */
+          std::string m_prefix;
+
+          /**
+           * \brief Maximum file size.
+           */
+          uint64_t m_file_size;
+
+          /**
+           * \brief Number of files kept.
+           */
+          size_t m_max_files;
+
+          /**
+           * \brief Block size.
+           */
+          size_t m_block_size;
+
+          /**
+           * \brief Maximum bytes saved per frame.
+           */
+          uint32_t m_snaplen;
+
+          /**
+           * \brief Blocks memory, aligned for O_DIRECT.
+           */
+          char* m_memory;
+
+          /**
+           * \brief Block being filled, npos for none.
+           */
+          size_t m_current;
+
+          /**
+           * \brief Number of bytes used in the block being filled.
+           */
+          size_t m_fill;
+
+          /**
+           * \brief Number of bytes in the current file, including the
+           * block being filled.
+           */
+          uint64_t m_file_bytes;
+
+          /**
+           * \brief Statistics updated by the caller.
+           */
+          statistics m_stats;
+
+          /**
+           * \brief Protects m_free, m_queue and m_stop.
+           */
+          mutable std::mutex m_mutex;
+
+          /**
+           * \brief Signals requests to the writer thread.
+           */
+          std::condition_variable m_cond;
+
+          /**
+           * \brief Free blocks.
+           */
+          std::vector<size_t> m_free;
+
+          /**
+           * \brief Pending requests (circular, room for each block and a
+           * file end without block after each of them).
+           */
+          std::vector<request> m_queue;
+
+          /**
+           * \brief Index of the oldest pending request.
+           */
+          size_t m_queue_head;
+
+          /**
+           * \brief Number of pending requests.
+           */
+          size_t m_queue_count;
+
+          /**
+           * \brief Whether the writer thread has to stop once idle.
+           */
+          bool m_stop;
+
+          /**
+           * \brief Current file descriptor, writer thread.
+           */
+          int m_fd;
+
+          /**
+           * \brief Current file index, writer thread.
+           */
+          uint64_t m_index;
+
+          /**
+           * \brief Bytes written in the current file, writer thread.
+           */
+          uint64_t m_offset;
+
+          /**
+           * \brief Whether files are opened with O_DIRECT, cleared by the
+           * writer thread, read by direct() from any thread.
+           */
+          std::atomic<bool> m_direct;
+
+          /**
+           * \brief First write error (errno), 0 if none.
+           */
+          std::atomic<int> m_error;
+
+          /**
+           * \brief Number of blocks written.
+           */
+          std::atomic<uint64_t> m_blocks;
+
+          /**
+           * \brief Number of files completed.
+           */
+          std::atomic<uint64_t> m_files;
+
+          /**
+           * \brief Writer thread.
+           */
+          std::thread m_thread;
+      };
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
+
+#endif /* ASIO_RAW_LL_CAPTURE_WRITER_HPP */
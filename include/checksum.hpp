@@ -0,0 +1,194 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file checksum.hpp
+ * \brief Internet (ones-complement) checksum helpers.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef ASIO_RAW_LL_CHECKSUM_HPP
+#define ASIO_RAW_LL_CHECKSUM_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \class checksum
+       * \brief Internet checksum (RFC 1071) computation and incremental
+       * update (RFC 1624).
+       *
+       * Partial sums are 32-bit accumulators of 16-bit words in network
+       * byte order, so they can be chained over non-contiguous regions
+       * (i.e. pseudo-header then payload) before being folded.
+       *
+       * Bulk summing is vectorized: the ones-complement sum does not depend
+       * on byte order (RFC 1071 section 2), so 32-bit native words are
+       * accumulated in 64-bit SIMD lanes and the folded result is
+       * byte-swapped once at the end.
+       */
+      class checksum
+      {
+        public:
+          /**
+           * \brief Adds data to a partial sum.
+           * \param data data to sum.
+           * \param len data length.
+           * \param sum initial partial sum.
+           * \return new partial sum.
+           * \note if len is odd, the last byte is padded with zero so only
+           * the last chained region may have an odd length.
+           * \note uses AVX2 or SSE2 when available, see partial_scalar()
+           * for the reference implementation.
+           */
+          static uint32_t partial(const void* data, size_t len,
+              uint32_t sum = 0);
+
+          /**
+           * \brief Adds data to a partial sum, one 16-bit word at a time.
+           * \param data data to sum.
+           * \param len data length.
+           * \param sum initial partial sum.
+           * \return new partial sum.
+           */
+          static uint32_t partial_scalar(const void* data, size_t len,
+              uint32_t sum = 0)
+          {
+            const uint8_t* p = static_cast<const uint8_t*>(data);
+            uint64_t acc = sum;
+
+            while(len > 1)
+            {
+              acc += static_cast<uint32_t>(p[0] << 8 | p[1]);
+              p += 2;
+              len -= 2;
+            }
+
+            if(len)
+            {
+              acc += static_cast<uint32_t>(p[0] << 8);
+            }
+
+            return reduce(acc);
+          }
+
+          /**
+           * \brief Folds a partial sum into a checksum value.
+           * \param sum partial sum.
+           * \return checksum in host byte order, ready to be stored with
+           * htons().
+           */
+          static uint16_t fold(uint32_t sum)
+          {
+            sum = (sum & 0xffff) + (sum >> 16);
+            sum = (sum & 0xffff) + (sum >> 16);
+            return static_cast<uint16_t>(~sum);
+          }
+
+          /**
+           * \brief Computes checksum of a contiguous region.
+           * \param data data to sum.
+           * \param len data length.
+           * \return checksum in host byte order.
+           */
+          static uint16_t compute(const void* data, size_t len)
+          {
+            return fold(partial(data, len));
+          }
+
+          /**
+           * \brief Updates a checksum after a 16-bit word changed
+           * (RFC 1624 eqn. 3: HC' = ~(~HC + ~m + m')).
+           * \param csum old checksum in host byte order.
+           * \param old_word old 16-bit word in host byte order.
+           * \param new_word new 16-bit word in host byte order.
+           * \return new checksum in host byte order.
+           */
+          static uint16_t update(uint16_t csum, uint16_t old_word,
+              uint16_t new_word)
+          {
+            uint32_t sum = static_cast<uint16_t>(~csum);
+
+            sum += static_cast<uint16_t>(~old_word);
+            sum += new_word;
+            return fold(sum);
+          }
+
+          /**
+           * \brief Updates a checksum after a region of the covered data
+           * changed.
+           * \param csum old checksum in host byte order.
+           * \param old_data old content of the region.
+           * \param new_data new content of the region.
+           * \param len region length.
+           * \param odd true if region starts at an odd offset from the
+           * start of the checksummed data.
+           * \return new checksum in host byte order.
+           */
+          static uint16_t update(uint16_t csum, const void* old_data,
+              const void* new_data, size_t len, bool odd = false)
+          {
+            const uint8_t* o = static_cast<const uint8_t*>(old_data);
+            const uint8_t* n = static_cast<const uint8_t*>(new_data);
+            uint64_t sum = static_cast<uint16_t>(~csum);
+
+            for(size_t i = 0 ; i < len ; i++)
+            {
+              // byte position inside its 16-bit word
+              unsigned int shift = ((i & 1) ^ (odd ? 1 : 0)) ? 0 : 8;
+
+              sum += static_cast<uint32_t>(static_cast<uint8_t>(~o[i])
+                  << shift);
+              sum += static_cast<uint32_t>(n[i] << shift);
+            }
+
+            // ~m for the padding half of a partial word is 0xff, not 0x00
+            if(odd)
+            {
+              sum += 0xff00;
+            }
+
+            if((len + (odd ? 1 : 0)) & 1)
+            {
+              sum += 0x00ff;
+            }
+
+            return fold(reduce(sum));
+          }
+
+          /**
+           * \brief Returns name of the implementation used by partial().
+           * \return "avx2", "sse2" or "scalar".
+           */
+          static const char* implementation();
+
+        private:
+          /**
+           * \brief Reduces a 64-bit accumulator to 32-bit without loss.
+           * \param acc accumulator.
+           * \return reduced partial sum.
+           */
+          static uint32_t reduce(uint64_t acc)
+          {
+            acc = (acc & 0xffffffff) + (acc >> 32);
+            acc = (acc & 0xffffffff) + (acc >> 32);
+            return static_cast<uint32_t>(acc);
+          }
+      };
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
+
+#endif /* ASIO_RAW_LL_CHECKSUM_HPP */
@@ -0,0 +1,314 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file ethertype_dispatcher.hpp
+ * \brief Per-ethertype frame dispatch on a single ETH_P_ALL socket.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef ASIO_RAW_LL_ETHERTYPE_DISPATCHER_HPP
+#define ASIO_RAW_LL_ETHERTYPE_DISPATCHER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <array>
+#include <functional>
+#include <vector>
+
+#include "ll_protocol.hpp"
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \class ethertype_dispatcher
+       * \brief Dispatches frames to handlers registered per ethertype.
+       *
+       * One ETH_P_ALL socket replaces one socket per protocol: lookup is a
+       * single load in a dense 64 KB table of handler indexes, and the
+       * classic BPF program returned by filter() makes the kernel drop
+       * frames of unregistered ethertypes before they are queued.
+       * \code
+       *  ethertype_dispatcher dispatcher;
+       *
+       *  dispatcher.add(ETH_P_IP, on_ipv4);
+       *  dispatcher.add(ETH_P_ARP, on_arp);
+       *  dispatcher.attach(server.socket());
+       *
+       *  // in handle_recv()
+       *  dispatcher.dispatch(buffer().data(), nb);
+       * \endcode
+       */
+      class ethertype_dispatcher
+      {
+        public:
+          /**
+           * \brief Frame handler.
+           * \param type ethertype in host byte order.
+           * \param data frame.
+           * \param len frame length.
+           */
+          typedef std::function<void(uint16_t type, const char* data,
+              size_t len)> handler;
+
+          /**
+           * \brief Maximum number of registered ethertypes.
+           */
+          static const size_t max_types = 255;
+
+          /**
+           * \brief Constructor.
+           */
+          ethertype_dispatcher();
+
+          /**
+           * \brief Registers handler for an ethertype.
+           * \param type ethertype in host byte order.
+           * \param h handler.
+           * \throw std::length_error if max_types are already registered.
+           */
+          void add(uint16_t type, const handler& h);
+
+          /**
+           * \brief Sets catch-all handler for unregistered ethertypes.
+           * \param h handler, nullptr to remove it.
+           * \note with a catch-all handler filter() accepts every frame.
+           */
+          void set_default(const handler& h);
+
+          /**
+           * \brief Dispatches a frame.
+           * \param data frame.
+           * \param len frame length.
+           * \return true if a handler was called.
+           */
+          bool dispatch(const char* data, size_t len) const;
+
+          /**
+           * \brief Returns BPF program accepting registered ethertypes.
+           * \return program.
+           */
+          std::vector<struct sock_filter> filter() const;
+
+          /**
+           * \brief Attaches filter() to a socket.
+           * \param socket socket, without pending receive operation.
+           */
+          void attach(ll_protocol::socket& socket) const;
+
+          /**
+           * \brief Builds a BPF program accepting some ethertypes.
+           * \param types ethertypes in host byte order.
+           * \param count number of ethertypes (at most max_types).
+           * \param accept_all accept every frame (catch-all registered).
+           * \return program.
+           */
+          static std::vector<struct sock_filter> make_filter(
+              const uint16_t* types, size_t count, bool accept_all = false);
+
+          /**
+           * \brief Attaches a BPF program to a socket and flushes frames
+           * queued before it was attached.
+           * \param socket socket, without pending receive operation.
+           * \param program BPF program.
+           */
+          static void attach(ll_protocol::socket& socket,
+              const std::vector<struct sock_filter>& program);
+
+          /**
+           * \brief Returns ethertype of a frame.
+           * \param data frame.
+           * \param len frame length, at least 14 bytes.
+           * \return ethertype in host byte order.
+           */
+          static uint16_t ethertype(const char* data, size_t len)
+          {
+            const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+
+            (void)len;
+            return static_cast<uint16_t>(p[12] << 8 | p[13]);
+          }
+
+        private:
+          /**
+           * \brief Handler index per ethertype (0: catch-all).
+           */
+          std::vector<uint8_t> m_index;
+
+          /**
+           * \brief Handlers, index 0 is the catch-all handler.
+           */
+          std::vector<handler> m_handlers;
+
+          /**
+           * \brief Registered ethertypes.
+           */
+          std::vector<uint16_t> m_types;
+      };
+
+      /**
+       * \struct ethertype_index
+       * \brief Compile-time search of an ethertype in a list.
+       * \tparam Types ethertypes.
+       */
+      template <uint16_t... Types>
+      struct ethertype_index;
+
+      /**
+       * \struct ethertype_index<>
+       * \brief End of the list: not found.
+       */
+      template <>
+      struct ethertype_index<>
+      {
+        /**
+         * \brief Returns index of an ethertype.
+         * \param type ethertype.
+         * \return 0.
+         */
+        static constexpr size_t find(uint16_t type)
+        {
+          return (void)type, 0;
+        }
+      };
+
+      /**
+       * \struct ethertype_index<Type, Types...>
+       * \brief Compares with head of the list.
+       */
+      template <uint16_t Type, uint16_t... Types>
+      struct ethertype_index<Type, Types...>
+      {
+        /**
+         * \brief Returns index of an ethertype.
+         * \param type ethertype.
+         * \return index, or list size if not found.
+         */
+        static constexpr size_t find(uint16_t type)
+        {
+          return type == Type ? 0 : 1 + ethertype_index<Types...>::find(type);
+        }
+      };
+
+      /**
+       * \class static_ethertype_dispatcher
+       * \brief Ethertype dispatcher for a set known at compile time.
+       *
+       * Lookup compiles to a chain of immediate compares (or a jump
+       * table), without any memory access besides the handler itself.
+       * \code
+       *  static_ethertype_dispatcher<ETH_P_IP, ETH_P_IPV6> dispatcher;
+       *
+       *  dispatcher.set<ETH_P_IP>(on_ipv4);
+       *  dispatcher.set<ETH_P_IPV6>(on_ipv6);
+       * \endcode
+       * \tparam Types ethertypes in host byte order.
+       */
+      template <uint16_t... Types>
+      class static_ethertype_dispatcher
+      {
+        public:
+          /**
+           * \brief Frame handler.
+           */
+          typedef ethertype_dispatcher::handler handler;
+
+          /**
+           * \brief Sets handler for an ethertype of the set.
+           * \tparam Type ethertype.
+           * \param h handler.
+           */
+          template <uint16_t Type>
+          void set(const handler& h)
+          {
+            static_assert(ethertype_index<Types...>::find(Type) <
+                sizeof...(Types), "ethertype not in the dispatcher set");
+
+            m_handlers[ethertype_index<Types...>::find(Type)] = h;
+          }
+
+          /**
+           * \brief Sets catch-all handler for other ethertypes.
+           * \param h handler, nullptr to remove it.
+           */
+          void set_default(const handler& h)
+          {
+            m_handlers[sizeof...(Types)] = h;
+          }
+
+          /**
+           * \brief Dispatches a frame.
+           * \param data frame.
+           * \param len frame length.
+           * \return true if a handler was called.
+           */
+          bool dispatch(const char* data, size_t len) const
+          {
+            uint16_t type = 0;
+            const handler* h = nullptr;
+
+            if(len < sizeof(struct ether_header))
+            {
+              return false;
+            }
+
+            type = ethertype_dispatcher::ethertype(data, len);
+            h = &m_handlers[ethertype_index<Types...>::find(type)];
+
+            if(!*h)
+            {
+              return false;
+            }
+
+            (*h)(type, data, len);
+            return true;
+          }
+
+          /**
+           * \brief Returns BPF program accepting the ethertypes of the set.
+           * \return program.
+           */
+          std::vector<struct sock_filter> filter() const
+          {
+            const uint16_t types[] = {Types...};
+
+            return ethertype_dispatcher::make_filter(types,
+                sizeof...(Types), static_cast<bool>(
+                  m_handlers[sizeof...(Types)]));
+          }
+
+          /**
+           * \brief Attaches filter() to a socket.
+           * \param socket socket, without pending receive operation.
+           */
+          void attach(ll_protocol::socket& socket) const
+          {
+            ethertype_dispatcher::attach(socket, filter());
+          }
+
+        private:
+          static_assert(sizeof...(Types) > 0 &&
+              sizeof...(Types) <= ethertype_dispatcher::max_types,
+              "1 to 255 ethertypes");
+
+          /**
+           * \brief Handlers in set order, then catch-all handler.
+           */
+          std::array<handler, sizeof...(Types) + 1> m_handlers;
+      };
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
+
+#endif /* ASIO_RAW_LL_ETHERTYPE_DISPATCHER_HPP */
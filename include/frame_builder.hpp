@@ -0,0 +1,237 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file frame_builder.hpp
+ * \brief Ethernet/IP/UDP/TCP frame builder.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef ASIO_RAW_LL_FRAME_BUILDER_HPP
+#define ASIO_RAW_LL_FRAME_BUILDER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <vector>
+
+#include <netinet/in.h>
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \class frame_builder
+       * \brief Lays out a header template once and stamps it in front of
+       * payloads.
+       *
+       * Layers are added outermost first. The constant part of the IPv4
+       * header checksum and of the L4 checksum (pseudo-header and L4
+       * header) are summed once when the template is built, so building a
+       * frame only sums the payload (vectorized) and the length words.
+       * \code
+       *  frame_builder fb;
+       *
+       *  fb.ethernet(dst_mac, src_mac)
+       *    .ipv4(inet_addr("10.0.0.1"), inet_addr("10.0.0.2"))
+       *    .udp(1234, 5678);
+       *
+       *  // payload written in place after the headers, no copy
+       *  memcpy(buf + fb.header_len(), payload, payload_len);
+       *  size_t len = fb.build(buf, payload_len);
+       *  server.async_send(buf, len);
+       * \endcode
+       */
+      class frame_builder
+      {
+        public:
+          /**
+           * \brief Constructor.
+           */
+          frame_builder();
+
+          /**
+           * \brief Adds ethernet header.
+           * \param dst destination MAC address.
+           * \param src source MAC address.
+           * \return the current object.
+           * \throw std::logic_error if header is not empty.
+           */
+          frame_builder& ethernet(const uint8_t* dst, const uint8_t* src);
+
+          /**
+           * \brief Adds 802.1Q tag.
+           * \param tci tag control information (PCP, DEI and VLAN ID).
+           * \return the current object.
+           * \throw std::logic_error if not following ethernet or a tag.
+           */
+          frame_builder& vlan(uint16_t tci);
+
+          /**
+           * \brief Adds IPv4 header.
+           * \param src source address in network byte order.
+           * \param dst destination address in network byte order.
+           * \param ttl time to live.
+           * \param tos type of service.
+           * \return the current object.
+           * \throw std::logic_error if not following ethernet or a tag.
+           */
+          frame_builder& ipv4(uint32_t src, uint32_t dst, uint8_t ttl = 64,
+              uint8_t tos = 0);
+
+          /**
+           * \brief Adds IPv6 header.
+           * \param src source address.
+           * \param dst destination address.
+           * \param hop_limit hop limit.
+           * \return the current object.
+           * \throw std::logic_error if not following ethernet or a tag.
+           */
+          frame_builder& ipv6(const struct in6_addr& src,
+              const struct in6_addr& dst, uint8_t hop_limit = 64);
+
+          /**
+           * \brief Adds UDP header.
+           * \param sport source port.
+           * \param dport destination port.
+           * \return the current object.
+           * \throw std::logic_error if not following an IP header.
+           */
+          frame_builder& udp(uint16_t sport, uint16_t dport);
+
+          /**
+           * \brief Adds TCP header (without options).
+           * \param sport source port.
+           * \param dport destination port.
+           * \param seq sequence number.
+           * \param ack acknowledgment number.
+           * \param flags TCP flags (TH_SYN, TH_ACK, ...).
+           * \param window receive window.
+           * \return the current object.
+           * \throw std::logic_error if not following an IP header.
+           */
+          frame_builder& tcp(uint16_t sport, uint16_t dport, uint32_t seq,
+              uint32_t ack, uint8_t flags, uint16_t window = 65535);
+
+          /**
+           * \brief Returns length of the header template.
+           * \return length, offset of the payload in a frame.
+           */
+          size_t header_len() const;
+
+          /**
+           * \brief Returns offset of the IP header.
+           * \return offset, 0 if none.
+           */
+          size_t l3_offset() const;
+
+          /**
+           * \brief Returns offset of the UDP/TCP header.
+           * \return offset, 0 if none.
+           */
+          size_t l4_offset() const;
+
+          /**
+           * \brief Returns header template.
+           * \return header template.
+           */
+          const std::vector<char>& header() const;
+
+          /**
+           * \brief Builds a frame whose payload is already in place.
+           * \param frame frame buffer, payload at frame + header_len().
+           * \param payload_len payload length.
+           * \return frame length.
+           */
+          size_t build(char* frame, size_t payload_len) const;
+
+          /**
+           * \brief Builds a frame.
+           * \param frame frame buffer.
+           * \param frame_size frame buffer size.
+           * \param payload payload.
+           * \param payload_len payload length.
+           * \return frame length.
+           * \throw std::length_error if frame buffer is too small.
+           */
+          size_t build(char* frame, size_t frame_size, const void* payload,
+              size_t payload_len) const;
+
+        private:
+          /**
+           * \brief Sets ethertype of the innermost link-layer header.
+           * \param type ethertype.
+           */
+          void set_ethertype(uint16_t type);
+
+          /**
+           * \brief Sets protocol in the IP header and starts L4 header.
+           * \param proto IPPROTO_UDP or IPPROTO_TCP.
+           */
+          void set_l4_proto(int proto);
+
+          /**
+           * \brief Checks an L3 header can be added.
+           */
+          void check_l3() const;
+
+          /**
+           * \brief Sums constant parts of checksums.
+           */
+          void prepare();
+
+          /**
+           * \brief Header template.
+           */
+          std::vector<char> m_header;
+
+          /**
+           * \brief Offset of the innermost ethertype, 0 if no ethernet.
+           */
+          size_t m_type_offset;
+
+          /**
+           * \brief IP header offset.
+           */
+          size_t m_l3;
+
+          /**
+           * \brief L4 header offset.
+           */
+          size_t m_l4;
+
+          /**
+           * \brief IP version (0, 4 or 6).
+           */
+          int m_ip_version;
+
+          /**
+           * \brief L4 protocol (0, IPPROTO_UDP or IPPROTO_TCP).
+           */
+          int m_l4_proto;
+
+          /**
+           * \brief Partial sum of the IPv4 header without total length.
+           */
+          uint32_t m_ip_sum;
+
+          /**
+           * \brief Partial sum of the pseudo-header without length and
+           * of the L4 header without length and checksum.
+           */
+          uint32_t m_l4_sum;
+      };
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
+
+#endif /* ASIO_RAW_LL_FRAME_BUILDER_HPP */
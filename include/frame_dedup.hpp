@@ -0,0 +1,213 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file frame_dedup.hpp
+ * \brief Duplicate frame filter.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef ASIO_RAW_LL_FRAME_DEDUP_HPP
+#define ASIO_RAW_LL_FRAME_DEDUP_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+#include <boost/noncopyable.hpp>
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \class frame_dedup
+       * \brief Drops frames already seen within a time window, i.e. the
+       * second copy of each frame delivered by a mirror port that
+       * duplicates both ingress and egress traffic.
+       *
+       * A 64-bit fingerprint of a byte range of each frame (CRC32C with
+       * SSE4.2) is looked up in a fixed-size table of 4-way sets, one
+       * cache line each. A frame matching a fingerprint recorded less
+       * than the window ago is a duplicate; otherwise its fingerprint
+       * replaces the oldest entry of its set. The table is allocated once:
+       * no allocation per frame. Not thread-safe, use one per receiving
+       * thread.
+       * \code
+       *  frame_dedup dedup(65536, 1000000);
+       *
+       *  // in handle_recv()
+       *  if(dedup.duplicate(buffer().data(), nb))
+       *  {
+       *    async_recv();
+       *    return;
+       *  }
+       * \endcode
+       */
+      class frame_dedup : private boost::noncopyable
+      {
+        public:
+          /**
+           * \class statistics
+           * \brief Filter statistics.
+           */
+          class statistics
+          {
+            public:
+              /**
+               * \brief Constructor.
+               */
+              statistics();
+
+              /**
+               * \brief Number of frames checked.
+               */
+              uint64_t frames;
+
+              /**
+               * \brief Number of duplicates dropped.
+               */
+              uint64_t dropped;
+
+              /**
+               * \brief Number of fingerprints replaced before the end of
+               * their window (table too small for the frame rate).
+               */
+              uint64_t evicted;
+          };
+
+          /**
+           * \brief Number of entries per set (one cache line).
+           */
+          static const size_t ways = 4;
+
+          /**
+           * \brief Constructor.
+           * \param entries table size, power of 2 multiple of ways. At
+           * least the number of frames per window.
+           * \param window_ns time window in nanoseconds.
+           * \param offset first byte hashed.
+           * \param length number of bytes hashed, 0 up to the end of the
+           * frame.
+           * \throw std::invalid_argument if entries is invalid.
+           * \throw std::bad_alloc if memory cannot be allocated.
+           */
+          frame_dedup(size_t entries = 65536, uint64_t window_ns = 1000000,
+              size_t offset = 0, size_t length = 0);
+
+          /**
+           * \brief Destructor.
+           */
+          ~frame_dedup();
+
+          /**
+           * \brief Checks a frame, time-stamped now (CLOCK_MONOTONIC).
+           * \param data frame.
+           * \param len frame length.
+           * \return true if frame is a duplicate to drop.
+           */
+          bool duplicate(const void* data, size_t len);
+
+          /**
+           * \brief Checks a frame.
+           * \param data frame.
+           * \param len frame length.
+           * \param now_ns receive time in nanoseconds, never going back.
+           * \return true if frame is a duplicate to drop.
+           */
+          bool duplicate(const void* data, size_t len, uint64_t now_ns);
+
+          /**
+           * \brief Forgets all fingerprints.
+           */
+          void clear();
+
+          /**
+           * \brief Returns statistics.
+           * \return statistics.
+           */
+          const statistics& stats() const;
+
+          /**
+           * \brief Computes the fingerprint of data.
+           * \param data data.
+           * \param len data length.
+           * \return fingerprint, never 0.
+           * \note uses SSE4.2 CRC32C when available, see hash_scalar()
+           * otherwise.
+           */
+          static uint64_t hash(const void* data, size_t len);
+
+          /**
+           * \brief Computes the fingerprint of data without SIMD.
+           * \param data data.
+           * \param len data length.
+           * \return fingerprint, never 0.
+           */
+          static uint64_t hash_scalar(const void* data, size_t len);
+
+          /**
+           * \brief Returns name of the implementation used by hash().
+           * \return "sse4.2" or "scalar".
+           */
+          static const char* implementation();
+
+        private:
+          /**
+           * \brief Fingerprint table entry.
+           */
+          struct entry
+          {
+            /**
+             * \brief Fingerprint, 0 if unused.
+             */
+            uint64_t fingerprint;
+
+            /**
+             * \brief Time the fingerprint was recorded.
+             */
+            uint64_t time;
+          };
+
+          /**
+           * \brief Entries, set after set.
+           */
+          entry* m_entries;
+
+          /**
+           * \brief Number of sets minus one.
+           */
+          size_t m_set_mask;
+
+          /**
+           * \brief Time window.
+           */
+          uint64_t m_window;
+
+          /**
+           * \brief First byte hashed.
+           */
+          size_t m_offset;
+
+          /**
+           * \brief Number of bytes hashed, 0 for all.
+           */
+          size_t m_length;
+
+          /**
+           * \brief Statistics.
+           */
+          statistics m_stats;
+      };
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
+
+#endif /* ASIO_RAW_LL_FRAME_DEDUP_HPP */
@@ -0,0 +1,431 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file handler_allocator.hpp
+ * \brief Preallocated memory for asynchronous operations.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef ASIO_RAW_LL_HANDLER_ALLOCATOR_HPP
+#define ASIO_RAW_LL_HANDLER_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \class handler_memory
+       * \brief Memory block for one asynchronous operation at a time.
+       *
+       * Boost.Asio allocates the state of every asynchronous operation.
+       * Its per-thread cache keeps a single block, so a handler that
+       * starts both a receive and a send still reaches malloc() on each
+       * frame. Giving each outstanding operation its own block removes
+       * these allocations.
+       */
+      class handler_memory : private boost::noncopyable
+      {
+        public:
+          /**
+           * \brief Block size, larger requests use operator new.
+           */
+          static const size_t size = 512;
+
+          /**
+           * \brief Constructor.
+           */
+          handler_memory();
+
+          /**
+           * \brief Allocates memory.
+           * \param n size in bytes.
+           * \return memory.
+           * \throw std::bad_alloc if the block is in use or too small and
+           * operator new fails.
+           */
+          void* allocate(size_t n);
+
+          /**
+           * \brief Frees memory.
+           * \param p memory returned by allocate().
+           */
+          void deallocate(void* p);
+
+        private:
+          /**
+           * \brief Block.
+           */
+          std::aligned_storage<size>::type m_storage;
+
+          /**
+           * \brief Whether block is in use.
+           */
+          bool m_in_use;
+      };
+
+      /**
+       * \class handler_allocator
+       * \brief Allocator associated with a handler, serving operation
+       * state from a handler_memory.
+       */
+      template<typename T>
+      class handler_allocator
+      {
+        public:
+          /**
+           * \brief Allocated type.
+           */
+          typedef T value_type;
+
+          /**
+           * \brief Constructor.
+           * \param memory memory block.
+           */
+          explicit handler_allocator(handler_memory& memory)
+            : m_memory(&memory)
+          {
+          }
+
+          /**
+           * \brief Rebinding constructor.
+           * \param other allocator.
+           */
+          template<typename U>
+          handler_allocator(const handler_allocator<U>& other)
+            : m_memory(other.memory())
+          {
+          }
+
+          /**
+           * \brief Allocates objects.
+           * \param n number of objects.
+           * \return memory.
+           */
+          T* allocate(size_t n) const
+          {
+            return static_cast<T*>(m_memory->allocate(sizeof(T) * n));
+          }
+
+          /**
+           * \brief Frees objects.
+           * \param p memory.
+           * \param n number of objects.
+           */
+          void deallocate(T* p, size_t n) const
+          {
+            (void)n;
+            m_memory->deallocate(p);
+          }
+
+          /**
+           * \brief Returns memory block.
+           * \return memory block.
+           */
+          handler_memory* memory() const
+          {
+            return m_memory;
+          }
+
+          /**
+           * \brief Compare allocators for equality.
+           * \param other allocator.
+           * \return true if they share the memory block.
+           */
+          template<typename U>
+          bool operator==(const handler_allocator<U>& other) const
+          {
+            return m_memory == other.memory();
+          }
+
+          /**
+           * \brief Compare allocators for inequality.
+           * \param other allocator.
+           * \return true if they do not share the memory block.
+           */
+          template<typename U>
+          bool operator!=(const handler_allocator<U>& other) const
+          {
+            return m_memory != other.memory();
+          }
+
+        private:
+          /**
+           * \brief Memory block.
+           */
+          handler_memory* m_memory;
+      };
+
+      /**
+       * \class allocating_handler
+       * \brief Wraps a handler so that its operation uses a
+       * handler_memory.
+       */
+      template<typename Handler>
+      class allocating_handler
+      {
+        public:
+          /**
+           * \brief Allocator type, found by Boost.Asio.
+           */
+          typedef handler_allocator<Handler> allocator_type;
+
+          /**
+           * \brief Constructor.
+           * \param memory memory block.
+           * \param handler handler.
+           */
+          allocating_handler(handler_memory& memory, const Handler& handler)
+            : m_memory(memory),
+            m_handler(handler)
+          {
+          }
+
+          /**
+           * \brief Returns allocator.
+           * \return allocator.
+           */
+          allocator_type get_allocator() const
+          {
+            return allocator_type(m_memory);
+          }
+
+          /**
+           * \brief Calls the handler.
+           * \param args completion arguments.
+           */
+          template<typename... Args>
+          void operator()(Args&&... args)
+          {
+            m_handler(std::forward<Args>(args)...);
+          }
+
+        private:
+          /**
+           * \brief Memory block.
+           */
+          handler_memory& m_memory;
+
+          /**
+           * \brief Handler.
+           */
+          Handler m_handler;
+      };
+
+      /**
+       * \brief Wraps a handler so that its operation uses a
+       * handler_memory.
+       * \param memory memory block, must outlive the operation.
+       * \param handler handler.
+       * \return wrapped handler.
+       */
+      template<typename Handler>
+      inline allocating_handler<Handler> make_allocating_handler(
+          handler_memory& memory, const Handler& handler)
+      {
+        return allocating_handler<Handler>(memory, handler);
+      }
+
+      template<typename Handler>
+      class send_pool_handler;
+
+      /**
+       * \class send_pool
+       * \brief Preallocated send buffers, each with the memory of its
+       * pending operation.
+       *
+       * A frame is copied into a free slot and sent from there; the slot
+       * is released when the send completes. Sends do not allocate as
+       * long as a slot is free.
+       * \code
+       *  uint32_t slot = 0;
+       *  char* buf = pool.acquire(len, slot);
+       *
+       *  if(buf)
+       *  {
+       *    memcpy(buf, data, len);
+       *    socket.async_send(boost::asio::buffer(buf, len),
+       *        pool.wrap(slot, handler));
+       *  }
+       * \endcode
+       */
+      class send_pool : private boost::noncopyable
+      {
+        public:
+          /**
+           * \brief Constructor, without slots until reset().
+           */
+          send_pool();
+
+          /**
+           * \brief Constructor.
+           * \param slots number of slots.
+           * \param slot_size size of a slot.
+           * \param handlers whether each slot has a handler_memory, for
+           * wrap().
+           */
+          send_pool(size_t slots, size_t slot_size, bool handlers = true);
+
+          /**
+           * \brief Allocates slots again, all free.
+           * \param slots number of slots.
+           * \param slot_size size of a slot.
+           * \param handlers whether each slot has a handler_memory, for
+           * wrap().
+           */
+          void reset(size_t slots, size_t slot_size, bool handlers = true);
+
+          /**
+           * \brief Takes a free slot.
+           * \param len data length.
+           * \param slot slot index, set on success.
+           * \return slot buffer, or nullptr if len is larger than a slot
+           * or no slot is free.
+           */
+          char* acquire(size_t len, uint32_t& slot);
+
+          /**
+           * \brief Gives a slot back.
+           * \param slot slot index.
+           */
+          void release(uint32_t slot);
+
+          /**
+           * \brief Returns buffer of a slot.
+           * \param slot slot index.
+           * \return buffer.
+           */
+          char* data(uint32_t slot);
+
+          /**
+           * \brief Returns buffer of all slots, contiguous.
+           * \return buffer.
+           */
+          char* data();
+
+          /**
+           * \brief Returns size of all slots.
+           * \return size in bytes.
+           */
+          size_t size() const;
+
+          /**
+           * \brief Returns size of a slot.
+           * \return size in bytes.
+           */
+          size_t slot_size() const;
+
+          /**
+           * \brief Wraps the completion handler of a send from a slot: the
+           * operation uses the slot memory, and the slot is released
+           * before the handler is called.
+           * \param slot slot index.
+           * \param handler handler.
+           * \return wrapped handler.
+           */
+          template<typename Handler>
+          allocating_handler<send_pool_handler<Handler>> wrap(uint32_t slot,
+              const Handler& handler);
+
+        private:
+          /**
+           * \brief Buffers, slot_size bytes each.
+           */
+          std::vector<char> m_buffers;
+
+          /**
+           * \brief Memory of the pending operation of each slot.
+           */
+          std::unique_ptr<handler_memory[]> m_memory;
+
+          /**
+           * \brief Free slots, lowest index on top.
+           */
+          std::vector<uint32_t> m_free;
+
+          /**
+           * \brief Size of a slot.
+           */
+          size_t m_slot_size;
+      };
+
+      /**
+       * \class send_pool_handler
+       * \brief Releases a send_pool slot, then calls a handler.
+       */
+      template<typename Handler>
+      class send_pool_handler
+      {
+        public:
+          /**
+           * \brief Constructor.
+           * \param pool pool.
+           * \param slot slot index.
+           * \param handler handler.
+           */
+          send_pool_handler(send_pool& pool, uint32_t slot,
+              const Handler& handler)
+            : m_pool(pool),
+            m_slot(slot),
+            m_handler(handler)
+          {
+          }
+
+          /**
+           * \brief Releases the slot and calls the handler.
+           * \param args completion arguments.
+           */
+          template<typename... Args>
+          void operator()(Args&&... args)
+          {
+            m_pool.release(m_slot);
+            m_handler(std::forward<Args>(args)...);
+          }
+
+        private:
+          /**
+           * \brief Pool.
+           */
+          send_pool& m_pool;
+
+          /**
+           * \brief Slot index.
+           */
+          uint32_t m_slot;
+
+          /**
+           * \brief Handler.
+           */
+          Handler m_handler;
+      };
+
+      template<typename Handler>
+      inline allocating_handler<send_pool_handler<Handler>> send_pool::wrap(
+          uint32_t slot, const Handler& handler)
+      {
+        return make_allocating_handler(m_memory[slot],
+            send_pool_handler<Handler>(*this, slot, handler));
+      }
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
+
+#endif /* ASIO_RAW_LL_HANDLER_ALLOCATOR_HPP */
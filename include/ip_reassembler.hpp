@@ -0,0 +1,592 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file ip_reassembler.hpp
+ * \brief IPv4 and IPv6 fragment reassembly.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef ASIO_RAW_LL_IP_REASSEMBLER_HPP
+#define ASIO_RAW_LL_IP_REASSEMBLER_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+#include <functional>
+#include <vector>
+
+#include <sys/uio.h>
+
+#include <boost/noncopyable.hpp>
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \class ip_reassembler
+       * \brief Reassembles IPv4 and IPv6 fragments into datagrams with
+       * bounded memory.
+       *
+       * All memory is allocated by the constructor: a fixed number of
+       * reassembly contexts and a pool of fixed-size buffers, one per
+       * fragment. A fragment is copied once, from the receive buffer to a
+       * pool buffer; the complete datagram is delivered as a list of
+       * I/O vectors over the rebuilt header and these buffers, without a
+       * second copy.
+       *
+       * Contexts are found with a hash table on (source, destination,
+       * identification, protocol) and expire from a timer wheel, both in
+       * constant time. When contexts or buffers run out, i.e. under a
+       * fragment flood, the oldest datagram is evicted and counted.
+       * Overlapping fragments discard the whole datagram (RFC 5722).
+       * \code
+       *  ip_reassembler reasm;
+       *
+       *  reasm.set_handler([](const ip_reassembler::datagram& d)
+       *  {
+       *    parse(d.iov, d.iovcnt);
+       *  });
+       *
+       *  // in handle_recv()
+       *  if(reasm.add_frame(buffer().data(), nb) ==
+       *      ip_reassembler::not_fragment)
+       *  {
+       *    parse_frame(buffer().data(), nb);
+       *  }
+       * \endcode
+       * \note not thread-safe, use one per receiving thread.
+       */
+      class ip_reassembler : private boost::noncopyable
+      {
+        public:
+          /**
+           * \enum result
+           * \brief Outcome of adding a packet.
+           */
+          enum result
+          {
+            /**
+             * \brief Not an IP fragment, to be processed as is.
+             */
+            not_fragment,
+
+            /**
+             * \brief Fragment stored, datagram incomplete.
+             */
+            queued,
+
+            /**
+             * \brief Fragment completed a datagram, handler was called.
+             */
+            completed,
+
+            /**
+             * \brief Fragment discarded (malformed, overlapping, too
+             * large or no memory).
+             */
+            dropped
+          };
+
+          /**
+           * \class datagram
+           * \brief View of a reassembled datagram, valid during the
+           * handler call only.
+           */
+          class datagram
+          {
+            public:
+              /**
+               * \brief Copies the datagram to a contiguous buffer.
+               * \param out buffer.
+               * \param size buffer size.
+               * \return number of bytes copied.
+               */
+              size_t copy(void* out, size_t size) const;
+
+              /**
+               * \brief AF_INET or AF_INET6.
+               */
+              int family;
+
+              /**
+               * \brief Upper layer protocol.
+               */
+              uint8_t protocol;
+
+              /**
+               * \brief Header (without fragment header for IPv6, lengths
+               * and checksum updated), then payload pieces in order.
+               */
+              const struct iovec* iov;
+
+              /**
+               * \brief Number of I/O vectors.
+               */
+              size_t iovcnt;
+
+              /**
+               * \brief Total length in bytes.
+               */
+              size_t len;
+          };
+
+          /**
+           * \class statistics
+           * \brief Reassembly statistics.
+           */
+          class statistics
+          {
+            public:
+              /**
+               * \brief Constructor.
+               */
+              statistics();
+
+              /**
+               * \brief Number of fragments received.
+               */
+              uint64_t fragments;
+
+              /**
+               * \brief Number of datagrams reassembled.
+               */
+              uint64_t datagrams;
+
+              /**
+               * \brief Number of incomplete datagrams expired.
+               */
+              uint64_t timeouts;
+
+              /**
+               * \brief Number of incomplete datagrams evicted because
+               * contexts or buffers ran out.
+               */
+              uint64_t evicted;
+
+              /**
+               * \brief Number of fragments discarded.
+               */
+              uint64_t dropped;
+          };
+
+          /**
+           * \brief Complete datagram handler.
+           * \param d datagram.
+           */
+          typedef std::function<void(const datagram& d)> handler;
+
+          /**
+           * \brief Constructor.
+           * \param contexts maximum number of datagrams being reassembled.
+           * \param buffers number of fragment buffers.
+           * \param buffer_size fragment buffer size, larger fragments
+           * are dropped (at least the MTU).
+           * \param timeout_ns reassembly timeout in nanoseconds.
+           * \param max_fragments maximum number of fragments per
+           * datagram.
+           * \throw std::invalid_argument if a parameter is invalid.
+           */
+          ip_reassembler(size_t contexts = 1024, size_t buffers = 8192,
+              size_t buffer_size = 2048, uint64_t timeout_ns = 30000000000ULL,
+              size_t max_fragments = 64);
+
+          /**
+           * \brief Sets the complete datagram handler.
+           * \param h handler.
+           */
+          void set_handler(const handler& h);
+
+          /**
+           * \brief Adds an Ethernet frame (802.1Q and 802.1ad tags are
+           * skipped), time-stamped now (CLOCK_MONOTONIC).
+           * \param data frame.
+           * \param len frame length.
+           * \return result.
+           */
+          result add_frame(const char* data, size_t len);
+
+          /**
+           * \brief Adds an Ethernet frame.
+           * \param data frame.
+           * \param len frame length.
+           * \param now_ns receive time in nanoseconds, never going back.
+           * \return result.
+           */
+          result add_frame(const char* data, size_t len, uint64_t now_ns);
+
+          /**
+           * \brief Adds an IPv4 or IPv6 packet.
+           * \param data packet, starting with the IP header.
+           * \param len packet length.
+           * \param now_ns receive time in nanoseconds, never going back.
+           * \return result.
+           */
+          result add_packet(const char* data, size_t len, uint64_t now_ns);
+
+          /**
+           * \brief Expires incomplete datagrams, also done by add_*().
+           * \param now_ns current time in nanoseconds.
+           */
+          void expire(uint64_t now_ns);
+
+          /**
+           * \brief Returns statistics.
+           * \return statistics.
+           */
+          const statistics& stats() const;
+
+          /**
+           * \brief Returns number of datagrams being reassembled.
+           * \return number of contexts in use.
+           */
+          size_t pending() const;
+
+          /**
+           * \brief Returns number of free fragment buffers.
+           * \return number of buffers.
+           */
+          size_t free_buffers() const;
+
+        private:
+          /**
+           * \brief Maximum stored header length (IPv6 with extension
+           * headers before the fragment header).
+           */
+          static const size_t max_header = 128;
+
+          /**
+           * \brief Number of timer wheel slots.
+           */
+          static const size_t wheel_size = 64;
+
+          /**
+           * \brief Datagram key, no padding so that it can be hashed and
+           * compared as bytes.
+           */
+          struct key
+          {
+            /**
+             * \brief Source address (IPv4 in the first 4 bytes).
+             */
+            uint8_t src[16];
+
+            /**
+             * \brief Destination address (IPv4 in the first 4 bytes).
+             */
+            uint8_t dst[16];
+
+            /**
+             * \brief Identification.
+             */
+            uint32_t id;
+
+            /**
+             * \brief Protocol.
+             */
+            uint8_t protocol;
+
+            /**
+             * \brief AF_INET or AF_INET6.
+             */
+            uint8_t family;
+
+            /**
+             * \brief Padding, zero.
+             */
+            uint8_t pad[2];
+          };
+
+          /**
+           * \brief Stored fragment.
+           */
+          struct fragment
+          {
+            /**
+             * \brief Payload offset in the datagram.
+             */
+            uint32_t offset;
+
+            /**
+             * \brief Payload length.
+             */
+            uint32_t len;
+
+            /**
+             * \brief Buffer index.
+             */
+            uint32_t buffer;
+          };
+
+          /**
+           * \brief Reassembly context.
+           */
+          struct context
+          {
+            /**
+             * \brief Datagram key.
+             */
+            key k;
+
+            /**
+             * \brief Expiry tick.
+             */
+            uint64_t expires;
+
+            /**
+             * \brief Next context in hash bucket.
+             */
+            uint32_t hash_next;
+
+            /**
+             * \brief Previous context in timer wheel slot.
+             */
+            uint32_t wheel_prev;
+
+            /**
+             * \brief Next context in timer wheel slot.
+             */
+            uint32_t wheel_next;
+
+            /**
+             * \brief Payload length, 0 until the last fragment arrived.
+             */
+            uint32_t total;
+
+            /**
+             * \brief Payload bytes received.
+             */
+            uint32_t received;
+
+            /**
+             * \brief Number of fragments.
+             */
+            uint32_t count;
+
+            /**
+             * \brief Header length, 0 until the first fragment arrived.
+             */
+            uint32_t header_len;
+
+            /**
+             * \brief Offset of the next header field to restore (IPv6).
+             */
+            uint32_t next_header_offset;
+
+            /**
+             * \brief Header of the first fragment.
+             */
+            uint8_t header[max_header];
+          };
+
+          /**
+           * \brief Parsed fragment.
+           */
+          struct parsed
+          {
+            /**
+             * \brief Datagram key.
+             */
+            key k;
+
+            /**
+             * \brief Header (unfragmentable part).
+             */
+            const char* header;
+
+            /**
+             * \brief Header length.
+             */
+            size_t header_len;
+
+            /**
+             * \brief Offset of the next header field pointing to the
+             * fragment header (IPv6).
+             */
+            size_t next_header_offset;
+
+            /**
+             * \brief Payload.
+             */
+            const char* payload;
+
+            /**
+             * \brief Payload length.
+             */
+            size_t payload_len;
+
+            /**
+             * \brief Payload offset in the datagram.
+             */
+            size_t offset;
+
+            /**
+             * \brief Whether more fragments follow.
+             */
+            bool more;
+          };
+
+          /**
+           * \brief Parses an IPv4 fragment.
+           * \param data packet.
+           * \param len packet length.
+           * \param p parsed fragment.
+           * \return not_fragment, dropped if malformed or queued.
+           */
+          result parse_ipv4(const char* data, size_t len, parsed& p) const;
+
+          /**
+           * \brief Parses an IPv6 fragment.
+           * \param data packet.
+           * \param len packet length.
+           * \param p parsed fragment.
+           * \return not_fragment, dropped if malformed or queued.
+           */
+          result parse_ipv6(const char* data, size_t len, parsed& p) const;
+
+          /**
+           * \brief Finds the context of a key.
+           * \param k key.
+           * \param bucket hash bucket of the key.
+           * \return context index or npos.
+           */
+          uint32_t find(const key& k, size_t bucket) const;
+
+          /**
+           * \brief Creates a context, evicting the oldest if none is free.
+           * \param k key.
+           * \param bucket hash bucket of the key.
+           * \param now_ns current time.
+           * \return context index or npos.
+           */
+          uint32_t create(const key& k, size_t bucket, uint64_t now_ns);
+
+          /**
+           * \brief Takes a fragment buffer, evicting old datagrams if none
+           * is free.
+           * \param keep context not to evict.
+           * \return buffer index or npos.
+           */
+          uint32_t take_buffer(uint32_t keep);
+
+          /**
+           * \brief Returns oldest context.
+           * \param keep context not to return.
+           * \return context index or npos.
+           */
+          uint32_t oldest(uint32_t keep) const;
+
+          /**
+           * \brief Inserts a fragment in a context.
+           * \param c context index.
+           * \param p parsed fragment.
+           * \return queued, completed or dropped.
+           */
+          result insert(uint32_t c, const parsed& p);
+
+          /**
+           * \brief Delivers a complete datagram.
+           * \param c context index.
+           */
+          void deliver(uint32_t c);
+
+          /**
+           * \brief Frees a context and its buffers.
+           * \param c context index.
+           */
+          void release(uint32_t c);
+
+          /**
+           * \brief Complete datagram handler.
+           */
+          handler m_handler;
+
+          /**
+           * \brief Contexts.
+           */
+          std::vector<context> m_contexts;
+
+          /**
+           * \brief Fragments, max_fragments per context.
+           */
+          std::vector<fragment> m_fragments;
+
+          /**
+           * \brief Free contexts.
+           */
+          std::vector<uint32_t> m_free_contexts;
+
+          /**
+           * \brief Fragment buffers memory.
+           */
+          std::vector<char> m_memory;
+
+          /**
+           * \brief Free fragment buffers.
+           */
+          std::vector<uint32_t> m_free_buffers;
+
+          /**
+           * \brief Hash buckets, first context of each chain.
+           */
+          std::vector<uint32_t> m_buckets;
+
+          /**
+           * \brief Timer wheel slots, oldest context first.
+           */
+          uint32_t m_wheel_head[wheel_size];
+
+          /**
+           * \brief Timer wheel slots, newest context.
+           */
+          uint32_t m_wheel_tail[wheel_size];
+
+          /**
+           * \brief Delivery I/O vectors.
+           */
+          std::vector<struct iovec> m_iov;
+
+          /**
+           * \brief Fragment buffer size.
+           */
+          size_t m_buffer_size;
+
+          /**
+           * \brief Maximum number of fragments per datagram.
+           */
+          size_t m_max_fragments;
+
+          /**
+           * \brief Timer wheel tick in nanoseconds.
+           */
+          uint64_t m_tick_ns;
+
+          /**
+           * \brief Timeout in ticks.
+           */
+          uint64_t m_timeout_ticks;
+
+          /**
+           * \brief Last tick expired.
+           */
+          uint64_t m_tick;
+
+          /**
+           * \brief Statistics.
+           */
+          statistics m_stats;
+      };
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
+
+#endif /* ASIO_RAW_LL_IP_REASSEMBLER_HPP */
@@ -0,0 +1,438 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file l2_forwarder.hpp
+ * \brief Link-layer forwarder between two interfaces.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef ASIO_RAW_LL_L2_FORWARDER_HPP
+#define ASIO_RAW_LL_L2_FORWARDER_HPP
+
+#include <functional>
+#include <vector>
+
+#include <sys/uio.h>
+
+#include <boost/noncopyable.hpp>
+
+#include "handler_allocator.hpp"
+#include "ll_protocol.hpp"
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \class l2_forwarder
+       * \brief Forwards frames in both directions between two interfaces
+       * (inline bridge).
+       *
+       * Each direction receives a batch of frames with one recvmmsg() call
+       * into a pool of slots, passes each frame to the inspector, then sends
+       * the kept frames to the other interface with one sendmmsg() call
+       * straight from the slots they were received in: no copy in user
+       * space, two system calls per batch.
+       *
+       * VLAN tags stripped by the NIC are put back in the frame
+       * (PACKET_AUXDATA). Frames that cannot be queued on the output
+       * interface are dropped and counted, as a switch would.
+       * \code
+       *  l2_forwarder fwd(ios, "eth1", "eth2");
+       *
+       *  fwd.set_inspector([](l2_forwarder::direction dir, char* data,
+       *        size_t& len)
+       *  {
+       *    return is_allowed(data, len) ? l2_forwarder::forward :
+       *      l2_forwarder::drop;
+       *  });
+       *  fwd.start();
+       *  ios.run();
+       * \endcode
+       */
+      class l2_forwarder : private boost::noncopyable
+      {
+        public:
+          /**
+           * \enum direction
+           * \brief Forwarding direction.
+           */
+          enum direction
+          {
+            /**
+             * \brief From first to second interface.
+             */
+            a_to_b = 0,
+
+            /**
+             * \brief From second to first interface.
+             */
+            b_to_a = 1
+          };
+
+          /**
+           * \enum verdict
+           * \brief Inspector decision.
+           */
+          enum verdict
+          {
+            /**
+             * \brief Send frame to the other interface.
+             */
+            forward,
+
+            /**
+             * \brief Discard frame.
+             */
+            drop
+          };
+
+          /**
+           * \brief Frame inspector.
+           * \param dir direction of the frame.
+           * \param data frame, can be modified in place.
+           * \param len frame length, can be changed up to frame_size().
+           * \return verdict.
+           */
+          typedef std::function<verdict(direction dir, char* data,
+              size_t& len)> inspector;
+
+          /**
+           * \class statistics
+           * \brief Forwarding statistics of one direction.
+           */
+          class statistics
+          {
+            public:
+              /**
+               * \brief Constructor.
+               */
+              statistics();
+
+              /**
+               * \brief Returns forwarding rate in frames per second.
+               * \return forwarded frames per second.
+               */
+              double pps() const;
+
+              /**
+               * \brief Returns mean latency from kernel receive timestamp
+               * to the return of sendmmsg().
+               * \return latency in nanoseconds.
+               */
+              double mean_latency_ns() const;
+
+              /**
+               * \brief Number of frames received.
+               */
+              uint64_t received;
+
+              /**
+               * \brief Number of frames forwarded.
+               */
+              uint64_t forwarded;
+
+              /**
+               * \brief Number of frames dropped by the inspector.
+               */
+              uint64_t dropped;
+
+              /**
+               * \brief Number of frames dropped because output queue was
+               * full or send failed.
+               */
+              uint64_t tx_dropped;
+
+              /**
+               * \brief Number of frames larger than frame_size().
+               */
+              uint64_t truncated;
+
+              /**
+               * \brief Number of recvmmsg() batches.
+               */
+              uint64_t batches;
+
+              /**
+               * \brief Time since start() in nanoseconds.
+               */
+              uint64_t elapsed_ns;
+
+              /**
+               * \brief Number of latency samples.
+               */
+              uint64_t latency_samples;
+
+              /**
+               * \brief Sum of latency samples in nanoseconds.
+               */
+              uint64_t latency_sum_ns;
+
+              /**
+               * \brief Worst latency in nanoseconds.
+               */
+              uint64_t latency_max_ns;
+          };
+
+          /**
+           * \brief Constructor.
+           * \param ios Boost.Asio IO service.
+           * \param ifname_a first interface.
+           * \param ifname_b second interface.
+           * \param batch maximum number of frames per system call (1 to
+           * 1024).
+           * \param frame_size maximum frame size, larger frames are
+           * dropped.
+           * \param promiscuous put both interfaces in promiscuous mode.
+           * \throw boost::system::system_error if sockets cannot be
+           * opened.
+           */
+          l2_forwarder(boost::asio::io_service& ios,
+              const std::string& ifname_a, const std::string& ifname_b,
+              size_t batch = 64, size_t frame_size = 2048,
+              bool promiscuous = true);
+
+          /**
+           * \brief Sets the inspector called for each frame.
+           * \param f inspector, nullptr to forward every frame.
+           */
+          void set_inspector(const inspector& f);
+
+          /**
+           * \brief Starts forwarding, statistics are reset.
+           */
+          void start();
+
+          /**
+           * \brief Stops forwarding.
+           */
+          void stop();
+
+          /**
+           * \brief Returns the error that stopped forwarding, if any.
+           *
+           * A receive error stops both directions instead of being thrown
+           * out of the IO service. It is cleared by start().
+           * \return error value.
+           */
+          boost::system::error_code error() const;
+
+          /**
+           * \brief Returns statistics of a direction.
+           * \param dir direction.
+           * \return statistics.
+           */
+          statistics stats(direction dir) const;
+
+          /**
+           * \brief Returns maximum frame size.
+           * \return size in bytes.
+           */
+          size_t frame_size() const;
+
+        private:
+          /**
+           * \brief Receive side and send side of one direction.
+           */
+          struct path
+          {
+            /**
+             * \brief Direction.
+             */
+            direction dir;
+
+            /**
+             * \brief Socket frames are received on.
+             */
+            asio::raw::ll::ll_protocol::socket* rx;
+
+            /**
+             * \brief Socket frames are sent on.
+             */
+            asio::raw::ll::ll_protocol::socket* tx;
+
+            /**
+             * \brief Frame slots.
+             */
+            std::vector<char> slots;
+
+            /**
+             * \brief Receive I/O vectors.
+             */
+            std::vector<struct iovec> rx_iovecs;
+
+            /**
+             * \brief Receive message headers.
+             */
+            std::vector<struct mmsghdr> rx_msgs;
+
+            /**
+             * \brief Source addresses (packet type).
+             */
+            std::vector<struct sockaddr_ll> names;
+
+            /**
+             * \brief Control messages (auxdata and timestamp).
+             */
+            std::vector<char> control;
+
+            /**
+             * \brief Send I/O vectors, pointing into the slots.
+             */
+            std::vector<struct iovec> tx_iovecs;
+
+            /**
+             * \brief Send message headers.
+             */
+            std::vector<struct mmsghdr> tx_msgs;
+
+            /**
+             * \brief Kernel receive timestamp of frames to send.
+             */
+            std::vector<uint64_t> rx_ns;
+
+            /**
+             * \brief Statistics.
+             */
+            statistics stats;
+
+            /**
+             * \brief Memory of the pending wait or post, one at a time.
+             */
+            handler_memory memory;
+          };
+
+          /**
+           * \brief Configures a socket.
+           * \param socket socket.
+           * \param ifindex interface index.
+           * \param promiscuous enable promiscuous mode.
+           */
+          void setup(asio::raw::ll::ll_protocol::socket& socket, int ifindex,
+              bool promiscuous);
+
+          /**
+           * \brief Allocates slots and message headers of a path.
+           * \param p path.
+           */
+          void prepare(path& p);
+
+          /**
+           * \brief Waits for frames on a path.
+           * \param p path.
+           */
+          void arm(path& p);
+
+          /**
+           * \brief Socket readable callback.
+           * \param p path.
+           * \param error error value.
+           */
+          void handle_readable(path* p,
+              const boost::system::error_code& error);
+
+          /**
+           * \brief Receives, inspects and sends one batch.
+           * \param p path.
+           * \param error set if receive fails.
+           * \return true if batch was full (more frames may be queued).
+           */
+          bool forward_batch(path& p, boost::system::error_code& error);
+
+          /**
+           * \brief Records an error and stops forwarding.
+           * \param error error value.
+           */
+          void fail(const boost::system::error_code& error);
+
+          /**
+           * \brief Sends inspected frames of a batch.
+           * \param p path.
+           * \param count number of frames.
+           */
+          void send_batch(path& p, size_t count);
+
+          /**
+           * \brief Boost.Asio IO service.
+           */
+          boost::asio::io_service& m_ios;
+
+          /**
+           * \brief First interface endpoint.
+           */
+          asio::raw::ll::ll_protocol::endpoint m_endpoint_a;
+
+          /**
+           * \brief Second interface endpoint.
+           */
+          asio::raw::ll::ll_protocol::endpoint m_endpoint_b;
+
+          /**
+           * \brief First interface socket.
+           */
+          asio::raw::ll::ll_protocol::socket m_socket_a;
+
+          /**
+           * \brief Second interface socket.
+           */
+          asio::raw::ll::ll_protocol::socket m_socket_b;
+
+          /**
+           * \brief Frames per batch.
+           */
+          size_t m_batch;
+
+          /**
+           * \brief Maximum frame size.
+           */
+          size_t m_frame_size;
+
+          /**
+           * \brief Slot size.
+           */
+          size_t m_slot_size;
+
+          /**
+           * \brief Frame inspector.
+           */
+          inspector m_inspector;
+
+          /**
+           * \brief Both directions.
+           */
+          path m_paths[2];
+
+          /**
+           * \brief Monotonic time of start() in nanoseconds.
+           */
+          uint64_t m_start_ns;
+
+          /**
+           * \brief Monotonic time of stop() in nanoseconds.
+           */
+          uint64_t m_stop_ns;
+
+          /**
+           * \brief Whether forwarding is running.
+           */
+          bool m_running;
+
+          /**
+           * \brief Error that stopped forwarding.
+           */
+          boost::system::error_code m_error;
+      };
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
+
+#endif /* ASIO_RAW_LL_L2_FORWARDER_HPP */
@@ -16,6 +16,11 @@
 #ifndef ASIO_RAW_LL_LL_PROTOCOL_HPP
 #define ASIO_RAW_LL_LL_PROTOCOL_HPP
 
+#include <cstdint>
+#include <cstring>
+
+#include <vector>
+
 #include <boost/asio.hpp>
 
 #ifdef __linux__
@@ -25,10 +30,33 @@
 #include <net/if.h>
 #include <net/ethernet.h>
 #include <netpacket/packet.h>
+#include <linux/filter.h>
 #else
 #error "This library supports only GNU/Linux!"
 #endif
 
+/* <linux/if_packet.h> conflicts with <netpacket/packet.h>, which lacks
+ * what older glibc versions did not know about */
+#ifndef PACKET_VNET_HDR
+#define PACKET_VNET_HDR 15
+#endif
+
+#ifndef PACKET_QDISC_BYPASS
+#define PACKET_QDISC_BYPASS 20
+#endif
+
+#ifndef PACKET_IGNORE_OUTGOING
+#define PACKET_IGNORE_OUTGOING 23
+#endif
+
+#ifndef TP_STATUS_VLAN_VALID
+#define TP_STATUS_VLAN_VALID (1 << 4)
+#endif
+
+#ifndef TP_STATUS_VLAN_TPID_VALID
+#define TP_STATUS_VLAN_TPID_VALID (1 << 6)
+#endif
+
 /**
  * \namespace asio
  */
@@ -44,6 +72,48 @@ namespace asio
      */
     namespace ll
     {
+      /**
+       * \brief PACKET_AUXDATA control message, same layout as struct
+       * tpacket_auxdata of <linux/if_packet.h>.
+       */
+      struct packet_auxdata
+      {
+        /**
+         * \brief Status flags (TP_STATUS_*).
+         */
+        uint32_t tp_status;
+
+        /**
+         * \brief Original frame length.
+         */
+        uint32_t tp_len;
+
+        /**
+         * \brief Captured length.
+         */
+        uint32_t tp_snaplen;
+
+        /**
+         * \brief Offset of the link-layer header.
+         */
+        uint16_t tp_mac;
+
+        /**
+         * \brief Offset of the network header.
+         */
+        uint16_t tp_net;
+
+        /**
+         * \brief VLAN TCI stripped by the NIC.
+         */
+        uint16_t tp_vlan_tci;
+
+        /**
+         * \brief VLAN TPID stripped by the NIC.
+         */
+        uint16_t tp_vlan_tpid;
+      };
+
       /**
        * \class ll_endpoint
        * \brief Link-layer protocol endpoint.
@@ -96,6 +166,7 @@ namespace asio
           ll_endpoint(uint16_t eth_protocol = ETH_P_ALL)
             : m_protocol_type(eth_protocol)
           {
+            memset(&m_sockaddr, 0x00, sizeof(m_sockaddr));
             m_sockaddr.sll_family = PF_PACKET;
             // protocol is already htons() in ll_protocol
             m_sockaddr.sll_protocol = m_protocol_type.protocol();
@@ -126,6 +197,7 @@ namespace asio
               }
             }
 
+            memset(&m_sockaddr, 0x00, sizeof(m_sockaddr));
             m_sockaddr.sll_family = PF_PACKET;
             // protocol is already htons() in ll_protocol
             m_sockaddr.sll_protocol = m_protocol_type.protocol();
@@ -163,6 +235,15 @@ namespace asio
             return m_protocol_type;
           }
 
+          /**
+           * \brief Returns interface index.
+           * \return interface index, 0 for all interfaces.
+           */
+          int ifindex() const
+          {
+            return m_sockaddr.sll_ifindex;
+          }
+
           /**
            * \brief Returns the underlying endpoint in the native type.
            * \return the underlying endpoint in the native type.
@@ -315,6 +396,253 @@ namespace asio
            */
           typedef ll_endpoint<ll_protocol> endpoint;
 
+          /**
+           * \brief Socket option to prefix frames with a virtio_net_hdr
+           * carrying GSO/checksum offload metadata (PACKET_VNET_HDR).
+           */
+          typedef boost::asio::detail::socket_option::boolean<SOL_PACKET,
+                  PACKET_VNET_HDR> vnet_hdr;
+
+          /**
+           * \brief Socket option to receive a packet_auxdata control
+           * message (i.e. VLAN tag stripped by the NIC) with each frame
+           * (PACKET_AUXDATA).
+           */
+          typedef boost::asio::detail::socket_option::boolean<SOL_PACKET,
+                  PACKET_AUXDATA> auxdata;
+
+          /**
+           * \brief Socket option to not receive the frames sent on the
+           * interface, by this or any other socket
+           * (PACKET_IGNORE_OUTGOING, Linux 4.20).
+           */
+          typedef boost::asio::detail::socket_option::boolean<SOL_PACKET,
+                  PACKET_IGNORE_OUTGOING> ignore_outgoing;
+
+          /**
+           * \brief Socket option to send frames straight to the driver,
+           * without queueing discipline nor copy to other packet sockets
+           * (PACKET_QDISC_BYPASS).
+           */
+          typedef boost::asio::detail::socket_option::boolean<SOL_PACKET,
+                  PACKET_QDISC_BYPASS> qdisc_bypass;
+
+          /**
+           * \brief Socket option to set the receive buffer size above
+           * net.core.rmem_max, needs CAP_NET_ADMIN (SO_RCVBUFFORCE).
+           * \note set only: read it back with
+           * boost::asio::socket_base::receive_buffer_size.
+           */
+          typedef boost::asio::detail::socket_option::integer<SOL_SOCKET,
+                  SO_RCVBUFFORCE> receive_buffer_force;
+
+          /**
+           * \brief Socket option to set the send buffer size above
+           * net.core.wmem_max, needs CAP_NET_ADMIN (SO_SNDBUFFORCE).
+           * \note set only: read it back with
+           * boost::asio::socket_base::send_buffer_size.
+           */
+          typedef boost::asio::detail::socket_option::integer<SOL_SOCKET,
+                  SO_SNDBUFFORCE> send_buffer_force;
+
+          /**
+           * \brief Socket option to busy poll the device queue for up to
+           * this many microseconds on receive when it is empty
+           * (SO_BUSY_POLL).
+           */
+          typedef boost::asio::detail::socket_option::integer<SOL_SOCKET,
+                  SO_BUSY_POLL> busy_poll;
+
+          /**
+           * \brief Socket option to receive the kernel receive time of each
+           * frame as a SCM_TIMESTAMPNS control message (SO_TIMESTAMPNS).
+           */
+          typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET,
+                  SO_TIMESTAMPNS> timestamp_ns;
+
+          /**
+           * \class membership
+           * \brief Socket option to add or drop a packet socket membership
+           * (PACKET_ADD_MEMBERSHIP or PACKET_DROP_MEMBERSHIP), i.e.
+           * promiscuous mode, counted by the kernel and dropped when the
+           * socket is closed.
+           */
+          template <int Name>
+          class membership
+          {
+            public:
+              /**
+               * \brief Constructor.
+               * \param ifindex interface index.
+               * \param type PACKET_MR_PROMISC, PACKET_MR_ALLMULTI or
+               * PACKET_MR_MULTICAST.
+               * \param addr link-layer address for PACKET_MR_MULTICAST.
+               */
+              explicit membership(int ifindex,
+                  unsigned short type = PACKET_MR_PROMISC,
+                  const uint8_t* addr = nullptr)
+              {
+                memset(&m_mreq, 0x00, sizeof(m_mreq));
+                m_mreq.mr_ifindex = ifindex;
+                m_mreq.mr_type = type;
+
+                if(addr)
+                {
+                  m_mreq.mr_alen = ETH_ALEN;
+                  memcpy(m_mreq.mr_address, addr, ETH_ALEN);
+                }
+              }
+
+              /**
+               * \brief Returns option level.
+               * \param p protocol.
+               * \return SOL_PACKET.
+               */
+              template <typename Protocol>
+              int level(const Protocol& p) const
+              {
+                (void)p;
+                return SOL_PACKET;
+              }
+
+              /**
+               * \brief Returns option name.
+               * \param p protocol.
+               * \return PACKET_ADD_MEMBERSHIP or PACKET_DROP_MEMBERSHIP.
+               */
+              template <typename Protocol>
+              int name(const Protocol& p) const
+              {
+                (void)p;
+                return Name;
+              }
+
+              /**
+               * \brief Returns option data.
+               * \param p protocol.
+               * \return pointer to struct packet_mreq.
+               */
+              template <typename Protocol>
+              const void* data(const Protocol& p) const
+              {
+                (void)p;
+                return &m_mreq;
+              }
+
+              /**
+               * \brief Returns option data size.
+               * \param p protocol.
+               * \return size of struct packet_mreq.
+               */
+              template <typename Protocol>
+              size_t size(const Protocol& p) const
+              {
+                (void)p;
+                return sizeof(m_mreq);
+              }
+
+            private:
+              /**
+               * \brief Membership request.
+               */
+              struct packet_mreq m_mreq;
+          };
+
+          /**
+           * \brief Socket option to add a membership (i.e. enter
+           * promiscuous mode).
+           */
+          typedef membership<PACKET_ADD_MEMBERSHIP> add_membership;
+
+          /**
+           * \brief Socket option to drop a membership.
+           */
+          typedef membership<PACKET_DROP_MEMBERSHIP> drop_membership;
+
+          /**
+           * \class attach_filter
+           * \brief Socket option to attach a classic BPF program run by the
+           * kernel on each frame before queueing it (SO_ATTACH_FILTER).
+           */
+          class attach_filter
+          {
+            public:
+              /**
+               * \brief Constructor.
+               * \param program BPF instructions.
+               */
+              explicit attach_filter(
+                  const std::vector<struct sock_filter>& program)
+                : m_program(program)
+              {
+                m_fprog.len = 0;
+                m_fprog.filter = nullptr;
+              }
+
+              /**
+               * \brief Returns option level.
+               * \param p protocol.
+               * \return SOL_SOCKET.
+               */
+              template <typename Protocol>
+              int level(const Protocol& p) const
+              {
+                (void)p;
+                return SOL_SOCKET;
+              }
+
+              /**
+               * \brief Returns option name.
+               * \param p protocol.
+               * \return SO_ATTACH_FILTER.
+               */
+              template <typename Protocol>
+              int name(const Protocol& p) const
+              {
+                (void)p;
+                return SO_ATTACH_FILTER;
+              }
+
+              /**
+               * \brief Returns option data.
+               * \param p protocol.
+               * \return pointer to struct sock_fprog.
+               */
+              template <typename Protocol>
+              const void* data(const Protocol& p) const
+              {
+                (void)p;
+                // rebuilt here so copies of the option stay valid
+                m_fprog.len = static_cast<unsigned short>(m_program.size());
+                m_fprog.filter = const_cast<struct sock_filter*>(
+                    m_program.data());
+                return &m_fprog;
+              }
+
+              /**
+               * \brief Returns option data size.
+               * \param p protocol.
+               * \return size of struct sock_fprog.
+               */
+              template <typename Protocol>
+              size_t size(const Protocol& p) const
+              {
+                (void)p;
+                return sizeof(m_fprog);
+              }
+
+            private:
+              /**
+               * \brief BPF instructions.
+               */
+              std::vector<struct sock_filter> m_program;
+
+              /**
+               * \brief Program descriptor passed to the kernel.
+               */
+              mutable struct sock_fprog m_fprog;
+          };
+
           /**
            * \brief Constructor.
            * \param eth_protocol protocol identifier.
@@ -0,0 +1,302 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file mac_table.hpp
+ * \brief Concurrent MAC learning table.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef ASIO_RAW_LL_MAC_TABLE_HPP
+#define ASIO_RAW_LL_MAC_TABLE_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+#include <atomic>
+
+#include <boost/noncopyable.hpp>
+
+#include <net/ethernet.h>
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \class mac_table
+       * \brief MAC address to port table for software switching, shared by
+       * several threads.
+       *
+       * Each entry is one 64-bit word: the 48-bit MAC address in the upper
+       * bits and the 16-bit port in the lower bits, so that a lookup reads
+       * and compares a whole cache line of 8 entries at once (SSE2) and
+       * always sees a consistent address/port pair. Lookups take no lock
+       * and never wait. The table is split in shards (open addressing,
+       * linear probing by cache line), each with its own writer lock;
+       * learning an address already known on the same port only refreshes
+       * its timestamp, without lock.
+       *
+       * Entries older than a maximum age are removed by age(), one shard
+       * at a time, or spread over time with age_shard().
+       * \code
+       *  mac_table table;
+       *
+       *  // in handle_recv(), for a frame received on port
+       *  const struct ether_header* hdr =
+       *    reinterpret_cast<const struct ether_header*>(buffer().data());
+       *  uint16_t out = 0;
+       *
+       *  table.learn(hdr, port, now);
+       *  if(table.lookup(hdr, out))
+       *  {
+       *    // send to out
+       *  }
+       *  else
+       *  {
+       *    // flood
+       *  }
+       * \endcode
+       */
+      class mac_table : private boost::noncopyable
+      {
+        public:
+          /**
+           * \brief Number of entries per probe group (one cache line).
+           */
+          static const size_t group_size = 8;
+
+          /**
+           * \brief Constructor.
+           * \param capacity maximum number of addresses.
+           * \param shards number of shards (power of 2), i.e. a few times
+           * the number of writer threads.
+           * \throw std::invalid_argument if shards is not a power of 2.
+           * \throw std::bad_alloc if memory cannot be allocated.
+           */
+          mac_table(size_t capacity = 65536, size_t shards = 64);
+
+          /**
+           * \brief Destructor.
+           */
+          ~mac_table();
+
+          /**
+           * \brief Packs a MAC address in an integer.
+           * \param mac address (6 bytes).
+           * \return key, first byte in bits 47 to 40.
+           */
+          static uint64_t key(const uint8_t* mac)
+          {
+            return static_cast<uint64_t>(mac[0]) << 40 |
+              static_cast<uint64_t>(mac[1]) << 32 |
+              static_cast<uint64_t>(mac[2]) << 24 |
+              static_cast<uint64_t>(mac[3]) << 16 |
+              static_cast<uint64_t>(mac[4]) << 8 |
+              static_cast<uint64_t>(mac[5]);
+          }
+
+          /**
+           * \brief Returns whether an address can be learnt (unicast and
+           * not all zeros).
+           * \param k key.
+           * \return true if address can be learnt.
+           */
+          static bool learnable(uint64_t k)
+          {
+            return k != 0 && !(k & (static_cast<uint64_t>(1) << 40));
+          }
+
+          /**
+           * \brief Looks up the port of an address.
+           * \param k key.
+           * \param port port if found.
+           * \return true if found.
+           */
+          bool lookup(uint64_t k, uint16_t& port) const;
+
+          /**
+           * \brief Looks up the port of the destination of a frame.
+           * \param hdr ethernet header.
+           * \param port port if found.
+           * \return true if found.
+           */
+          bool lookup(const struct ether_header* hdr, uint16_t& port) const
+          {
+            return lookup(key(hdr->ether_dhost), port);
+          }
+
+          /**
+           * \brief Learns or refreshes an address.
+           * \param k key.
+           * \param port port the address was seen on.
+           * \param now current time, in the unit of age() max_age.
+           * \return false if address is not learnable or shard is full.
+           */
+          bool learn(uint64_t k, uint16_t port, uint32_t now);
+
+          /**
+           * \brief Learns or refreshes the source address of a frame.
+           * \param hdr ethernet header.
+           * \param port port the frame was received on.
+           * \param now current time, in the unit of age() max_age.
+           * \return false if address is not learnable or shard is full.
+           */
+          bool learn(const struct ether_header* hdr, uint16_t port,
+              uint32_t now)
+          {
+            return learn(key(hdr->ether_shost), port, now);
+          }
+
+          /**
+           * \brief Removes an address.
+           * \param k key.
+           * \return true if address was present.
+           */
+          bool remove(uint64_t k);
+
+          /**
+           * \brief Removes entries not refreshed for max_age, shard by
+           * shard.
+           * \param now current time.
+           * \param max_age maximum age.
+           * \return number of entries removed.
+           */
+          size_t age(uint32_t now, uint32_t max_age);
+
+          /**
+           * \brief Removes old entries of one shard, to spread aging over
+           * time (i.e. one shard per timer tick).
+           * \param shard shard index (modulo number of shards).
+           * \param now current time.
+           * \param max_age maximum age.
+           * \return number of entries removed.
+           */
+          size_t age_shard(size_t shard, uint32_t now, uint32_t max_age);
+
+          /**
+           * \brief Returns number of addresses.
+           * \return number of addresses (approximate while writers run).
+           */
+          size_t size() const;
+
+          /**
+           * \brief Returns number of shards.
+           * \return number of shards.
+           */
+          size_t shards() const;
+
+        private:
+          /**
+           * \brief Shard writer state, one cache line.
+           */
+          struct alignas(64) shard
+          {
+            /**
+             * \brief Writer lock.
+             */
+            std::atomic_flag lock;
+
+            /**
+             * \brief Number of entries.
+             */
+            std::atomic<uint32_t> count;
+
+            /**
+             * \brief Number of removed entries still in probe chains.
+             */
+            uint32_t tombstones;
+          };
+
+          /**
+           * \brief Hashes a key.
+           * \param k key.
+           * \return hash.
+           */
+          static uint64_t hash(uint64_t k)
+          {
+            // Fibonacci hashing, high bits are the best mixed
+            return k * 0x9e3779b97f4a7c15ULL;
+          }
+
+          /**
+           * \brief Finds the slot of a key in a shard, without lock.
+           * \param s shard index.
+           * \param h key hash.
+           * \param word key in entry position (key << 16).
+           * \return slot index in the table, or npos.
+           */
+          size_t find(size_t s, uint64_t h, uint64_t word) const;
+
+          /**
+           * \brief Inserts or updates an entry, shard lock held.
+           * \param s shard index.
+           * \param h key hash.
+           * \param entry entry.
+           * \param now current time.
+           * \return false if shard is full.
+           */
+          bool insert(size_t s, uint64_t h, uint64_t entry, uint32_t now);
+
+          /**
+           * \brief Reinserts entries of a shard to clear tombstones, shard
+           * lock held.
+           * \param s shard index.
+           */
+          void rebuild(size_t s);
+
+          /**
+           * \brief Takes the writer lock of a shard.
+           * \param s shard index.
+           */
+          void lock(size_t s);
+
+          /**
+           * \brief Releases the writer lock of a shard.
+           * \param s shard index.
+           */
+          void unlock(size_t s);
+
+          /**
+           * \brief Entries, shard after shard.
+           */
+          uint64_t* m_slots;
+
+          /**
+           * \brief Last time each entry was seen.
+           */
+          uint32_t* m_seen;
+
+          /**
+           * \brief Shards.
+           */
+          shard* m_shards;
+
+          /**
+           * \brief Number of shards.
+           */
+          size_t m_shard_count;
+
+          /**
+           * \brief Number of groups per shard (power of 2).
+           */
+          size_t m_groups;
+
+          /**
+           * \brief Maximum number of entries per shard.
+           */
+          uint32_t m_shard_max;
+      };
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
+
+#endif /* ASIO_RAW_LL_MAC_TABLE_HPP */
@@ -0,0 +1,205 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file socket_profile.hpp
+ * \brief Packet socket tuning profiles.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef ASIO_RAW_LL_SOCKET_PROFILE_HPP
+#define ASIO_RAW_LL_SOCKET_PROFILE_HPP
+
+#include "ll_protocol.hpp"
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \class socket_profile
+       * \brief Set of packet socket options applied in one step.
+       *
+       * A default constructed profile changes nothing. The presets are
+       * starting points for the three usual workloads and can be adjusted
+       * with the setters before being applied.
+       * \code
+       *  // keep up with a saturated link
+       *  my_server server(ios, "eth0", ETH_P_ALL, socket_profile::capture());
+       *
+       *  // or on any packet socket
+       *  socket_profile::generator().set_busy_poll(20).apply(socket,
+       *      endpoint);
+       * \endcode
+       */
+      class socket_profile
+      {
+        public:
+          /**
+           * \brief Constructor, profile with no option.
+           */
+          socket_profile();
+
+          /**
+           * \brief Returns profile for capture: large receive buffer to
+           * absorb bursts, promiscuous mode, and outgoing frames are kept
+           * so that both directions are seen.
+           * \return profile.
+           */
+          static socket_profile capture();
+
+          /**
+           * \brief Returns profile for low latency request/response: busy
+           * polling on receive (with CAP_NET_ADMIN) and own frames not
+           * looped back.
+           * \return profile.
+           */
+          static socket_profile low_latency();
+
+          /**
+           * \brief Returns profile for traffic generation: frames go
+           * straight to the driver (no qdisc), larger send buffer and
+           * nothing received back.
+           * \return profile.
+           */
+          static socket_profile generator();
+
+          /**
+           * \brief Sets receive buffer size, forced above
+           * net.core.rmem_max when allowed.
+           * \param size size in bytes, 0 to keep the default.
+           * \return profile.
+           */
+          socket_profile& set_receive_buffer(int size);
+
+          /**
+           * \brief Sets send buffer size, forced above net.core.wmem_max
+           * when allowed.
+           * \param size size in bytes, 0 to keep the default.
+           * \return profile.
+           */
+          socket_profile& set_send_buffer(int size);
+
+          /**
+           * \brief Enables or disables promiscuous mode.
+           * \param enable true to receive frames for other hosts.
+           * \return profile.
+           */
+          socket_profile& set_promiscuous(bool enable);
+
+          /**
+           * \brief Enables or disables PACKET_IGNORE_OUTGOING.
+           * \param enable true to not receive frames sent on the interface.
+           * \return profile.
+           */
+          socket_profile& set_ignore_outgoing(bool enable);
+
+          /**
+           * \brief Enables or disables PACKET_QDISC_BYPASS.
+           * \param enable true to send frames straight to the driver.
+           * \return profile.
+           */
+          socket_profile& set_qdisc_bypass(bool enable);
+
+          /**
+           * \brief Sets SO_BUSY_POLL.
+           * \param usec busy poll time in microseconds, 0 to disable.
+           * \return profile.
+           */
+          socket_profile& set_busy_poll(int usec);
+
+          /**
+           * \brief Applies the options to a socket.
+           * \param socket socket.
+           * \param endpoint endpoint the socket is bound to (promiscuous
+           * mode is not set when bound to all interfaces).
+           * \throw boost::system::system_error if an option is refused.
+           * \note forced buffer sizes fall back to the limited ones
+           * without CAP_NET_ADMIN, and options unknown to the running
+           * kernel (PACKET_IGNORE_OUTGOING before Linux 4.20, SO_BUSY_POLL
+           * without CONFIG_NET_RX_BUSY_POLL) are skipped. SO_BUSY_POLL is
+           * skipped as well without CAP_NET_ADMIN.
+           */
+          void apply(asio::raw::ll::ll_protocol::socket& socket,
+              const asio::raw::ll::ll_protocol::endpoint& endpoint) const;
+
+          /**
+           * \brief Returns receive buffer size.
+           * \return size in bytes, 0 for default.
+           */
+          int receive_buffer() const;
+
+          /**
+           * \brief Returns send buffer size.
+           * \return size in bytes, 0 for default.
+           */
+          int send_buffer() const;
+
+          /**
+           * \brief Returns whether promiscuous mode is enabled.
+           * \return true if enabled.
+           */
+          bool promiscuous() const;
+
+          /**
+           * \brief Returns whether outgoing frames are ignored.
+           * \return true if ignored.
+           */
+          bool ignore_outgoing() const;
+
+          /**
+           * \brief Returns whether qdisc is bypassed.
+           * \return true if bypassed.
+           */
+          bool qdisc_bypass() const;
+
+          /**
+           * \brief Returns busy poll time.
+           * \return time in microseconds, 0 if disabled.
+           */
+          int busy_poll() const;
+
+        private:
+          /**
+           * \brief Receive buffer size.
+           */
+          int m_receive_buffer;
+
+          /**
+           * \brief Send buffer size.
+           */
+          int m_send_buffer;
+
+          /**
+           * \brief Promiscuous mode.
+           */
+          bool m_promiscuous;
+
+          /**
+           * \brief Ignore outgoing frames.
+           */
+          bool m_ignore_outgoing;
+
+          /**
+           * \brief Bypass qdisc.
+           */
+          bool m_qdisc_bypass;
+
+          /**
+           * \brief Busy poll time in microseconds.
+           */
+          int m_busy_poll;
+      };
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
+
+#endif /* ASIO_RAW_LL_SOCKET_PROFILE_HPP */
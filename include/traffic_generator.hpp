@@ -0,0 +1,389 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file traffic_generator.hpp
+ * \brief Rate-paced link-layer traffic generator.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef ASIO_RAW_LL_TRAFFIC_GENERATOR_HPP
+#define ASIO_RAW_LL_TRAFFIC_GENERATOR_HPP
+
+#include <atomic>
+#include <vector>
+
+#include <sys/uio.h>
+
+#include <boost/noncopyable.hpp>
+
+#include "ll_protocol.hpp"
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \class traffic_generator
+       * \brief Sends copies of a frame template at a target rate.
+       *
+       * The template is laid out once in a batch of send slots. For each
+       * frame only the registered fields are rewritten and the checksums
+       * covering them are updated incrementally (RFC 1624), then the whole
+       * batch is sent with a single sendmmsg() call. Batches are paced
+       * against absolute deadlines with a busy-wait on the TSC (when
+       * invariant) or clock_gettime().
+       * \code
+       *  traffic_generator gen(ios, "eth0");
+       *
+       *  gen.set_template(frame, frame_len);
+       *  // 32-bit sequence number in UDP payload, covered by UDP checksum
+       *  gen.add_field(traffic_generator::field(42, 4, 1, 0)
+       *    .add_checksum(40, 34, true));
+       *  gen.set_rate_pps(100000);
+       *  gen.run(1000000);
+       *  std::cout << gen.stats().pps() << std::endl;
+       * \endcode
+       */
+      class traffic_generator : private boost::noncopyable
+      {
+        public:
+          /**
+           * \class field
+           * \brief Big-endian integer field rewritten for every frame.
+           *
+           * Frame n carries base + (n % count) * step, where base is the
+           * value found in the template.
+           */
+          class field
+          {
+            public:
+              /**
+               * \brief Constructor.
+               * \param offset offset of the field in the frame.
+               * \param width width of the field in bytes (1 to 8, i.e. 4
+               * for an IPv4 address or 6 for a MAC address).
+               * \param step increment between two consecutive frames.
+               * \param count number of distinct values before wrapping
+               * back to base, 0 to never wrap.
+               */
+              field(size_t offset, size_t width, uint64_t step = 1,
+                  uint64_t count = 0);
+
+              /**
+               * \brief Registers a checksum covering this field.
+               * \param csum_offset offset of the 16-bit checksum in the
+               * frame.
+               * \param start offset in the frame where checksummed data
+               * starts (i.e. IPv4 header for the IPv4 checksum, UDP header
+               * for the UDP checksum).
+               * \param udp true for a UDP checksum, where zero means
+               * disabled and is left untouched.
+               * \return the current object.
+               */
+              field& add_checksum(size_t csum_offset, size_t start,
+                  bool udp = false);
+
+            private:
+              friend class traffic_generator;
+
+              /**
+               * \brief Checksum covering the field.
+               */
+              struct checksum_ref
+              {
+                /**
+                 * \brief Offset of the checksum in the frame.
+                 */
+                size_t offset;
+
+                /**
+                 * \brief Whether field starts at odd offset in the
+                 * checksummed data.
+                 */
+                bool odd;
+
+                /**
+                 * \brief Whether this is a UDP checksum.
+                 */
+                bool udp;
+              };
+
+              /**
+               * \brief Offset in the frame.
+               */
+              size_t m_offset;
+
+              /**
+               * \brief Width in bytes.
+               */
+              size_t m_width;
+
+              /**
+               * \brief Increment per frame.
+               */
+              uint64_t m_step;
+
+              /**
+               * \brief Number of values before wrapping.
+               */
+              uint64_t m_count;
+
+              /**
+               * \brief Value in the template.
+               */
+              uint64_t m_base;
+
+              /**
+               * \brief Checksums covering the field.
+               */
+              std::vector<checksum_ref> m_checksums;
+          };
+
+          /**
+           * \class statistics
+           * \brief Transmit statistics.
+           */
+          class statistics
+          {
+            public:
+              /**
+               * \brief Constructor.
+               */
+              statistics();
+
+              /**
+               * \brief Returns achieved rate in frames per second.
+               * \return achieved rate.
+               */
+              double pps() const;
+
+              /**
+               * \brief Returns achieved rate in bits per second.
+               * \return achieved rate.
+               */
+              double bps() const;
+
+              /**
+               * \brief Returns standard deviation of batch send time
+               * against its deadline.
+               * \return jitter in nanoseconds.
+               */
+              double jitter_ns() const;
+
+              /**
+               * \brief Number of frames sent.
+               */
+              uint64_t frames;
+
+              /**
+               * \brief Number of bytes sent.
+               */
+              uint64_t bytes;
+
+              /**
+               * \brief Number of batches sent.
+               */
+              uint64_t batches;
+
+              /**
+               * \brief Number of sendmmsg() retries (ENOBUFS or partial
+               * send).
+               */
+              uint64_t retries;
+
+              /**
+               * \brief Duration of the run in nanoseconds.
+               */
+              uint64_t elapsed_ns;
+
+              /**
+               * \brief Worst lateness of a batch against its deadline in
+               * nanoseconds.
+               */
+              uint64_t max_late_ns;
+
+              /**
+               * \brief Mean lateness in nanoseconds (Welford).
+               */
+              double late_mean;
+
+              /**
+               * \brief Sum of squared differences from the mean
+               * (Welford).
+               */
+              double late_m2;
+          };
+
+          /**
+           * \brief Constructor.
+           * \param ios Boost.Asio IO service.
+           * \param ifname interface to send to.
+           */
+          traffic_generator(boost::asio::io_service& ios,
+              const std::string& ifname);
+
+          /**
+           * \brief Sets the frame template.
+           * \param data frame, starting with the ethernet header.
+           * \param data_len frame length.
+           * \note previously added fields are discarded.
+           */
+          void set_template(const char* data, size_t data_len);
+
+          /**
+           * \brief Adds a field to rewrite for each frame.
+           * \param f field description.
+           * \throw std::invalid_argument if field or one of its checksums
+           * does not fit in the template.
+           */
+          void add_field(const field& f);
+
+          /**
+           * \brief Sets target rate in frames per second.
+           * \param pps target rate, 0 for unpaced.
+           */
+          void set_rate_pps(double pps);
+
+          /**
+           * \brief Sets target rate in bits per second (frame bytes
+           * only, without preamble, FCS nor inter-frame gap).
+           * \param bps target rate, 0 for unpaced.
+           */
+          void set_rate_bps(double bps);
+
+          /**
+           * \brief Sets number of frames per sendmmsg() call.
+           * \param batch number of frames (1 to 1024).
+           */
+          void set_batch(size_t batch);
+
+          /**
+           * \brief Sends frames until count is reached or stop() is
+           * called.
+           * \param count number of frames to send, 0 for no limit.
+           * \return statistics of this run.
+           * \throw boost::system::system_error if send fails.
+           */
+          const statistics& run(uint64_t count = 0);
+
+          /**
+           * \brief Stops a running run() call, can be called from another
+           * thread or signal handler. It also holds if run() has not
+           * started yet: once stopped, run() returns without sending.
+           */
+          void stop();
+
+          /**
+           * \brief Returns statistics of the last run.
+           * \return statistics.
+           */
+          const statistics& stats() const;
+
+        private:
+          /**
+           * \brief Lays out the template in all slots.
+           */
+          void prepare();
+
+          /**
+           * \brief Rewrites fields of a slot for frame number n.
+           * \param slot slot data.
+           * \param n frame number.
+           */
+          void mutate(char* slot, uint64_t n);
+
+          /**
+           * \brief Returns current monotonic time.
+           * \return time in nanoseconds.
+           */
+          uint64_t now() const;
+
+          /**
+           * \brief Link-layer endpoint.
+           */
+          asio::raw::ll::ll_protocol::endpoint m_endpoint;
+
+          /**
+           * \brief Raw link-layer socket.
+           */
+          asio::raw::ll::ll_protocol::socket m_socket;
+
+          /**
+           * \brief Frame template.
+           */
+          std::vector<char> m_template;
+
+          /**
+           * \brief Fields to rewrite.
+           */
+          std::vector<field> m_fields;
+
+          /**
+           * \brief Slots content (batch copies of the template).
+           */
+          std::vector<char> m_slots;
+
+          /**
+           * \brief I/O vectors of slots.
+           */
+          std::vector<struct iovec> m_iovecs;
+
+          /**
+           * \brief Message headers of slots.
+           */
+          std::vector<struct mmsghdr> m_msgs;
+
+          /**
+           * \brief Frames per batch.
+           */
+          size_t m_batch;
+
+          /**
+           * \brief Target rate in frames per second.
+           */
+          double m_pps;
+
+          /**
+           * \brief Target rate in bits per second.
+           */
+          double m_bps;
+
+          /**
+           * \brief TSC ticks per nanosecond, 0 if clock_gettime() is used.
+           */
+          double m_tsc_per_ns;
+
+          /**
+           * \brief TSC value at calibration.
+           */
+          uint64_t m_tsc_base;
+
+          /**
+           * \brief Monotonic time at calibration in nanoseconds.
+           */
+          uint64_t m_ns_base;
+
+          /**
+           * \brief Running state, cleared by stop() only.
+           */
+          std::atomic<bool> m_running;
+
+          /**
+           * \brief Statistics of the last run.
+           */
+          statistics m_stats;
+      };
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
+
+#endif /* ASIO_RAW_LL_TRAFFIC_GENERATOR_HPP */
@@ -0,0 +1,386 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file tx_engine.hpp
+ * \brief Multi-socket transmit engine.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef ASIO_RAW_LL_TX_ENGINE_HPP
+#define ASIO_RAW_LL_TX_ENGINE_HPP
+
+#include <cstdint>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <boost/noncopyable.hpp>
+
+#include "ll_protocol.hpp"
+#include "socket_profile.hpp"
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \class tx_engine
+       * \brief Transmits frames from several threads, each with its own
+       * packet socket bound to the same interface.
+       *
+       * A single socket serializes every sender on its lock and on one
+       * queueing discipline path. Here each lane owns a socket, a thread
+       * and a bounded queue: send() copies the frame into the queue of
+       * the lane selected by the flow hash, and the lane thread sends
+       * batches with sendmmsg() straight from the queue memory.
+       *
+       * Frames of a flow (same addresses, protocol and ports) always go
+       * through the same lane, so their order is kept; distinct flows
+       * spread over the lanes. With the socket_profile::generator()
+       * profile (PACKET_QDISC_BYPASS), the kernel picks the device queue
+       * of the sending CPU: pin lanes with set_affinity() to give each
+       * core its own queue.
+       * \code
+       *  tx_engine tx(ios, "eth0", 4);
+       *
+       *  tx.start();
+       *  // any thread
+       *  if(!tx.send(frame, frame_len))
+       *  {
+       *    // lane queue full: drop or retry
+       *  }
+       *  tx.stop();
+       * \endcode
+       * \note send() is thread-safe and lock-free, it never allocates.
+       */
+      class tx_engine : private boost::noncopyable
+      {
+        public:
+          /**
+           * \class statistics
+           * \brief Transmit statistics.
+           */
+          class statistics
+          {
+            public:
+              /**
+               * \brief Constructor.
+               */
+              statistics();
+
+              /**
+               * \brief Number of frames sent.
+               */
+              uint64_t frames;
+
+              /**
+               * \brief Number of bytes sent.
+               */
+              uint64_t bytes;
+
+              /**
+               * \brief Number of sendmmsg() calls that sent frames.
+               */
+              uint64_t batches;
+
+              /**
+               * \brief Number of sendmmsg() retries (device queue full).
+               */
+              uint64_t retries;
+
+              /**
+               * \brief Number of frames refused by the kernel, or dropped
+               * by stop() while the device did not take them.
+               */
+              uint64_t errors;
+
+              /**
+               * \brief Number of frames refused by send() (queue full or
+               * frame too large).
+               */
+              uint64_t rejected;
+          };
+
+          /**
+           * \brief Constructor.
+           * \param ios Boost.Asio IO service.
+           * \param ifname interface name.
+           * \param lanes number of sockets and threads.
+           * \param profile options applied to each socket.
+           * \param queue_size frames per lane queue, a power of 2.
+           * \param frame_size maximum frame size.
+           * \param batch maximum frames per sendmmsg().
+           * \throw std::invalid_argument if a parameter is invalid.
+           * \throw boost::system::system_error if a socket cannot be
+           * opened or an option is refused.
+           */
+          tx_engine(boost::asio::io_service& ios, const std::string& ifname,
+              size_t lanes, const socket_profile& profile =
+              socket_profile::generator(), size_t queue_size = 4096,
+              size_t frame_size = 2048, size_t batch = 32);
+
+          /**
+           * \brief Destructor, stops the lanes.
+           */
+          ~tx_engine();
+
+          /**
+           * \brief Pins lane threads to CPUs, before start().
+           * \param cpus CPU of each lane, used round-robin.
+           */
+          void set_affinity(const std::vector<int>& cpus);
+
+          /**
+           * \brief Starts lane threads.
+           * \throw std::logic_error if already started.
+           */
+          void start();
+
+          /**
+           * \brief Stops lane threads once queued frames are sent. Frames
+           * the device still refuses after about 50 ms are dropped and
+           * counted in errors.
+           */
+          void stop();
+
+          /**
+           * \brief Queues a frame on the lane of its flow.
+           * \param data frame, starting with the ethernet header.
+           * \param data_len frame length.
+           * \return false if the lane queue is full or the frame too large.
+           */
+          bool send(const char* data, size_t data_len);
+
+          /**
+           * \brief Queues a frame on a given lane.
+           * \param lane lane index.
+           * \param data frame, starting with the ethernet header.
+           * \param data_len frame length.
+           * \return false if the lane queue is full or the frame too large.
+           */
+          bool send(size_t lane, const char* data, size_t data_len);
+
+          /**
+           * \brief Returns lane of a frame.
+           * \param data frame.
+           * \param data_len frame length.
+           * \return lane index.
+           */
+          size_t lane(const char* data, size_t data_len) const;
+
+          /**
+           * \brief Returns number of lanes.
+           * \return number of lanes.
+           */
+          size_t lanes() const;
+
+          /**
+           * \brief Returns statistics of a lane.
+           * \param lane lane index.
+           * \return statistics.
+           */
+          statistics stats(size_t lane) const;
+
+          /**
+           * \brief Returns statistics of all lanes.
+           * \return statistics.
+           */
+          statistics stats() const;
+
+          /**
+           * \brief Returns flow hash of a frame: IPv4 or IPv6 addresses,
+           * protocol and TCP/UDP/SCTP ports, behind up to two VLAN tags.
+           * Other frames hash their MAC addresses and EtherType.
+           * \param data frame.
+           * \param data_len frame length.
+           * \return hash.
+           */
+          static uint64_t flow_hash(const char* data, size_t data_len);
+
+        private:
+          /**
+           * \brief Queue entry state.
+           */
+          struct cell
+          {
+            /**
+             * \brief Sequence: position when free, position + 1 when
+             * holding a frame.
+             */
+            std::atomic<uint64_t> sequence;
+
+            /**
+             * \brief Frame length.
+             */
+            uint32_t len;
+          };
+
+          /**
+           * \brief Lane: socket, thread and bounded multi-producer queue.
+           */
+          struct lane_state
+          {
+            /**
+             * \brief Constructor.
+             * \param ios Boost.Asio IO service.
+             * \param endpoint bound endpoint.
+             */
+            lane_state(boost::asio::io_service& ios,
+                const ll_protocol::endpoint& endpoint);
+
+            /**
+             * \brief Socket.
+             */
+            ll_protocol::socket socket;
+
+            /**
+             * \brief Frames, frame_size bytes each.
+             */
+            std::vector<char> frames;
+
+            /**
+             * \brief Entries.
+             */
+            std::unique_ptr<cell[]> cells;
+
+            /**
+             * \brief Send I/O vectors.
+             */
+            std::vector<struct iovec> iovecs;
+
+            /**
+             * \brief Send message headers.
+             */
+            std::vector<struct mmsghdr> msgs;
+
+            /**
+             * \brief Thread.
+             */
+            std::thread thread;
+
+            /**
+             * \brief CPU to run on, -1 for any.
+             */
+            int cpu;
+
+            /**
+             * \brief Whether frames left are dropped, once stopped with the
+             * device not taking frames.
+             */
+            bool abandoned;
+
+            /**
+             * \brief Keeps producer and consumer positions on their own
+             * cache lines.
+             */
+            char pad0[64];
+
+            /**
+             * \brief Next position to fill, shared by producers.
+             */
+            std::atomic<uint64_t> enqueue_pos;
+
+            /**
+             * \brief Keeps producer and consumer positions on their own
+             * cache lines.
+             */
+            char pad1[64 - sizeof(std::atomic<uint64_t>)];
+
+            /**
+             * \brief Next position to send, lane thread only.
+             */
+            uint64_t dequeue_pos;
+
+            /**
+             * \brief Frames sent.
+             */
+            std::atomic<uint64_t> sent;
+
+            /**
+             * \brief Bytes sent.
+             */
+            std::atomic<uint64_t> bytes;
+
+            /**
+             * \brief sendmmsg() calls.
+             */
+            std::atomic<uint64_t> batches;
+
+            /**
+             * \brief sendmmsg() retries.
+             */
+            std::atomic<uint64_t> retries;
+
+            /**
+             * \brief Frames refused by the kernel.
+             */
+            std::atomic<uint64_t> errors;
+
+            /**
+             * \brief Frames refused by send().
+             */
+            std::atomic<uint64_t> rejected;
+          };
+
+          /**
+           * \brief Lane thread loop.
+           * \param l lane.
+           */
+          void run(lane_state& l);
+
+          /**
+           * \brief Sends frames ready in a lane queue.
+           * \param l lane.
+           * \return number of frames taken from the queue.
+           */
+          size_t flush(lane_state& l);
+
+          /**
+           * \brief Lanes.
+           */
+          std::vector<std::unique_ptr<lane_state>> m_lanes;
+
+          /**
+           * \brief Link-layer endpoint.
+           */
+          ll_protocol::endpoint m_endpoint;
+
+          /**
+           * \brief Queue size minus one.
+           */
+          uint64_t m_mask;
+
+          /**
+           * \brief Maximum frame size.
+           */
+          size_t m_frame_size;
+
+          /**
+           * \brief Maximum frames per sendmmsg().
+           */
+          size_t m_batch;
+
+          /**
+           * \brief Whether lanes run.
+           */
+          std::atomic<bool> m_running;
+      };
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
+
+#endif /* ASIO_RAW_LL_TX_ENGINE_HPP */
@@ -0,0 +1,250 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file uring.hpp
+ * \brief Minimal io_uring instance.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef ASIO_RAW_LL_URING_HPP
+#define ASIO_RAW_LL_URING_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <sys/uio.h>
+
+#include <linux/io_uring.h>
+
+#include <boost/noncopyable.hpp>
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \class uring
+       * \brief io_uring instance driven with raw system calls.
+       *
+       * Maps the submission and completion rings and exposes just what the
+       * packet socket backends need: SQE allocation, batched submit,
+       * completion reaping and resource registration. The instance is
+       * single-threaded, it is not safe to use it from several threads.
+       */
+      class uring : private boost::noncopyable
+      {
+        public:
+          /**
+           * \brief Constructor.
+           * \param entries number of submission queue entries.
+           * \param cq_entries number of completion queue entries, 0 for
+           * kernel default (twice entries).
+           * \throw boost::system::system_error if io_uring is not available.
+           */
+          uring(unsigned entries, unsigned cq_entries = 0);
+
+          /**
+           * \brief Destructor.
+           */
+          ~uring();
+
+          /**
+           * \brief Returns ring file descriptor, readable when completions
+           * are available.
+           * \return file descriptor.
+           */
+          int fd() const
+          {
+            return m_fd;
+          }
+
+          /**
+           * \brief Returns whether the kernel supports an operation.
+           * \param op operation (IORING_OP_*).
+           * \return true if supported.
+           */
+          bool supports(uint8_t op) const;
+
+          /**
+           * \brief Returns a zeroed submission queue entry.
+           * \return entry, or nullptr if submission queue is full.
+           * \note entry is queued, it is submitted by the next submit().
+           */
+          struct io_uring_sqe* get_sqe();
+
+          /**
+           * \brief Returns number of entries queued but not submitted.
+           * \return number of entries.
+           */
+          unsigned pending() const
+          {
+            return m_sqe_tail - m_sqe_head;
+          }
+
+          /**
+           * \brief Submits queued entries.
+           * \return number of entries submitted.
+           * \throw boost::system::system_error on error.
+           */
+          unsigned submit();
+
+          /**
+           * \brief Returns oldest completion.
+           * \return completion, or nullptr if completion queue is empty.
+           * \note call advance() once done with the completion.
+           */
+          const struct io_uring_cqe* peek() const;
+
+          /**
+           * \brief Releases oldest completion to the kernel.
+           */
+          void advance();
+
+          /**
+           * \brief Registers file descriptors, used as index with
+           * IOSQE_FIXED_FILE.
+           * \param fds file descriptors.
+           * \param count number of file descriptors.
+           * \throw boost::system::system_error on error.
+           */
+          void register_files(const int* fds, unsigned count);
+
+          /**
+           * \brief Registers buffers, used as index with *_FIXED operations.
+           * \param iovs buffers.
+           * \param count number of buffers.
+           * \throw boost::system::system_error on error.
+           */
+          void register_buffers(const struct iovec* iovs, unsigned count);
+
+          /**
+           * \brief Registers a provided buffer ring.
+           * \param ring ring, page aligned.
+           * \param entries number of entries (power of 2).
+           * \param group buffer group identifier.
+           * \throw boost::system::system_error on error.
+           */
+          void register_buf_ring(struct io_uring_buf_ring* ring,
+              unsigned entries, uint16_t group);
+
+        private:
+          /**
+           * \brief Unmaps rings and closes ring file descriptor.
+           */
+          void release();
+
+          /**
+           * \brief Calls io_uring_register().
+           * \param opcode register operation.
+           * \param arg argument.
+           * \param nr_args number of arguments.
+           * \param what operation name for the exception.
+           * \throw boost::system::system_error on error.
+           */
+          void do_register(unsigned opcode, const void* arg,
+              unsigned nr_args, const char* what);
+
+          /**
+           * \brief Ring file descriptor.
+           */
+          int m_fd;
+
+          /**
+           * \brief Submission queue ring mapping.
+           */
+          void* m_sq_ring;
+
+          /**
+           * \brief Submission queue ring mapping size.
+           */
+          size_t m_sq_ring_size;
+
+          /**
+           * \brief Completion queue ring mapping, may alias m_sq_ring.
+           */
+          void* m_cq_ring;
+
+          /**
+           * \brief Completion queue ring mapping size.
+           */
+          size_t m_cq_ring_size;
+
+          /**
+           * \brief Submission queue entries.
+           */
+          struct io_uring_sqe* m_sqes;
+
+          /**
+           * \brief Submission queue entries mapping size.
+           */
+          size_t m_sqes_size;
+
+          /**
+           * \brief Kernel submission queue head.
+           */
+          unsigned* m_sq_khead;
+
+          /**
+           * \brief Kernel submission queue tail.
+           */
+          unsigned* m_sq_ktail;
+
+          /**
+           * \brief Submission queue mask.
+           */
+          unsigned m_sq_mask;
+
+          /**
+           * \brief Submission queue entries count.
+           */
+          unsigned m_sq_entries;
+
+          /**
+           * \brief First entry not yet submitted.
+           */
+          unsigned m_sqe_head;
+
+          /**
+           * \brief Next entry to allocate.
+           */
+          unsigned m_sqe_tail;
+
+          /**
+           * \brief Kernel completion queue head.
+           */
+          unsigned* m_cq_khead;
+
+          /**
+           * \brief Kernel completion queue tail.
+           */
+          unsigned* m_cq_ktail;
+
+          /**
+           * \brief Completion queue mask.
+           */
+          unsigned m_cq_mask;
+
+          /**
+           * \brief Completion queue entries.
+           */
+          struct io_uring_cqe* m_cqes;
+
+          /**
+           * \brief Supported operations, from IORING_REGISTER_PROBE.
+           */
+          uint8_t m_ops[256];
+      };
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
+
+#endif /* ASIO_RAW_LL_URING_HPP */
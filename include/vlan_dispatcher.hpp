@@ -0,0 +1,202 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file vlan_dispatcher.hpp
+ * \brief Per-VLAN frame dispatch.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef ASIO_RAW_LL_VLAN_DISPATCHER_HPP
+#define ASIO_RAW_LL_VLAN_DISPATCHER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <array>
+#include <functional>
+#include <vector>
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \class vlan_tag
+       * \brief 802.1Q/802.1ad tag of a received frame.
+       */
+      class vlan_tag
+      {
+        public:
+          /**
+           * \brief Constructor, describes an untagged frame.
+           */
+          vlan_tag()
+            : valid(false),
+            tci(0),
+            tpid(0)
+          {
+          }
+
+          /**
+           * \brief Constructor.
+           * \param vlan_tci tag control information.
+           * \param vlan_tpid tag protocol identifier.
+           */
+          vlan_tag(uint16_t vlan_tci, uint16_t vlan_tpid)
+            : valid(true),
+            tci(vlan_tci),
+            tpid(vlan_tpid)
+          {
+          }
+
+          /**
+           * \brief Returns VLAN identifier.
+           * \return VLAN identifier (0 to 4095).
+           */
+          uint16_t vid() const
+          {
+            return tci & 0x0fff;
+          }
+
+          /**
+           * \brief Returns priority code point.
+           * \return priority (0 to 7).
+           */
+          uint8_t pcp() const
+          {
+            return static_cast<uint8_t>(tci >> 13);
+          }
+
+          /**
+           * \brief Returns drop eligible indicator.
+           * \return true if frame is drop eligible.
+           */
+          bool dei() const
+          {
+            return tci & 0x1000;
+          }
+
+          /**
+           * \brief Whether frame was tagged.
+           */
+          bool valid;
+
+          /**
+           * \brief Tag control information in host byte order.
+           */
+          uint16_t tci;
+
+          /**
+           * \brief Tag protocol identifier in host byte order (0x8100 or
+           * 0x88a8).
+           */
+          uint16_t tpid;
+      };
+
+      /**
+       * \class vlan_dispatcher
+       * \brief Dispatches frames to per-VLAN handlers.
+       *
+       * Lookup is a single load in a flat 4096-entry table of handler
+       * indexes (8 KB), so dispatch cost does not depend on the number of
+       * registered VLANs.
+       * \code
+       *  vlan_dispatcher dispatcher;
+       *
+       *  dispatcher.add(100, tenant_a);
+       *  dispatcher.add(200, tenant_b);
+       *
+       *  // in handle_recv() of a server with set_auxdata(true)
+       *  dispatcher.dispatch(vlan(), buffer().data(), nb);
+       * \endcode
+       */
+      class vlan_dispatcher
+      {
+        public:
+          /**
+           * \brief Frame handler.
+           * \param tag VLAN tag of the frame.
+           * \param data frame (tag not re-inserted if it was stripped).
+           * \param len frame length.
+           */
+          typedef std::function<void(const vlan_tag& tag, const char* data,
+              size_t len)> handler;
+
+          /**
+           * \brief Number of VLAN identifiers.
+           */
+          static const size_t vid_count = 4096;
+
+          /**
+           * \brief Constructor.
+           */
+          vlan_dispatcher();
+
+          /**
+           * \brief Registers handler for a VLAN.
+           * \param vid VLAN identifier.
+           * \param h handler.
+           * \throw std::out_of_range if vid is greater than 4095.
+           */
+          void add(uint16_t vid, const handler& h);
+
+          /**
+           * \brief Unregisters handler of a VLAN, frames go to default
+           * handler again.
+           * \param vid VLAN identifier.
+           */
+          void remove(uint16_t vid);
+
+          /**
+           * \brief Sets handler for untagged frames.
+           * \param h handler.
+           */
+          void set_untagged(const handler& h);
+
+          /**
+           * \brief Sets handler for tagged frames of unregistered VLANs.
+           * \param h handler.
+           */
+          void set_default(const handler& h);
+
+          /**
+           * \brief Dispatches a frame.
+           * \param tag tag reported out-of-band (PACKET_AUXDATA), if not
+           * valid an in-band 802.1Q/802.1ad tag is looked for in data.
+           * \param data frame.
+           * \param len frame length.
+           * \return true if a handler was called.
+           */
+          bool dispatch(const vlan_tag& tag, const char* data,
+              size_t len) const;
+
+        private:
+          /**
+           * \brief Handler index per VLAN identifier (0: default).
+           */
+          std::array<uint16_t, vid_count> m_index;
+
+          /**
+           * \brief Handlers, index 0 is the default handler.
+           */
+          std::vector<handler> m_handlers;
+
+          /**
+           * \brief Untagged frames handler.
+           */
+          handler m_untagged;
+      };
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
+
+#endif /* ASIO_RAW_LL_VLAN_DISPATCHER_HPP */
@@ -0,0 +1,177 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file xdp_program.hpp
+ * \brief XDP program redirecting frames to AF_XDP sockets.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef ASIO_RAW_LL_XDP_PROGRAM_HPP
+#define ASIO_RAW_LL_XDP_PROGRAM_HPP
+
+#include <cstdint>
+
+#include <boost/noncopyable.hpp>
+
+#include <net/ethernet.h>
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \class xdp_program
+       * \brief XDP program redirecting frames of an ethertype to the AF_XDP
+       * socket of their receive queue.
+       *
+       * The program is assembled here (no compiler or libbpf needed):
+       * frames of other ethertypes, or received on a queue without socket,
+       * go on to the kernel stack (XDP_PASS). It is attached with a BPF
+       * link, so it is detached when this object is destroyed or the
+       * process exits.
+       *
+       * One program is attached per interface: for several queues, create
+       * it once and give it to one async_xdp_server per queue.
+       */
+      class xdp_program : private boost::noncopyable
+      {
+        public:
+          /**
+           * \enum attach_mode
+           * \brief XDP attach mode.
+           */
+          enum attach_mode
+          {
+            /**
+             * \brief Native (driver) mode, generic if not supported.
+             */
+            mode_auto,
+
+            /**
+             * \brief Native (driver) mode only, needed for zero-copy.
+             */
+            mode_native,
+
+            /**
+             * \brief Generic (skb) mode, works on any interface.
+             */
+            mode_generic
+          };
+
+          /**
+           * \brief Constructor.
+           * \param ifindex interface index.
+           * \param eth_protocol ethertype to redirect (ETH_P_ALL for all).
+           * \param mode attach mode.
+           * \param queues number of queue slots in the socket map.
+           * \throw boost::system::system_error if program cannot be loaded
+           * or attached.
+           */
+          xdp_program(uint32_t ifindex, uint16_t eth_protocol = ETH_P_ALL,
+              attach_mode mode = mode_auto, uint32_t queues = 64);
+
+          /**
+           * \brief Destructor, detaches program.
+           */
+          ~xdp_program();
+
+          /**
+           * \brief Redirects frames of a queue to a socket.
+           * \param queue_id queue.
+           * \param fd AF_XDP socket, bound to queue_id.
+           * \throw boost::system::system_error on error.
+           */
+          void add_socket(uint32_t queue_id, int fd);
+
+          /**
+           * \brief Stops redirecting frames of a queue.
+           * \param queue_id queue.
+           */
+          void remove_socket(uint32_t queue_id);
+
+          /**
+           * \brief Returns interface index.
+           * \return interface index.
+           */
+          uint32_t ifindex() const
+          {
+            return m_ifindex;
+          }
+
+          /**
+           * \brief Returns ethertype redirected by the program.
+           * \return ethertype in host byte order.
+           */
+          uint16_t eth_protocol() const
+          {
+            return m_eth_protocol;
+          }
+
+          /**
+           * \brief Returns whether the program runs in the driver.
+           * \return true for native mode, false for generic mode.
+           */
+          bool native() const
+          {
+            return m_native;
+          }
+
+        private:
+          /**
+           * \brief Loads program.
+           * \param eth_protocol ethertype to redirect.
+           * \throw boost::system::system_error on error.
+           */
+          void load(uint16_t eth_protocol);
+
+          /**
+           * \brief Attaches program with a BPF link.
+           * \param flags XDP_FLAGS_SKB_MODE or XDP_FLAGS_DRV_MODE.
+           * \return link file descriptor, -1 on error (errno set).
+           */
+          int attach(uint32_t flags);
+
+          /**
+           * \brief Interface index.
+           */
+          uint32_t m_ifindex;
+
+          /**
+           * \brief Ethertype redirected by the program.
+           */
+          uint16_t m_eth_protocol;
+
+          /**
+           * \brief XSKMAP file descriptor.
+           */
+          int m_map;
+
+          /**
+           * \brief Program file descriptor.
+           */
+          int m_prog;
+
+          /**
+           * \brief BPF link file descriptor.
+           */
+          int m_link;
+
+          /**
+           * \brief Whether program runs in native mode.
+           */
+          bool m_native;
+      };
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
+
+#endif /* ASIO_RAW_LL_XDP_PROGRAM_HPP */
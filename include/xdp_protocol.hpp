@@ -0,0 +1,441 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file xdp_protocol.hpp
+ * \brief AF_XDP protocol and endpoint for Boost.Asio.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#ifndef ASIO_RAW_LL_XDP_PROTOCOL_HPP
+#define ASIO_RAW_LL_XDP_PROTOCOL_HPP
+
+#include <cstring>
+
+#include <stdexcept>
+#include <string>
+
+#include <boost/asio.hpp>
+
+#include <sys/socket.h>
+
+#include <net/if.h>
+#include <net/ethernet.h>
+#include <linux/if_xdp.h>
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \class xdp_endpoint
+       * \brief AF_XDP endpoint: one receive/transmit queue of an interface.
+       *
+       * The ethertype is not part of the socket address, it is used by the
+       * XDP program redirecting frames to the socket (see xdp_program).
+       */
+      template <typename Protocol>
+      class xdp_endpoint
+      {
+        public:
+          /**
+           * \brief The protocol type associated with the endpoint typedef.
+           */
+          typedef Protocol protocol_type;
+
+          /**
+           * \brief The socket address type typedef.
+           */
+          typedef boost::asio::detail::socket_addr_type data_type;
+
+          /**
+           * \brief Constructor.
+           */
+          xdp_endpoint()
+            : m_protocol_type(ETH_P_ALL)
+          {
+            memset(&m_sockaddr, 0x00, sizeof(m_sockaddr));
+            m_sockaddr.sxdp_family = AF_XDP;
+          }
+
+          /**
+           * \brief Constructor.
+           * \param ifname interface name.
+           * \param eth_protocol network protocol redirected to the socket.
+           * \param queue_id interface queue.
+           * \param flags bind flags (XDP_COPY, XDP_ZEROCOPY, ...).
+           * \throw std::runtime_error if interface does not exist.
+           */
+          xdp_endpoint(const std::string& ifname,
+              uint16_t eth_protocol = ETH_P_ALL, uint32_t queue_id = 0,
+              uint16_t flags = 0)
+            : m_protocol_type(eth_protocol)
+          {
+            unsigned int ifindex = if_nametoindex(ifname.c_str());
+
+            // unlike PF_PACKET, there is no "all interfaces" socket
+            if(ifindex == 0)
+            {
+              std::string str = "network interface '" + ifname +
+                "' does not exist";
+              throw std::runtime_error(str);
+            }
+
+            memset(&m_sockaddr, 0x00, sizeof(m_sockaddr));
+            m_sockaddr.sxdp_family = AF_XDP;
+            m_sockaddr.sxdp_flags = flags;
+            m_sockaddr.sxdp_ifindex = ifindex;
+            m_sockaddr.sxdp_queue_id = queue_id;
+          }
+
+          /**
+           * \brief Constructor.
+           * \param ifindex interface index.
+           * \param eth_protocol network protocol redirected to the socket.
+           * \param queue_id interface queue.
+           * \param flags bind flags (XDP_COPY, XDP_ZEROCOPY, ...).
+           */
+          xdp_endpoint(uint32_t ifindex, uint16_t eth_protocol,
+              uint32_t queue_id = 0, uint16_t flags = 0)
+            : m_protocol_type(eth_protocol)
+          {
+            memset(&m_sockaddr, 0x00, sizeof(m_sockaddr));
+            m_sockaddr.sxdp_family = AF_XDP;
+            m_sockaddr.sxdp_flags = flags;
+            m_sockaddr.sxdp_ifindex = ifindex;
+            m_sockaddr.sxdp_queue_id = queue_id;
+          }
+
+          /**
+           * \brief Returns the protocol associated with the endpoint.
+           * \return protocol associated with the endpoint.
+           */
+          protocol_type protocol() const
+          {
+            return m_protocol_type;
+          }
+
+          /**
+           * \brief Returns interface index.
+           * \return interface index.
+           */
+          uint32_t ifindex() const
+          {
+            return m_sockaddr.sxdp_ifindex;
+          }
+
+          /**
+           * \brief Returns interface queue.
+           * \return queue identifier.
+           */
+          uint32_t queue_id() const
+          {
+            return m_sockaddr.sxdp_queue_id;
+          }
+
+          /**
+           * \brief Returns bind flags.
+           * \return flags.
+           */
+          uint16_t flags() const
+          {
+            return m_sockaddr.sxdp_flags;
+          }
+
+          /**
+           * \brief Sets bind flags.
+           * \param flags flags (XDP_COPY, XDP_ZEROCOPY, ...).
+           */
+          void set_flags(uint16_t flags)
+          {
+            m_sockaddr.sxdp_flags = flags;
+          }
+
+          /**
+           * \brief Returns the underlying endpoint in the native type.
+           * \return the underlying endpoint in the native type.
+           */
+          data_type* data()
+          {
+            return reinterpret_cast<struct sockaddr*>(&m_sockaddr);
+          }
+
+          /**
+           * \brief Returns the underlying endpoint in the native type.
+           * \return the underlying endpoint in the native type.
+           */
+          const data_type* data() const
+          {
+            return reinterpret_cast<const struct sockaddr*>(&m_sockaddr);
+          }
+
+          /**
+           * \brief Returns the size of the endpoint in the native type.
+           * \return the size of the endpoint in the native type.
+           */
+          std::size_t size() const
+          {
+            return sizeof(m_sockaddr);
+          }
+
+          /**
+           * \brief Sets the underlying size of the endpoint in the native type.
+           * \param s new size.
+           * \note this function does nothing.
+           */
+          void resize(std::size_t s)
+          {
+            // nothing we can do here
+            (void)s;
+          }
+
+          /**
+           * \brief Returns the capacity of the endpoint in the native type.
+           * \return the capacity of the endpoint in the native type.
+           */
+          std::size_t capacity() const
+          {
+            return sizeof(m_sockaddr);
+          }
+
+          /**
+           * \brief Compare endpoints for equality.
+           * \param e1 first endpoint to compare.
+           * \param e2 second endpoint to compare.
+           * \return true if first is equal to the second endpoint.
+           */
+          friend bool operator==(const xdp_endpoint<Protocol>& e1,
+              const xdp_endpoint<Protocol>& e2)
+          {
+            return !memcmp(&e1.m_sockaddr, &e2.m_sockaddr,
+                sizeof(struct sockaddr_xdp));
+          }
+
+          /**
+           * \brief Compare endpoints for inequality.
+           * \param e1 first endpoint to compare.
+           * \param e2 second endpoint to compare.
+           * \return true if first is not equal to the second endpoint.
+           */
+          friend bool operator!=(const xdp_endpoint<Protocol>& e1,
+              const xdp_endpoint<Protocol>& e2)
+          {
+            return !(e1 == e2);
+          }
+
+          /**
+           * \brief Compare endpoints for ordering.
+           * \param e1 first endpoint to compare.
+           * \param e2 second endpoint to compare.
+           * \return true if first is lower than second endpoint.
+           */
+          friend bool operator<(const xdp_endpoint<Protocol>& e1,
+              const xdp_endpoint<Protocol>& e2)
+          {
+            return memcmp(&e1.m_sockaddr, &e2.m_sockaddr,
+                sizeof(struct sockaddr_xdp)) < 0;
+          }
+
+        private:
+          /**
+           * \brief XDP socket address.
+           */
+          struct sockaddr_xdp m_sockaddr;
+
+          /**
+           * \brief Protocol.
+           */
+          protocol_type m_protocol_type;
+      };
+
+      /**
+       * \class xdp_protocol
+       * \brief AF_XDP protocol, counterpart of ll_protocol.
+       *
+       * An AF_XDP socket must be given its UMEM and ring sizes with the
+       * options below between open() and bind(); async_xdp_server does
+       * this and maps the rings.
+       */
+      class xdp_protocol
+      {
+        public:
+          /**
+           * \brief The XDP socket typedef.
+           */
+          typedef boost::asio::basic_raw_socket<xdp_protocol> socket;
+
+          /**
+           * \brief The XDP endpoint typedef.
+           */
+          typedef xdp_endpoint<xdp_protocol> endpoint;
+
+          /**
+           * \brief Socket option to set RX ring size (XDP_RX_RING).
+           */
+          typedef boost::asio::detail::socket_option::integer<SOL_XDP,
+                  XDP_RX_RING> rx_ring;
+
+          /**
+           * \brief Socket option to set TX ring size (XDP_TX_RING).
+           */
+          typedef boost::asio::detail::socket_option::integer<SOL_XDP,
+                  XDP_TX_RING> tx_ring;
+
+          /**
+           * \brief Socket option to set fill ring size
+           * (XDP_UMEM_FILL_RING).
+           */
+          typedef boost::asio::detail::socket_option::integer<SOL_XDP,
+                  XDP_UMEM_FILL_RING> fill_ring;
+
+          /**
+           * \brief Socket option to set completion ring size
+           * (XDP_UMEM_COMPLETION_RING).
+           */
+          typedef boost::asio::detail::socket_option::integer<SOL_XDP,
+                  XDP_UMEM_COMPLETION_RING> completion_ring;
+
+          /**
+           * \class umem_reg
+           * \brief Socket option to register the UMEM area (XDP_UMEM_REG).
+           */
+          class umem_reg
+          {
+            public:
+              /**
+               * \brief Constructor.
+               * \param area UMEM area, page aligned.
+               * \param len area length.
+               * \param frame_size frame (chunk) size, power of 2 from 2048
+               * to page size.
+               * \param headroom headroom reserved before each frame.
+               */
+              umem_reg(void* area, size_t len, uint32_t frame_size,
+                  uint32_t headroom = 0)
+              {
+                memset(&m_reg, 0x00, sizeof(m_reg));
+                m_reg.addr = reinterpret_cast<uintptr_t>(area);
+                m_reg.len = len;
+                m_reg.chunk_size = frame_size;
+                m_reg.headroom = headroom;
+              }
+
+              /**
+               * \brief Returns option level.
+               * \param p protocol.
+               * \return SOL_XDP.
+               */
+              template <typename Protocol>
+              int level(const Protocol& p) const
+              {
+                (void)p;
+                return SOL_XDP;
+              }
+
+              /**
+               * \brief Returns option name.
+               * \param p protocol.
+               * \return XDP_UMEM_REG.
+               */
+              template <typename Protocol>
+              int name(const Protocol& p) const
+              {
+                (void)p;
+                return XDP_UMEM_REG;
+              }
+
+              /**
+               * \brief Returns option data.
+               * \param p protocol.
+               * \return pointer to struct xdp_umem_reg.
+               */
+              template <typename Protocol>
+              const void* data(const Protocol& p) const
+              {
+                (void)p;
+                return &m_reg;
+              }
+
+              /**
+               * \brief Returns option data size.
+               * \param p protocol.
+               * \return size of struct xdp_umem_reg.
+               */
+              template <typename Protocol>
+              size_t size(const Protocol& p) const
+              {
+                (void)p;
+                return sizeof(m_reg);
+              }
+
+            private:
+              /**
+               * \brief UMEM registration.
+               */
+              struct xdp_umem_reg m_reg;
+          };
+
+          /**
+           * \brief Constructor.
+           * \param eth_protocol ethertype redirected to the socket.
+           */
+          explicit xdp_protocol(uint16_t eth_protocol = ETH_P_ALL)
+            : m_eth_protocol(eth_protocol)
+          {
+          }
+
+          /**
+           * \brief Returns type of protocol.
+           * \return type of protocol.
+           */
+          int type() const
+          {
+            return SOCK_RAW;
+          }
+
+          /**
+           * \brief Returns identifier of the protocol.
+           * \return 0, AF_XDP sockets do not take a protocol.
+           */
+          int protocol() const
+          {
+            return 0;
+          }
+
+          /**
+           * \brief Returns identifier for the protocol family.
+           * \returns AF_XDP.
+           */
+          int family() const
+          {
+            return AF_XDP;
+          }
+
+          /**
+           * \brief Returns ethertype redirected to the socket.
+           * \return ethertype in host byte order.
+           */
+          uint16_t eth_protocol() const
+          {
+            return m_eth_protocol;
+          }
+
+        private:
+          /**
+           * \brief Ethertype redirected to the socket.
+           */
+          uint16_t m_eth_protocol;
+      };
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
+
+#endif /* ASIO_RAW_LL_XDP_PROTOCOL_HPP */
@@ -0,0 +1,559 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file alloc_check.cpp
+ * \brief Checks that receive and send hot paths do not allocate.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <iostream>
+#include <new>
+
+#include <sys/socket.h>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+
+#include "async_raw_server.hpp"
+#include "async_uring_server.hpp"
+#include "async_vnet_server.hpp"
+#include "async_xdp_server.hpp"
+#include "frame_dedup.hpp"
+
+using namespace asio::raw::ll;
+
+extern "C"
+{
+  void* __libc_malloc(size_t size);
+  void* __libc_calloc(size_t nmemb, size_t size);
+  void* __libc_realloc(void* ptr, size_t size);
+  void* __libc_memalign(size_t alignment, size_t size);
+  void __libc_free(void* ptr);
+}
+
+/**
+ * \var g_armed
+ * \brief Whether allocations are counted.
+ */
+static bool g_armed = false;
+
+/**
+ * \var g_allocations
+ * \brief Number of allocations while armed.
+ */
+static size_t g_allocations = 0;
+
+/**
+ * \brief Counts an allocation.
+ */
+static inline void count_allocation()
+{
+  if(g_armed)
+  {
+    g_allocations++;
+  }
+}
+
+extern "C"
+{
+  void* malloc(size_t size)
+  {
+    count_allocation();
+    return __libc_malloc(size);
+  }
+
+  void* calloc(size_t nmemb, size_t size)
+  {
+    count_allocation();
+    return __libc_calloc(nmemb, size);
+  }
+
+  void* realloc(void* ptr, size_t size)
+  {
+    count_allocation();
+    return __libc_realloc(ptr, size);
+  }
+
+  int posix_memalign(void** ptr, size_t alignment, size_t size)
+  {
+    count_allocation();
+    *ptr = __libc_memalign(alignment, size);
+    return *ptr ? 0 : ENOMEM;
+  }
+
+  void* aligned_alloc(size_t alignment, size_t size)
+  {
+    count_allocation();
+    return __libc_memalign(alignment, size);
+  }
+
+  void free(void* ptr)
+  {
+    __libc_free(ptr);
+  }
+}
+
+/**
+ * \brief Global operator new, counted by malloc().
+ * \param size size.
+ * \return memory.
+ */
+void* operator new(size_t size)
+{
+  void* ret = malloc(size ? size : 1);
+
+  if(ret == nullptr)
+  {
+    throw std::bad_alloc();
+  }
+  return ret;
+}
+
+/**
+ * \brief Global operator new[], counted by malloc().
+ * \param size size.
+ * \return memory.
+ */
+void* operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+/**
+ * \brief Global operator delete.
+ * \param ptr memory.
+ */
+void operator delete(void* ptr) noexcept
+{
+  free(ptr);
+}
+
+/**
+ * \brief Global operator delete[].
+ * \param ptr memory.
+ */
+void operator delete[](void* ptr) noexcept
+{
+  free(ptr);
+}
+
+/**
+ * \brief Returns frame data of a receive buffer.
+ * \param b buffer.
+ * \return data.
+ */
+static const char* frame_data(const std::array<char, 1500>& b)
+{
+  return b.data();
+}
+
+/**
+ * \brief Returns frame data of a receive buffer.
+ * \param b buffer.
+ * \return data.
+ */
+static const char* frame_data(const std::vector<char>& b)
+{
+  return b.data();
+}
+
+/**
+ * \brief Returns frame data of a receive buffer.
+ * \param b buffer.
+ * \return data.
+ */
+static const char* frame_data(const char* b)
+{
+  return b;
+}
+
+/**
+ * \class echo
+ * \brief Sends back every frame received, counting allocations once
+ * warmed up.
+ */
+template<class Server>
+class echo : public Server
+{
+  public:
+    /**
+     * \brief Constructor.
+     * \param ios Boost.Asio IO service.
+     * \param warmup round trips before counting.
+     * \param count round trips counted.
+     * \param args server arguments.
+     */
+    template<typename... Args>
+    echo(boost::asio::io_service& ios, size_t warmup, size_t count,
+        Args&&... args)
+      : Server(std::forward<Args>(args)...),
+      m_ios(ios),
+      m_warmup(warmup),
+      m_count(count),
+      m_received(0),
+      m_errors(0),
+      m_allocations(0),
+      m_twice(false),
+      m_sequence(0)
+    {
+    }
+
+    /**
+     * \brief Sends each frame twice under a new sequence number, for a
+     * receiver dropping duplicates.
+     * \param enable enable or not.
+     */
+    void set_twice(bool enable)
+    {
+      m_twice = enable;
+    }
+
+    /**
+     * \brief Returns allocations counted.
+     * \return number of allocations.
+     */
+    size_t allocations() const
+    {
+      return m_allocations;
+    }
+
+    /**
+     * \brief Returns round trips done.
+     * \return number of frames received.
+     */
+    size_t received() const
+    {
+      return m_received;
+    }
+
+    /**
+     * \brief Returns number of errors.
+     * \return number of errors.
+     */
+    size_t errors() const
+    {
+      return m_errors;
+    }
+
+  protected:
+    /**
+     * \brief Receive callback.
+     * \param error error value.
+     * \param nb number of bytes transferred.
+     */
+    virtual void handle_recv(const boost::system::error_code& error,
+        size_t nb)
+    {
+      if(error)
+      {
+        m_errors++;
+        m_ios.stop();
+        return;
+      }
+
+      m_received++;
+      if(m_received == m_warmup)
+      {
+        g_allocations = 0;
+        g_armed = true;
+      }
+      else if(m_received == m_warmup + m_count)
+      {
+        g_armed = false;
+        m_allocations = g_allocations;
+        m_ios.stop();
+        return;
+      }
+
+      Server::async_recv();
+
+      if(m_twice)
+      {
+        size_t len = std::min(nb, sizeof(m_frame));
+
+        // a new frame each round trip, its copy is the duplicate
+        memcpy(m_frame, frame_data(Server::buffer()), len);
+        m_sequence++;
+        memcpy(m_frame + 14, &m_sequence, sizeof(m_sequence));
+        Server::async_send(m_frame, len);
+        Server::async_send(m_frame, len);
+        return;
+      }
+
+      Server::async_send(frame_data(Server::buffer()), nb);
+    }
+
+    /**
+     * \brief Send callback.
+     * \param error error value.
+     * \param nb number of bytes transferred.
+     */
+    virtual void handle_send(const boost::system::error_code& error,
+        size_t nb)
+    {
+      (void)nb;
+
+      if(error)
+      {
+        m_errors++;
+      }
+    }
+
+  private:
+    /**
+     * \brief Boost.Asio IO service.
+     */
+    boost::asio::io_service& m_ios;
+
+    /**
+     * \brief Round trips before counting.
+     */
+    size_t m_warmup;
+
+    /**
+     * \brief Round trips counted.
+     */
+    size_t m_count;
+
+    /**
+     * \brief Frames received.
+     */
+    size_t m_received;
+
+    /**
+     * \brief Errors.
+     */
+    size_t m_errors;
+
+    /**
+     * \brief Allocations counted.
+     */
+    size_t m_allocations;
+
+    /**
+     * \brief Whether each frame is sent twice.
+     */
+    bool m_twice;
+
+    /**
+     * \brief Sequence number of the frame sent twice.
+     */
+    uint64_t m_sequence;
+
+    /**
+     * \brief Frame sent twice.
+     */
+    char m_frame[64];
+};
+
+/**
+ * \brief Warm-up round trips.
+ */
+static const size_t warmup_frames = 1000;
+
+/**
+ * \brief Round trips counted.
+ */
+static const size_t counted_frames = 20000;
+
+/**
+ * \brief Test frame, to the local experimental EtherType.
+ */
+static const char test_frame[64] = {
+  0x02, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x00, 0x00, 0x00, 0x00, 0x02,
+  static_cast<char>(0x88), static_cast<char>(0xb5)
+};
+
+/**
+ * \brief Runs the echo loop and reports.
+ * \param ios Boost.Asio IO service.
+ * \param name test name.
+ * \param servers echo servers, the first one sends the first frame.
+ * \param nb number of servers.
+ * \return true if no allocation happened after warm-up.
+ */
+template<class Server>
+static bool run(boost::asio::io_service& ios, const char* name,
+    echo<Server>** servers, size_t nb)
+{
+  boost::asio::deadline_timer timeout(ios,
+      boost::posix_time::seconds(10));
+  const echo<Server>& first = *servers[0];
+  bool ret = false;
+
+  timeout.async_wait([&ios](const boost::system::error_code& error)
+  {
+    if(!error)
+    {
+      ios.stop();
+    }
+  });
+
+  for(size_t i = 0 ; i < nb ; i++)
+  {
+    servers[i]->async_recv();
+  }
+  servers[0]->async_send(test_frame, sizeof(test_frame));
+  ios.run();
+
+  ret = first.received() == warmup_frames + counted_frames &&
+    first.errors() == 0 && first.allocations() == 0;
+  std::cout << name << ": " << first.received() << " frames, "
+    << first.errors() << " errors, " << first.allocations()
+    << " allocations after warm-up" << (ret ? "" : " FAILED")
+    << std::endl;
+  return ret;
+}
+
+/**
+ * \brief Entry point of the program.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+int main(int argc, char** argv)
+{
+  const char* ifname = argc > 1 ? argv[1] : "lo";
+  int ret = EXIT_SUCCESS;
+  bool privileged = true;
+
+  // packet sockets on an interface, frames come back through it
+  try
+  {
+    boost::asio::io_service ios;
+    echo<async_raw_server> server(ios, warmup_frames, counted_frames, ios,
+        ifname, 0x88b5);
+    echo<async_raw_server>* servers[] = {&server};
+
+    ret = run(ios, "async_raw_server", servers, 1) ? ret : EXIT_FAILURE;
+  }
+  catch(boost::system::system_error& e)
+  {
+    if(e.code() != boost::system::errc::operation_not_permitted)
+    {
+      std::cerr << "async_raw_server: " << e.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+    privileged = false;
+  }
+
+  // PACKET_AUXDATA receive path, dropping duplicates before handle_recv()
+  if(privileged)
+  {
+    try
+    {
+      boost::asio::io_service ios;
+      frame_dedup dedup;
+      echo<async_raw_server> server(ios, warmup_frames, counted_frames, ios,
+          ifname, 0x88b5);
+      echo<async_raw_server>* servers[] = {&server};
+
+      server.set_auxdata(true);
+      server.set_dedup(&dedup);
+      server.set_twice(true);
+
+      ret = run(ios, "async_raw_server (auxdata, dedup)", servers, 1) ? ret :
+        EXIT_FAILURE;
+
+      if(dedup.stats().dropped < counted_frames)
+      {
+        std::cerr << "async_raw_server (auxdata, dedup): "
+          << dedup.stats().dropped << " duplicates dropped" << std::endl;
+        ret = EXIT_FAILURE;
+      }
+    }
+    catch(std::exception& e)
+    {
+      std::cerr << "async_raw_server (auxdata, dedup): " << e.what()
+        << std::endl;
+      ret = EXIT_FAILURE;
+    }
+  }
+
+  if(!privileged)
+  {
+    // same server code over a socketpair instead of a packet socket
+    int fds[2];
+
+    if(socketpair(AF_UNIX, SOCK_DGRAM, 0, fds) != 0)
+    {
+      std::cerr << "socketpair: " << strerror(errno) << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    boost::asio::io_service ios;
+    echo<async_raw_server> a(ios, warmup_frames, counted_frames, ios,
+        fds[0]);
+    echo<async_raw_server> b(ios, warmup_frames + 1, counted_frames, ios,
+        fds[1]);
+    echo<async_raw_server>* servers[] = {&a, &b};
+
+    std::cout << "not privileged, using a socketpair" << std::endl;
+    return run(ios, "async_raw_server (socketpair)", servers, 2) ? ret :
+      EXIT_FAILURE;
+  }
+
+  try
+  {
+    boost::asio::io_service ios;
+    echo<async_vnet_server> server(ios, warmup_frames, counted_frames, ios,
+        ifname, 0x88b5);
+    echo<async_vnet_server>* servers[] = {&server};
+
+    ret = run(ios, "async_vnet_server", servers, 1) ? ret : EXIT_FAILURE;
+  }
+  catch(std::exception& e)
+  {
+    std::cerr << "async_vnet_server: " << e.what() << std::endl;
+    ret = EXIT_FAILURE;
+  }
+
+  try
+  {
+    boost::asio::io_service ios;
+    echo<async_uring_server> server(ios, warmup_frames, counted_frames, ios,
+        ifname, 0x88b5);
+    echo<async_uring_server>* servers[] = {&server};
+
+    if(!server.uring_enabled())
+    {
+      std::cout << "async_uring_server: io_uring not available, "
+        << "socket fallback" << std::endl;
+    }
+    ret = run(ios, "async_uring_server", servers, 1) ? ret : EXIT_FAILURE;
+  }
+  catch(std::exception& e)
+  {
+    std::cerr << "async_uring_server: " << e.what() << std::endl;
+    ret = EXIT_FAILURE;
+  }
+
+  // AF_XDP needs driver or generic XDP support, optional
+  try
+  {
+    boost::asio::io_service ios;
+    echo<async_xdp_server> server(ios, warmup_frames, counted_frames, ios,
+        ifname, 0x88b5);
+    echo<async_xdp_server>* servers[] = {&server};
+
+    ret = run(ios, "async_xdp_server", servers, 1) ? ret : EXIT_FAILURE;
+  }
+  catch(std::exception& e)
+  {
+    std::cout << "async_xdp_server: skipped (" << e.what() << ")"
+      << std::endl;
+  }
+
+  return ret;
+}
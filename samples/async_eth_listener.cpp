@@ -36,7 +36,8 @@ class eth_listener : public async_raw_server
   public:
     eth_listener(boost::asio::io_service& ios, const std::string& ifname,
         int protocol = ETH_P_ALL)
-      : async_raw_server(ios, ifname, protocol)
+      : async_raw_server(ios, ifname, protocol,
+          socket_profile().set_ignore_outgoing(true))
     {
     }
 
@@ -0,0 +1,173 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file checksum_bench.cpp
+ * \brief Internet checksum and frame builder microbenchmarks.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <net/ethernet.h>
+
+#include "checksum.hpp"
+#include "frame_builder.hpp"
+
+using namespace asio::raw::ll;
+
+/**
+ * \var g_sink
+ * \brief Keeps results alive so the compiler does not drop the loops.
+ */
+static volatile uint32_t g_sink = 0;
+
+/**
+ * \brief Returns CLOCK_MONOTONIC time.
+ * \return time in nanoseconds.
+ */
+static double now_ns()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * \brief Times a checksum function.
+ * \param fn function.
+ * \param data data.
+ * \param len data length.
+ * \param iterations number of calls.
+ * \return nanoseconds per call.
+ */
+static double bench(uint32_t (*fn)(const void*, size_t, uint32_t),
+    const char* data, size_t len, size_t iterations)
+{
+  double start = now_ns();
+  uint32_t acc = 0;
+
+  for(size_t i = 0 ; i < iterations ; i++)
+  {
+    acc += fn(data, len, i & 0xff);
+  }
+
+  g_sink = acc;
+  return (now_ns() - start) / iterations;
+}
+
+/**
+ * \brief Entry point of the program.
+ * \return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+int main()
+{
+  const size_t sizes[] = {64, 576, 1500, 9000, 65536};
+  std::vector<char> data(65536 + 1);
+  int ret = EXIT_SUCCESS;
+
+  srand(42);
+  for(char& c : data)
+  {
+    c = static_cast<char>(rand());
+  }
+
+  std::cout << "checksum::partial implementation: "
+    << checksum::implementation() << std::endl;
+  std::cout << std::setw(8) << "size" << std::setw(14) << "scalar ns"
+    << std::setw(14) << "simd ns" << std::setw(14) << "simd GB/s"
+    << std::setw(10) << "speedup" << std::endl;
+
+  for(size_t size : sizes)
+  {
+    size_t iterations = (64 * 1024 * 1024) / size;
+
+    // partial sums are only congruent, compare folded values; odd offset
+    // and odd length check unaligned loads and the tail
+    for(size_t off = 0 ; off < 2 ; off++)
+    {
+      if(checksum::fold(checksum::partial(data.data() + off, size)) !=
+          checksum::fold(checksum::partial_scalar(data.data() + off,
+              size)) ||
+          checksum::fold(checksum::partial(data.data() + off, size - 1)) !=
+          checksum::fold(checksum::partial_scalar(data.data() + off,
+              size - 1)))
+      {
+        std::cerr << "Mismatch for size " << size << std::endl;
+        ret = EXIT_FAILURE;
+      }
+    }
+
+    double scalar = bench(checksum::partial_scalar, data.data(), size,
+        iterations);
+    double simd = bench(checksum::partial, data.data(), size, iterations);
+
+    std::cout << std::setw(8) << size
+      << std::setw(14) << std::fixed << std::setprecision(1) << scalar
+      << std::setw(14) << simd
+      << std::setw(14) << std::setprecision(2) << size / simd
+      << std::setw(9) << scalar / simd << "x" << std::endl;
+  }
+
+  // frame builder: header stamping, length fix-up and checksums
+  {
+    const uint8_t mac[ETH_ALEN] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+    const size_t iterations = 1000000;
+    std::vector<char> frame(1514);
+    frame_builder fb;
+    double start = 0;
+    size_t len = 0;
+
+    fb.ethernet(mac, mac)
+      .ipv4(inet_addr("10.0.0.1"), inet_addr("10.0.0.2"))
+      .udp(1234, 5678);
+
+    memcpy(frame.data() + fb.header_len(), data.data(), 1472);
+
+    start = now_ns();
+    for(size_t i = 0 ; i < iterations ; i++)
+    {
+      len += fb.build(frame.data(), 64 + (i & 1023));
+    }
+    g_sink = static_cast<uint32_t>(len);
+
+    std::cout << "frame_builder::build (IPv4/UDP, 64-1087 bytes payload): "
+      << std::setprecision(1) << (now_ns() - start) / iterations
+      << " ns/frame" << std::endl;
+
+    // whole UDP datagram including pseudo-header must sum to zero
+    len = fb.build(frame.data(), 1472);
+    {
+      uint16_t proto = htons(17);
+      uint16_t ulen = htons(1480);
+      uint32_t sum = checksum::partial(frame.data() + 26, 8);
+
+      sum = checksum::partial(&proto, 2, sum);
+      sum = checksum::partial(&ulen, 2, sum);
+      sum = checksum::partial(frame.data() + 34, 1480, sum);
+
+      if(frame[23] != 17 || checksum::fold(sum) != 0 ||
+          checksum::compute(frame.data() + 14, 20) != 0)
+      {
+        std::cerr << "Invalid frame_builder checksum" << std::endl;
+        ret = EXIT_FAILURE;
+      }
+    }
+  }
+
+  return ret;
+}
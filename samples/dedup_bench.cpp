@@ -0,0 +1,186 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file dedup_bench.cpp
+ * \brief Duplicate frame filter benchmark.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+
+#include "frame_dedup.hpp"
+
+using namespace asio::raw::ll;
+
+/**
+ * \var g_sink
+ * \brief Keeps results alive so the compiler does not drop the loops.
+ */
+static volatile uint64_t g_sink = 0;
+
+/**
+ * \brief Frame size without FCS (64 bytes on the wire).
+ */
+static const size_t frame_size = 60;
+
+/**
+ * \brief Time between two minimum size frames at 10 Gbit/s (with
+ * preamble and inter-frame gap).
+ */
+static const uint64_t frame_gap_ns = 67;
+
+/**
+ * \brief Frames between a frame and its mirrored copy.
+ */
+static const size_t copy_delay = 8;
+
+/**
+ * \brief Returns CLOCK_MONOTONIC time.
+ * \return time in nanoseconds.
+ */
+static double now_ns()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * \brief Times a fingerprint function over the first frames, in cache.
+ * \param fn function.
+ * \param frames frames.
+ * \param iterations number of calls.
+ * \return nanoseconds per frame.
+ */
+static double bench_hash(uint64_t (*fn)(const void*, size_t),
+    const std::vector<char>& frames, size_t iterations)
+{
+  double start = now_ns();
+  uint64_t acc = 0;
+
+  for(size_t i = 0 ; i < iterations ; i++)
+  {
+    acc += fn(frames.data() + (i & 1023) * frame_size, frame_size);
+  }
+
+  g_sink = acc;
+  return (now_ns() - start) / iterations;
+}
+
+/**
+ * \brief Entry point of the program.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+int main(int argc, char** argv)
+{
+  size_t count = 1 << 19;
+  size_t passes = 8;
+  std::vector<char> frames;
+  frame_dedup dedup(65536, 1000000);
+  uint64_t now = 0;
+  uint64_t expected = 0;
+  double start = 0;
+  double elapsed = 0;
+  int ret = EXIT_SUCCESS;
+
+  if(argc > 1)
+  {
+    passes = strtoul(argv[1], nullptr, 10);
+  }
+
+  // distinct frames: random payload and a sequence number, as unrelated
+  // flows and a counter in every frame would give
+  frames.resize(count * frame_size);
+  srand(42);
+  for(char& c : frames)
+  {
+    c = static_cast<char>(rand());
+  }
+  for(size_t i = 0 ; i < count ; i++)
+  {
+    uint64_t seq = i;
+
+    memcpy(frames.data() + i * frame_size + 14, &seq, sizeof(seq));
+  }
+
+  std::cout << "frame_dedup::hash implementation: "
+    << frame_dedup::implementation() << std::endl;
+  std::cout << "hash scalar: " << std::fixed << std::setprecision(2)
+    << bench_hash(frame_dedup::hash_scalar, frames, 1 << 24)
+    << " ns/frame" << std::endl;
+  std::cout << "hash simd:   "
+    << bench_hash(frame_dedup::hash, frames, 1 << 24) << " ns/frame"
+    << std::endl;
+
+  // mirror port stream: every frame, then its copy a few frames later;
+  // one clock tick per frame at 10 Gbit/s line rate
+  start = now_ns();
+  for(size_t p = 0 ; p < passes ; p++)
+  {
+    for(size_t i = 0 ; i < count + copy_delay ; i++)
+    {
+      if(i < count)
+      {
+        dedup.duplicate(frames.data() + i * frame_size, frame_size, now);
+        now += frame_gap_ns;
+      }
+
+      if(i >= copy_delay)
+      {
+        dedup.duplicate(frames.data() + (i - copy_delay) * frame_size,
+            frame_size, now);
+        now += frame_gap_ns;
+        expected++;
+      }
+    }
+
+    // passes further apart than the window: nothing is a duplicate
+    now += 2000000;
+  }
+  elapsed = now_ns() - start;
+
+  const frame_dedup::statistics& s = dedup.stats();
+
+  std::cout << "duplicate(): " << elapsed / s.frames << " ns/frame, "
+    << s.frames * 1e3 / elapsed << " Mpps (10GbE line rate: 14.88 Mpps)"
+    << std::endl;
+  std::cout << s.frames << " frames " << s.dropped << " dropped ("
+    << expected << " expected) " << s.evicted << " evicted" << std::endl;
+
+  if(s.dropped != expected)
+  {
+    std::cerr << "Wrong number of duplicates" << std::endl;
+    ret = EXIT_FAILURE;
+  }
+
+  // a copy arriving after the window is a new frame
+  {
+    frame_dedup late(1024, 1000);
+
+    late.duplicate(frames.data(), frame_size, 0);
+    if(late.duplicate(frames.data(), frame_size, 1001) ||
+        !late.duplicate(frames.data(), frame_size, 1500))
+    {
+      std::cerr << "Wrong time window" << std::endl;
+      ret = EXIT_FAILURE;
+    }
+  }
+
+  return ret;
+}
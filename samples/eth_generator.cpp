@@ -0,0 +1,151 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file eth_generator.cpp
+ * \brief Rate-paced UDP traffic generator sample.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+
+#include <iostream>
+
+#include <arpa/inet.h>
+
+#include "frame_builder.hpp"
+#include "traffic_generator.hpp"
+
+using namespace asio::raw::ll;
+
+/**
+ * \var g_generator
+ * \brief Running generator.
+ */
+static traffic_generator* g_generator = nullptr;
+
+/**
+ * \brief Signal handler.
+ * \param signum signal number.
+ */
+static void signal_handler(int signum)
+{
+  switch(signum)
+  {
+    case SIGINT:
+    case SIGTERM:
+      if(g_generator)
+      {
+        g_generator->stop();
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * \brief Entry point of the program.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+int main(int argc, char** argv)
+{
+  struct sigaction sa;
+  double pps = 10000;
+  uint64_t count = 0;
+
+  if(argc < 2)
+  {
+    std::cerr << "Usage: " << argv[0] << " ifname [pps] [count]"
+      << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if(argc > 2)
+  {
+    pps = atof(argv[2]);
+  }
+
+  if(argc > 3)
+  {
+    count = strtoull(argv[3], nullptr, 10);
+  }
+
+  memset(&sa, 0x00, sizeof(struct sigaction));
+
+  sa.sa_handler = signal_handler;
+  sigfillset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART;
+
+  if(sigaction(SIGINT, &sa, nullptr))
+  {
+    std::cerr << "Failed to catch SIGINT" << std::endl;
+  }
+
+  if(sigaction(SIGTERM, &sa, nullptr))
+  {
+    std::cerr << "Failed to catch SIGTERM" << std::endl;
+  }
+
+  try
+  {
+    boost::asio::io_service ios;
+    traffic_generator generator(ios, argv[1]);
+    const uint8_t dst[ETH_ALEN] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+    const uint8_t src[ETH_ALEN] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+    const char payload[18] = {0};
+    char frame[64];
+    frame_builder fb;
+    size_t len = 0;
+
+    fb.ethernet(dst, src)
+      .ipv4(inet_addr("10.0.0.1"), inet_addr("10.0.0.2"))
+      .udp(9, 9);
+    len = fb.build(frame, sizeof(frame), payload, sizeof(payload));
+
+    generator.set_template(frame, len);
+
+    // sequence number at start of UDP payload
+    generator.add_field(traffic_generator::field(fb.header_len(), 4)
+        .add_checksum(fb.l4_offset() + 6, fb.l4_offset(), true));
+    // 256 source addresses, covered by IPv4 checksum and UDP pseudo-header
+    generator.add_field(traffic_generator::field(fb.l3_offset() + 12, 4, 1,
+          256)
+        .add_checksum(fb.l3_offset() + 10, fb.l3_offset())
+        .add_checksum(fb.l4_offset() + 6, fb.l3_offset(), true));
+    // 16 source MAC addresses
+    generator.add_field(traffic_generator::field(6, 6, 1, 16));
+
+    generator.set_rate_pps(pps);
+    g_generator = &generator;
+
+    std::cout << "Generator running at " << pps << " pps" << std::endl;
+    const traffic_generator::statistics& stats = generator.run(count);
+    g_generator = nullptr;
+
+    std::cout << "Sent " << stats.frames << " frames in "
+      << stats.elapsed_ns / 1e9 << " s: "
+      << stats.pps() << " pps, " << stats.bps() / 1e6 << " Mbit/s, "
+      << "jitter " << stats.jitter_ns() << " ns, "
+      << "max late " << stats.max_late_ns << " ns, "
+      << stats.retries << " retries" << std::endl;
+  }
+  catch(std::exception& e)
+  {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Exiting..." << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,172 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file ethertype_listener.cpp
+ * \brief Asynchronous multi-protocol listener on a single socket sample.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <cstdlib>
+
+#include <iostream>
+#include <string>
+
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+
+#include "ll_protocol.hpp"
+#include "async_raw_server.hpp"
+#include "ethertype_dispatcher.hpp"
+
+using namespace asio::raw::ll;
+
+/**
+ * \brief Dispatcher for the protocols of this sample.
+ */
+typedef static_ethertype_dispatcher<ETH_P_IP, ETH_P_IPV6, ETH_P_ARP,
+        ETH_P_LLDP> dispatcher_type;
+
+/**
+ * \class ethertype_listener
+ * \brief IPv4, IPv6, ARP and LLDP listener on one ETH_P_ALL socket.
+ */
+class ethertype_listener : public async_raw_server
+{
+  public:
+    ethertype_listener(boost::asio::io_service& ios,
+        const std::string& ifname, const dispatcher_type& dispatcher)
+      : async_raw_server(ios, ifname, ETH_P_ALL),
+      m_dispatcher(dispatcher)
+    {
+      // kernel drops other ethertypes before queueing them
+      m_dispatcher.attach(socket());
+    }
+
+    /**
+     * \brief Receive callback.
+     * \param error error value.
+     * \param nb number of bytes transferred.
+     */
+    virtual void handle_recv(
+        const boost::system::error_code& error, size_t nb)
+    {
+      if(error && error != boost::asio::error::message_size)
+      {
+        std::cerr << "Error receiving: " << error << std::endl;
+        async_recv();
+        return;
+      }
+
+      m_dispatcher.dispatch(buffer().data(), nb);
+
+      // start again an asynchronous receive
+      async_recv();
+    }
+
+    /**
+     * \brief Send callback.
+     * \param error error value.
+     * \param nb number of bytes transferred.
+     */
+    virtual void handle_send(const boost::system::error_code& error,
+        size_t nb)
+    {
+      (void)error;
+      (void)nb;
+    }
+
+  private:
+    /**
+     * \brief Ethertype dispatcher.
+     */
+    const dispatcher_type& m_dispatcher;
+};
+
+/**
+ * \brief Prints a received frame.
+ * \param name protocol name.
+ * \param type ethertype.
+ * \param data frame.
+ * \param len frame length.
+ */
+static void print_frame(const std::string& name, uint16_t type,
+    const char* data, size_t len)
+{
+  (void)data;
+
+  std::cout << name << " frame received: type=0x" << std::hex << type
+    << std::dec << " len=" << len << std::endl;
+}
+
+/**
+ * \brief Signal handler.
+ * \param signum signal number.
+ */
+static void signal_handler(const boost::system::error_code& error, int signum,
+    boost::asio::io_service& ios)
+{
+  if(!error)
+  {
+    switch(signum)
+    {
+      case SIGINT:
+      case SIGTERM:
+        ios.stop();
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+/**
+ * \brief Entry point of the program.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+int main(int argc, char** argv)
+{
+  char* ifname = nullptr;
+  dispatcher_type dispatcher;
+
+  if(argc > 1)
+  {
+    ifname = argv[1];
+  }
+
+  dispatcher.set<ETH_P_IP>(boost::bind(print_frame, "IPv4", _1, _2, _3));
+  dispatcher.set<ETH_P_IPV6>(boost::bind(print_frame, "IPv6", _1, _2, _3));
+  dispatcher.set<ETH_P_ARP>(boost::bind(print_frame, "ARP", _1, _2, _3));
+  dispatcher.set<ETH_P_LLDP>(boost::bind(print_frame, "LLDP", _1, _2, _3));
+
+  try
+  {
+    boost::asio::io_service ios;
+    ethertype_listener server(ios, ifname ? ifname : "", dispatcher);
+
+    // signals handling
+    boost::asio::signal_set signals(ios, SIGINT, SIGTERM);
+    signals.async_wait(boost::bind(signal_handler, _1, _2,
+          boost::ref(ios)));
+
+    std::cout << "Raw socket running" << std::endl;
+    server.async_recv();
+
+    ios.run();
+  }
+  catch(std::exception& e)
+  {
+    std::cerr << "Error: " << e.what() << std::endl;
+  }
+
+  std::cout << "Exiting..." << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,183 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file l2_bridge.cpp
+ * \brief Inline bridge between two interfaces sample.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <cstdlib>
+
+#include <iostream>
+
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include "l2_forwarder.hpp"
+
+using namespace asio::raw::ll;
+
+/**
+ * \brief Ethertype dropped by the bridge, 0 for none.
+ */
+static uint16_t blocked_type = 0;
+
+/**
+ * \brief Inspector: drops frames of the blocked ethertype.
+ * \param dir direction of the frame.
+ * \param data frame.
+ * \param len frame length.
+ * \return verdict.
+ */
+static l2_forwarder::verdict inspect(l2_forwarder::direction dir,
+    char* data, size_t& len)
+{
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+
+  (void)dir;
+
+  if(len >= sizeof(struct ether_header) &&
+      (p[12] << 8 | p[13]) == blocked_type)
+  {
+    return l2_forwarder::drop;
+  }
+  return l2_forwarder::forward;
+}
+
+/**
+ * \brief Prints statistics of one direction.
+ * \param name direction name.
+ * \param s statistics.
+ */
+static void print_stats(const char* name, const l2_forwarder::statistics& s)
+{
+  std::cout << name << ": " << s.forwarded << " forwarded ("
+    << static_cast<uint64_t>(s.pps()) << " pps) " << s.dropped
+    << " dropped " << s.tx_dropped << " tx dropped " << s.truncated
+    << " truncated, latency mean " << s.mean_latency_ns() / 1000.0
+    << " us max " << s.latency_max_ns / 1000.0 << " us" << std::endl;
+}
+
+/**
+ * \brief Periodic report.
+ * \param error error value.
+ * \param timer report timer.
+ * \param fwd forwarder.
+ * \param ios Boost.Asio IO service, stopped if forwarding failed.
+ */
+static void report(const boost::system::error_code& error,
+    boost::asio::steady_timer& timer, l2_forwarder& fwd,
+    boost::asio::io_service& ios)
+{
+  if(error)
+  {
+    return;
+  }
+
+  print_stats("a->b", fwd.stats(l2_forwarder::a_to_b));
+  print_stats("b->a", fwd.stats(l2_forwarder::b_to_a));
+
+  if(fwd.error())
+  {
+    ios.stop();
+    return;
+  }
+
+  timer.expires_after(std::chrono::seconds(1));
+  timer.async_wait(boost::bind(report, boost::asio::placeholders::error,
+        boost::ref(timer), boost::ref(fwd), boost::ref(ios)));
+}
+
+/**
+ * \brief Signal handler.
+ * \param signum signal number.
+ */
+static void signal_handler(const boost::system::error_code& error, int signum,
+    boost::asio::io_service& ios)
+{
+  if(!error)
+  {
+    switch(signum)
+    {
+      case SIGINT:
+      case SIGTERM:
+        ios.stop();
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+/**
+ * \brief Entry point of the program.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+int main(int argc, char** argv)
+{
+  if(argc < 3)
+  {
+    std::cerr << "Usage: " << argv[0] << " ifname_a ifname_b "
+      "[blocked_ethertype]" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if(argc > 3)
+  {
+    blocked_type = static_cast<uint16_t>(strtoul(argv[3], nullptr, 0));
+  }
+
+  try
+  {
+    boost::asio::io_service ios;
+    l2_forwarder fwd(ios, argv[1], argv[2]);
+    boost::asio::steady_timer timer(ios);
+
+    // signals handling
+    boost::asio::signal_set signals(ios, SIGINT, SIGTERM);
+    signals.async_wait(boost::bind(signal_handler, _1, _2,
+          boost::ref(ios)));
+
+    if(blocked_type)
+    {
+      fwd.set_inspector(inspect);
+    }
+
+    fwd.start();
+    timer.expires_after(std::chrono::seconds(1));
+    timer.async_wait(boost::bind(report, boost::asio::placeholders::error,
+          boost::ref(timer), boost::ref(fwd), boost::ref(ios)));
+
+    std::cout << "Bridging " << argv[1] << " and " << argv[2] << std::endl;
+    ios.run();
+
+    fwd.stop();
+    print_stats("a->b", fwd.stats(l2_forwarder::a_to_b));
+    print_stats("b->a", fwd.stats(l2_forwarder::b_to_a));
+
+    if(fwd.error())
+    {
+      std::cerr << "Error forwarding: " << fwd.error().message()
+        << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  catch(std::exception& e)
+  {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Exiting..." << std::endl;
+  return EXIT_SUCCESS;
+}
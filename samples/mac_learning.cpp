@@ -0,0 +1,252 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file mac_learning.cpp
+ * \brief MAC learning table benchmark with concurrent switching threads.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <net/ethernet.h>
+
+#include "mac_table.hpp"
+
+using namespace asio::raw::ll;
+
+/**
+ * \brief Returns CLOCK_MONOTONIC time.
+ * \return time in nanoseconds.
+ */
+static double now_ns()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * \brief Writes the address of a station.
+ * \param mac address (6 bytes).
+ * \param station station number.
+ */
+static void station_mac(uint8_t* mac, uint32_t station)
+{
+  // locally administered unicast
+  mac[0] = 0x02;
+  mac[1] = 0x00;
+  mac[2] = static_cast<uint8_t>(station >> 24);
+  mac[3] = static_cast<uint8_t>(station >> 16);
+  mac[4] = static_cast<uint8_t>(station >> 8);
+  mac[5] = static_cast<uint8_t>(station);
+}
+
+/**
+ * \struct worker_result
+ * \brief Counters of one switching thread.
+ */
+struct worker_result
+{
+  /**
+   * \brief Frames switched.
+   */
+  uint64_t frames;
+
+  /**
+   * \brief Destinations found.
+   */
+  uint64_t hits;
+
+  /**
+   * \brief Destinations found on a wrong port.
+   */
+  uint64_t errors;
+};
+
+/**
+ * \brief Switching thread: learns source and looks up destination of
+ * frames received on its port.
+ * \param table MAC table.
+ * \param port port of the thread, stations with station % ports == port
+ * are behind it.
+ * \param ports number of ports.
+ * \param stations number of stations.
+ * \param now current time.
+ * \param running running flag.
+ * \param result counters.
+ */
+static void worker(mac_table& table, uint16_t port, uint16_t ports,
+    uint32_t stations, const std::atomic<uint32_t>& now,
+    const std::atomic<bool>& running, worker_result& result)
+{
+  uint32_t local = (stations + ports - 1 - port) / ports;
+  std::vector<struct ether_header> frames(local < 1024 ? 1024 : local);
+  uint32_t seed = 0x12345678 + port;
+
+  // frames as parsed from a receive buffer, every station behind this
+  // port sends to random stations
+  for(size_t i = 0 ; i < frames.size() ; i++)
+  {
+    uint32_t src = port + ports * static_cast<uint32_t>(i % local);
+    uint32_t dst = 0;
+
+    seed = seed * 1103515245 + 12345;
+    dst = (seed >> 8) % stations;
+
+    station_mac(frames[i].ether_shost, src);
+    station_mac(frames[i].ether_dhost, dst);
+    frames[i].ether_type = 0;
+  }
+
+  memset(&result, 0x00, sizeof(worker_result));
+
+  while(running.load(std::memory_order_relaxed))
+  {
+    uint32_t t = now.load(std::memory_order_relaxed);
+
+    for(size_t i = 0 ; i < frames.size() ; i++)
+    {
+      const struct ether_header* hdr = &frames[i];
+      uint16_t out = 0;
+
+      table.learn(hdr, port, t);
+
+      if(table.lookup(hdr, out))
+      {
+        uint32_t dst = static_cast<uint32_t>(
+            mac_table::key(hdr->ether_dhost) & 0xffffffff);
+
+        result.hits++;
+        if(out != dst % ports)
+        {
+          result.errors++;
+        }
+      }
+    }
+
+    result.frames += frames.size();
+  }
+}
+
+/**
+ * \brief Entry point of the program.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+int main(int argc, char** argv)
+{
+  uint16_t ports = 4;
+  uint32_t stations = 16384;
+  uint32_t seconds = 2;
+  const uint32_t max_age = 3;
+  std::atomic<uint32_t> now(0);
+  std::atomic<bool> running(true);
+  std::vector<std::thread> threads;
+  std::vector<worker_result> results;
+  uint64_t frames = 0;
+  uint64_t hits = 0;
+  uint64_t errors = 0;
+  size_t aged = 0;
+  double start = 0;
+  double elapsed = 0;
+
+  if(argc > 1)
+  {
+    ports = static_cast<uint16_t>(atoi(argv[1]));
+  }
+
+  if(argc > 2)
+  {
+    stations = static_cast<uint32_t>(atoi(argv[2]));
+  }
+
+  if(argc > 3)
+  {
+    seconds = static_cast<uint32_t>(atoi(argv[3]));
+  }
+
+  if(ports == 0 || stations < ports)
+  {
+    std::cerr << "Usage: " << argv[0] << " [threads] [stations] [seconds]"
+      << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  try
+  {
+    mac_table table(stations);
+
+    results.resize(ports);
+    start = now_ns();
+
+    for(uint16_t p = 0 ; p < ports ; p++)
+    {
+      threads.push_back(std::thread(worker, std::ref(table), p, ports,
+            stations, std::cref(now), std::cref(running),
+            std::ref(results[p])));
+    }
+
+    // time unit is 100 ms, one shard aged per tick
+    for(uint32_t tick = 0 ; tick < seconds * 10 ; tick++)
+    {
+      struct timespec ts = {0, 100000000};
+
+      nanosleep(&ts, nullptr);
+      now++;
+      aged += table.age_shard(tick, now, max_age);
+    }
+
+    running = false;
+    for(size_t i = 0 ; i < threads.size() ; i++)
+    {
+      threads[i].join();
+    }
+    elapsed = now_ns() - start;
+
+    for(size_t i = 0 ; i < results.size() ; i++)
+    {
+      frames += results[i].frames;
+      hits += results[i].hits;
+      errors += results[i].errors;
+    }
+
+    std::cout << ports << " threads, " << table.size() << " addresses in "
+      << table.shards() << " shards" << std::endl;
+    std::cout << frames * 1e3 / elapsed << " Mframes/s (learn + lookup), "
+      << (frames ? 100.0 * hits / frames : 0) << "% destinations known, "
+      << errors << " wrong ports, " << aged << " aged" << std::endl;
+
+    // no traffic any more: everything must age out
+    aged = table.age(now + max_age + 1, max_age);
+    std::cout << aged << " aged after traffic stopped, " << table.size()
+      << " left" << std::endl;
+
+    if(errors || table.size())
+    {
+      return EXIT_FAILURE;
+    }
+  }
+  catch(std::exception& e)
+  {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,201 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file pcap_capture.cpp
+ * \brief Rotating pcap capture to disk sample.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <cstdlib>
+
+#include <iostream>
+
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include "async_raw_server.hpp"
+#include "capture_writer.hpp"
+
+using namespace asio::raw::ll;
+
+/**
+ * \class pcap_capture
+ * \brief Writes every frame received on an interface to disk.
+ */
+class pcap_capture : public async_raw_server
+{
+  public:
+    /**
+     * \brief Constructor.
+     * \param ios Boost.Asio IO service.
+     * \param ifname interface.
+     * \param writer capture writer.
+     */
+    pcap_capture(boost::asio::io_service& ios, const std::string& ifname,
+        capture_writer& writer)
+      : async_raw_server(ios, ifname, ETH_P_ALL, socket_profile::capture()),
+      m_writer(writer)
+    {
+    }
+
+  protected:
+    /**
+     * \brief Receive callback.
+     * \param error error value.
+     * \param nb number of bytes transferred.
+     */
+    virtual void handle_recv(const boost::system::error_code& error,
+        size_t nb)
+    {
+      if(!error || error == boost::asio::error::message_size)
+      {
+        // never blocks, frame counted as dropped if the disk lags
+        m_writer.write(buffer().data(), nb);
+      }
+
+      async_recv();
+    }
+
+    /**
+     * \brief Send callback.
+     * \param error error value.
+     * \param nb number of bytes transferred.
+     */
+    virtual void handle_send(const boost::system::error_code& error,
+        size_t nb)
+    {
+      (void)error;
+      (void)nb;
+    }
+
+  private:
+    /**
+     * \brief Capture writer.
+     */
+    capture_writer& m_writer;
+};
+
+/**
+ * \brief Prints statistics.
+ * \param writer capture writer.
+ */
+static void print_stats(const capture_writer& writer)
+{
+  capture_writer::statistics s = writer.stats();
+
+  std::cout << s.frames << " frames " << s.bytes << " bytes " << s.dropped
+    << " dropped " << s.blocks << " blocks " << s.files << " files"
+    << std::endl;
+}
+
+/**
+ * \brief Periodic report.
+ * \param error error value.
+ * \param timer report timer.
+ * \param writer capture writer.
+ */
+static void report(const boost::system::error_code& error,
+    boost::asio::steady_timer& timer, capture_writer& writer)
+{
+  if(error)
+  {
+    return;
+  }
+
+  print_stats(writer);
+
+  timer.expires_after(std::chrono::seconds(1));
+  timer.async_wait(boost::bind(report, boost::asio::placeholders::error,
+        boost::ref(timer), boost::ref(writer)));
+}
+
+/**
+ * \brief Signal handler.
+ * \param signum signal number.
+ */
+static void signal_handler(const boost::system::error_code& error, int signum,
+    boost::asio::io_service& ios)
+{
+  if(!error)
+  {
+    switch(signum)
+    {
+      case SIGINT:
+      case SIGTERM:
+        ios.stop();
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+/**
+ * \brief Entry point of the program.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+int main(int argc, char** argv)
+{
+  uint64_t file_size = 1024 * 1024 * 1024;
+  size_t max_files = 0;
+
+  if(argc < 3)
+  {
+    std::cerr << "Usage: " << argv[0] << " ifname prefix [file_size_mb] "
+      "[max_files]" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if(argc > 3)
+  {
+    file_size = strtoull(argv[3], nullptr, 10) * 1024 * 1024;
+  }
+
+  if(argc > 4)
+  {
+    max_files = strtoul(argv[4], nullptr, 10);
+  }
+
+  try
+  {
+    boost::asio::io_service ios;
+    capture_writer writer(argv[2], file_size, max_files);
+    pcap_capture server(ios, argv[1], writer);
+    boost::asio::steady_timer timer(ios);
+
+    // signals handling
+    boost::asio::signal_set signals(ios, SIGINT, SIGTERM);
+    signals.async_wait(boost::bind(signal_handler, _1, _2,
+          boost::ref(ios)));
+
+    timer.expires_after(std::chrono::seconds(1));
+    timer.async_wait(boost::bind(report, boost::asio::placeholders::error,
+          boost::ref(timer), boost::ref(writer)));
+
+    std::cout << "Capturing " << argv[1] << " to " << writer.file_name(0)
+      << (writer.direct() ? " (O_DIRECT)" : " (buffered)") << std::endl;
+    server.async_recv();
+    ios.run();
+
+    writer.close();
+    print_stats(writer);
+  }
+  catch(std::exception& e)
+  {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Exiting..." << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,345 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file reassembly_bench.cpp
+ * \brief IP fragment reassembly check and benchmark.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <net/ethernet.h>
+#include <netinet/in.h>
+
+#include "checksum.hpp"
+#include "ip_reassembler.hpp"
+
+using namespace asio::raw::ll;
+
+/**
+ * \brief Fragment payload size at MTU 1500 (IPv4).
+ */
+static const size_t ipv4_fragment = 1480;
+
+/**
+ * \brief Fragment payload size at MTU 1500 (IPv6 with fragment header).
+ */
+static const size_t ipv6_fragment = 1448;
+
+/**
+ * \brief Returns CLOCK_MONOTONIC time.
+ * \return time in nanoseconds.
+ */
+static double now_ns()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * \brief Writes a big-endian 16-bit integer.
+ * \param p destination.
+ * \param v value.
+ */
+static void write16(char* p, size_t v)
+{
+  p[0] = static_cast<char>(v >> 8);
+  p[1] = static_cast<char>(v);
+}
+
+/**
+ * \brief Builds an unfragmented datagram, as the reassembler must rebuild
+ * it.
+ * \param v6 IPv6 instead of IPv4.
+ * \param id identification.
+ * \param payload_len payload length.
+ * \param rng random generator.
+ * \return datagram.
+ */
+static std::vector<char> make_datagram(bool v6, uint32_t id,
+    size_t payload_len, std::mt19937& rng)
+{
+  size_t hl = v6 ? 40 : 20;
+  std::vector<char> d(hl + payload_len);
+
+  for(size_t i = hl ; i < d.size() ; i++)
+  {
+    d[i] = static_cast<char>(rng());
+  }
+
+  if(v6)
+  {
+    d[0] = 0x60;
+    write16(&d[4], payload_len);
+    d[6] = IPPROTO_UDP;
+    d[7] = 64;
+    d[8] = 0x20;
+    d[9] = 0x01;
+    d[23] = 1;
+    d[24] = 0x20;
+    d[25] = 0x01;
+    d[39] = 2;
+  }
+  else
+  {
+    uint16_t csum = 0;
+
+    d[0] = 0x45;
+    write16(&d[2], d.size());
+    write16(&d[4], id & 0xffff);
+    d[8] = 64;
+    d[9] = IPPROTO_UDP;
+    d[12] = 10;
+    d[15] = 1;
+    d[16] = 10;
+    d[19] = 2;
+    csum = htons(checksum::compute(d.data(), hl));
+    memcpy(&d[10], &csum, sizeof(csum));
+  }
+
+  return d;
+}
+
+/**
+ * \brief Splits a datagram in Ethernet frames.
+ * \param d datagram.
+ * \param id identification.
+ * \param frames output frames.
+ */
+static void fragment(const std::vector<char>& d, uint32_t id,
+    std::vector<std::vector<char>>& frames)
+{
+  bool v6 = (d[0] >> 4) == 6;
+  size_t hl = v6 ? 40 : 20;
+  size_t step = v6 ? ipv6_fragment : ipv4_fragment;
+  size_t payload_len = d.size() - hl;
+
+  for(size_t off = 0 ; off < payload_len ; off += step)
+  {
+    size_t n = std::min(step, payload_len - off);
+    bool more = off + n < payload_len;
+    size_t fl = v6 ? hl + 8 : hl;
+    std::vector<char> f(sizeof(struct ether_header) + fl + n);
+    char* ip = &f[sizeof(struct ether_header)];
+
+    write16(&f[12], v6 ? ETH_P_IPV6 : ETH_P_IP);
+    memcpy(ip, d.data(), hl);
+    memcpy(ip + fl, d.data() + hl + off, n);
+
+    if(v6)
+    {
+      uint32_t nid = htonl(id);
+
+      write16(ip + 4, 8 + n);
+      ip[6] = static_cast<char>(IPPROTO_FRAGMENT);
+      ip[40] = IPPROTO_UDP;
+      write16(ip + 42, off | (more ? 1 : 0));
+      memcpy(ip + 44, &nid, sizeof(nid));
+    }
+    else
+    {
+      write16(ip + 2, hl + n);
+      write16(ip + 6, off / 8 | (more ? 0x2000 : 0));
+    }
+
+    frames.push_back(f);
+  }
+}
+
+/**
+ * \brief Entry point of the program.
+ * \return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+int main()
+{
+  const size_t count = 2000;
+  const size_t rounds = 20;
+  std::mt19937 rng(42);
+  std::vector<std::vector<char>> datagrams;
+  std::vector<std::vector<char>> frames;
+  std::vector<char> out(65536);
+  size_t matched = 0;
+  size_t mismatched = 0;
+  size_t bytes = 0;
+  uint64_t now = 1;
+  double start = 0;
+  double elapsed = 0;
+  int ret = EXIT_SUCCESS;
+
+  // interleaved datagrams of 2 to 7 fragments, fragments of each in
+  // random order
+  for(size_t i = 0 ; i < count ; i++)
+  {
+    std::vector<std::vector<char>> f;
+
+    datagrams.push_back(make_datagram(i & 1, static_cast<uint32_t>(i),
+          1500 + rng() % 7500, rng));
+    fragment(datagrams.back(), static_cast<uint32_t>(i), f);
+    std::shuffle(f.begin(), f.end(), rng);
+    frames.insert(frames.end(), f.begin(), f.end());
+  }
+  for(size_t i = 0 ; i + 8 < frames.size() ; i += 8)
+  {
+    std::shuffle(frames.begin() + i, frames.begin() + i + 8, rng);
+  }
+
+  {
+    ip_reassembler reasm;
+
+    reasm.set_handler([&](const ip_reassembler::datagram& d)
+    {
+      size_t n = d.copy(out.data(), out.size());
+      bool found = false;
+
+      // identification is in the payload for IPv6, search by content
+      for(size_t i = 0 ; i < datagrams.size() && !found ; i++)
+      {
+        found = datagrams[i].size() == n &&
+          memcmp(datagrams[i].data(), out.data(), n) == 0;
+      }
+
+      found ? matched++ : mismatched++;
+    });
+
+    for(const std::vector<char>& f : frames)
+    {
+      reasm.add_frame(f.data(), f.size(), now);
+    }
+
+    if(matched != count || mismatched || reasm.pending() ||
+        reasm.stats().dropped)
+    {
+      std::cerr << "Reassembly failed: " << matched << "/" << count
+        << " matched, " << mismatched << " mismatched" << std::endl;
+      ret = EXIT_FAILURE;
+    }
+
+    // overlapping fragment discards the datagram
+    {
+      std::vector<std::vector<char>> f;
+      uint64_t delivered = reasm.stats().datagrams;
+
+      fragment(make_datagram(false, 7777, 4000, rng), 7777, f);
+      write16(&f[1][sizeof(struct ether_header) + 6],
+          (ipv4_fragment - 8) / 8 | 0x2000);
+      reasm.add_frame(f[0].data(), f[0].size(), now);
+      reasm.add_frame(f[2].data(), f[2].size(), now);
+      reasm.add_frame(f[1].data(), f[1].size(), now);
+
+      if(reasm.stats().datagrams != delivered || reasm.pending())
+      {
+        std::cerr << "Overlap not detected" << std::endl;
+        ret = EXIT_FAILURE;
+      }
+    }
+
+    // largest datagram whose first fragment carries 40 bytes of options:
+    // the rebuilt datagram would exceed 65535 bytes
+    {
+      std::vector<std::vector<char>> f;
+      uint64_t delivered = reasm.stats().datagrams;
+      uint64_t dropped = reasm.stats().dropped;
+      size_t eh = sizeof(struct ether_header);
+
+      fragment(make_datagram(false, 8888, 65515, rng), 8888, f);
+      f[0].insert(f[0].begin() + eh + 20, 40, 0x01);
+      f[0][eh] = 0x4f;
+      write16(&f[0][eh + 2], f[0].size() - eh);
+      for(const std::vector<char>& frame : f)
+      {
+        reasm.add_frame(frame.data(), frame.size(), now);
+      }
+
+      if(reasm.stats().datagrams != delivered ||
+          reasm.stats().dropped != dropped + 1 || reasm.pending())
+      {
+        std::cerr << "Oversized datagram not detected" << std::endl;
+        ret = EXIT_FAILURE;
+      }
+    }
+  }
+
+  // throughput: handler only touches the views
+  {
+    ip_reassembler reasm;
+
+    reasm.set_handler([&](const ip_reassembler::datagram& d)
+    {
+      bytes += d.len;
+    });
+
+    start = now_ns();
+    for(size_t r = 0 ; r < rounds ; r++)
+    {
+      for(const std::vector<char>& f : frames)
+      {
+        reasm.add_frame(f.data(), f.size(), now);
+      }
+    }
+    elapsed = now_ns() - start;
+
+    std::cout << "reassembly: " << std::fixed << std::setprecision(1)
+      << elapsed / (rounds * frames.size()) << " ns/fragment, "
+      << rounds * frames.size() * 1e3 / elapsed << " Mfragments/s, "
+      << bytes * 8 / elapsed << " Gbit/s" << std::endl;
+  }
+
+  // flood of first fragments never completed: memory stays bounded
+  {
+    ip_reassembler reasm(256, 1024);
+    std::vector<std::vector<char>> f;
+    size_t min_free = 1024;
+
+    fragment(make_datagram(false, 0, 4000, rng), 0, f);
+    start = now_ns();
+    for(uint32_t id = 0 ; id < 1000000 ; id++)
+    {
+      write16(&f[0][sizeof(struct ether_header) + 4], id & 0xffff);
+      f[0][sizeof(struct ether_header) + 12] = static_cast<char>(id >> 16);
+      reasm.add_frame(f[0].data(), f[0].size(), now);
+      min_free = std::min(min_free, reasm.free_buffers());
+    }
+    elapsed = now_ns() - start;
+
+    std::cout << "flood: " << elapsed / 1000000 << " ns/fragment, "
+      << reasm.stats().evicted << " evicted, " << reasm.pending()
+      << " pending, " << min_free << " buffers free at worst"
+      << std::endl;
+
+    if(reasm.pending() > 256 || reasm.stats().evicted < 1000000 - 256)
+    {
+      std::cerr << "Flood not contained" << std::endl;
+      ret = EXIT_FAILURE;
+    }
+
+    // incomplete datagrams expire
+    now += 31000000000ULL;
+    reasm.expire(now);
+    if(reasm.pending() || reasm.stats().timeouts != 256 ||
+        reasm.free_buffers() != 1024)
+    {
+      std::cerr << "Timeout failed" << std::endl;
+      ret = EXIT_FAILURE;
+    }
+  }
+
+  return ret;
+}
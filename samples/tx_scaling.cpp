@@ -0,0 +1,331 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file tx_scaling.cpp
+ * \brief Multi-socket transmit engine scaling and ordering check.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <atomic>
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "tx_engine.hpp"
+
+using namespace asio::raw::ll;
+
+/**
+ * \brief Frame size without FCS (64 bytes on the wire).
+ */
+static const size_t frame_size = 60;
+
+/**
+ * \brief Number of UDP flows.
+ */
+static const size_t flows = 1024;
+
+/**
+ * \brief UDP destination port of test frames.
+ */
+static const uint16_t test_port = 9;
+
+/**
+ * \brief Returns CLOCK_MONOTONIC time.
+ * \return time in nanoseconds.
+ */
+static double now_ns()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * \brief Writes a big-endian 16-bit integer.
+ * \param p destination.
+ * \param v value.
+ */
+static void write16(char* p, uint16_t v)
+{
+  p[0] = static_cast<char>(v >> 8);
+  p[1] = static_cast<char>(v);
+}
+
+/**
+ * \brief Builds the IPv4/UDP frame of a flow, sequence set by send_flow().
+ * \param frame destination, frame_size bytes.
+ * \param flow flow index, also UDP source port.
+ */
+static void build_frame(char* frame, uint32_t flow)
+{
+  static const char macs[12] = {
+    0x02, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x00, 0x00, 0x00, 0x00, 0x02
+  };
+  char* ip = frame + 14;
+  char* udp = ip + 20;
+
+  memset(frame, 0x00, frame_size);
+  memcpy(frame, macs, sizeof(macs));
+  write16(frame + 12, 0x0800);
+
+  ip[0] = 0x45;
+  write16(ip + 2, static_cast<uint16_t>(frame_size - 14));
+  ip[8] = 64;
+  ip[9] = 17;
+  ip[12] = 10;
+  ip[15] = 1;
+  ip[16] = 10;
+  ip[19] = 2;
+
+  write16(udp, static_cast<uint16_t>(1024 + flow));
+  write16(udp + 2, test_port);
+  write16(udp + 4, static_cast<uint16_t>(frame_size - 34));
+  memcpy(udp + 8, &flow, sizeof(flow));
+}
+
+/**
+ * \brief Receives test frames and checks per-flow order.
+ * \param fd packet socket.
+ * \param stop stop flag.
+ * \param received number of test frames received.
+ * \param reordered number of frames older than their flow's last one.
+ */
+static void check_order(int fd, const std::atomic<bool>& stop,
+    size_t& received, size_t& reordered)
+{
+  std::vector<uint32_t> last(flows, 0);
+  char buf[2048];
+
+  for(;;)
+  {
+    ssize_t nb = recv(fd, buf, sizeof(buf), 0);
+    uint32_t flow = 0;
+    uint32_t seq = 0;
+
+    if(nb < 0)
+    {
+      // timeout: done once the sender is done
+      if(stop)
+      {
+        break;
+      }
+      continue;
+    }
+
+    if(static_cast<size_t>(nb) < frame_size || buf[23] != 17 ||
+        buf[36] != 0 || buf[37] != test_port)
+    {
+      continue;
+    }
+
+    memcpy(&flow, buf + 42, sizeof(flow));
+    memcpy(&seq, buf + 46, sizeof(seq));
+    if(flow >= flows)
+    {
+      continue;
+    }
+
+    received++;
+    // drops are fine, going back is not
+    if(seq <= last[flow])
+    {
+      reordered++;
+    }
+    last[flow] = seq;
+  }
+}
+
+/**
+ * \brief Entry point of the program.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+int main(int argc, char** argv)
+{
+  std::vector<char> frames(flows * frame_size);
+  std::vector<uint32_t> seqs(flows, 0);
+  std::vector<int> cpus;
+  size_t max_lanes = 4;
+  double seconds = 2;
+  const char* peer = nullptr;
+  double base = 0;
+  int ret = EXIT_SUCCESS;
+
+  if(argc < 2)
+  {
+    std::cout << "Usage: " << argv[0]
+      << " ifname [max_lanes] [seconds] [peer_ifname]" << std::endl;
+    std::cout << "peer_ifname receives the frames (i.e. other end of a "
+      << "veth pair) to check per-flow order" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if(argc > 2)
+  {
+    max_lanes = strtoul(argv[2], nullptr, 10);
+  }
+
+  if(argc > 3)
+  {
+    seconds = strtod(argv[3], nullptr);
+  }
+
+  if(argc > 4)
+  {
+    peer = argv[4];
+  }
+
+  for(uint32_t i = 0 ; i < flows ; i++)
+  {
+    build_frame(frames.data() + i * frame_size, i);
+  }
+
+  for(unsigned int i = 0 ; i < std::thread::hardware_concurrency() ; i++)
+  {
+    cpus.push_back(static_cast<int>(i));
+  }
+
+  std::cout << std::thread::hardware_concurrency() << " CPU(s), "
+    << frame_size + 4 << " bytes frames, " << flows << " flows"
+    << std::endl;
+
+  try
+  {
+    boost::asio::io_service ios;
+
+    // one producer thread, lanes doubling up to max_lanes, with and
+    // without qdisc bypass
+    for(size_t bypass = 0 ; bypass < 2 ; bypass++)
+    {
+      for(size_t lanes = 1 ; lanes <= max_lanes ; lanes *= 2)
+      {
+        tx_engine tx(ios, argv[1], lanes,
+            socket_profile::generator().set_qdisc_bypass(bypass != 0));
+        std::vector<size_t> lane_of(flows);
+        double start = 0;
+        double elapsed = 0;
+        double mpps = 0;
+        size_t i = 0;
+
+        for(size_t f = 0 ; f < flows ; f++)
+        {
+          lane_of[f] = tx.lane(frames.data() + f * frame_size, frame_size);
+        }
+
+        tx.set_affinity(cpus);
+        tx.start();
+        start = now_ns();
+        while(now_ns() - start < seconds * 1e9)
+        {
+          for(size_t n = 0 ; n < 256 ; n++, i++)
+          {
+            size_t f = i % flows;
+
+            while(!tx.send(lane_of[f], frames.data() + f * frame_size,
+                  frame_size))
+            {
+              std::this_thread::yield();
+            }
+          }
+        }
+        tx.stop();
+        elapsed = now_ns() - start;
+
+        tx_engine::statistics s = tx.stats();
+
+        mpps = s.frames * 1e3 / elapsed;
+        if(lanes == 1)
+        {
+          base = mpps;
+        }
+
+        std::cout << "qdisc bypass " << (bypass ? "on " : "off") << " "
+          << std::setw(2) << lanes << " lane(s): " << std::fixed
+          << std::setprecision(3) << mpps << " Mpps ("
+          << std::setprecision(2) << mpps / base << "x), "
+          << s.frames / (s.batches ? s.batches : 1) << " frames/batch, "
+          << s.retries << " retries, " << s.errors << " errors"
+          << std::endl;
+
+        if(s.frames != i || s.errors)
+        {
+          std::cerr << "Frames lost: " << i << " queued, " << s.frames
+            << " sent" << std::endl;
+          ret = EXIT_FAILURE;
+        }
+      }
+    }
+
+    if(peer)
+    {
+      ll_protocol::endpoint rx_endpoint(peer, ETH_P_IP);
+      ll_protocol::socket rx(ios, rx_endpoint);
+      tx_engine tx(ios, argv[1], max_lanes);
+      std::atomic<bool> stop(false);
+      struct timeval tv = {0, 200000};
+      size_t received = 0;
+      size_t reordered = 0;
+      std::thread checker;
+
+      socket_profile::capture().apply(rx, rx_endpoint);
+      setsockopt(rx.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &tv,
+          sizeof(tv));
+
+      checker = std::thread(check_order, rx.native_handle(),
+          std::cref(stop), std::ref(received), std::ref(reordered));
+
+      tx.set_affinity(cpus);
+      tx.start();
+      for(size_t i = 0 ; i < 200000 ; i++)
+      {
+        size_t f = i % flows;
+        char* frame = frames.data() + f * frame_size;
+
+        seqs[f]++;
+        memcpy(frame + 46, &seqs[f], sizeof(uint32_t));
+        while(!tx.send(frame, frame_size))
+        {
+          std::this_thread::yield();
+        }
+      }
+      tx.stop();
+      stop = true;
+      checker.join();
+
+      std::cout << "order check on " << peer << ": " << received
+        << " frames received, " << reordered << " out of order"
+        << std::endl;
+
+      if(received == 0 || reordered)
+      {
+        std::cerr << "Per-flow order not kept" << std::endl;
+        ret = EXIT_FAILURE;
+      }
+    }
+  }
+  catch(std::exception& e)
+  {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return ret;
+}
@@ -0,0 +1,209 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file uring_listener.cpp
+ * \brief Asynchronous listener on io_uring backend sample.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <cstdlib>
+#include <cstring>
+
+#include <iostream>
+
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include "ll_protocol.hpp"
+#include "async_uring_server.hpp"
+
+using namespace asio::raw::ll;
+
+/**
+ * \class uring_listener
+ * \brief Counts received frames and reports backend efficiency.
+ */
+class uring_listener : public async_uring_server
+{
+  public:
+    uring_listener(boost::asio::io_service& ios, const std::string& ifname)
+      : async_uring_server(ios, ifname, ETH_P_ALL, 1024),
+      m_timer(ios),
+      m_bytes(0)
+    {
+      memset(&m_last, 0x00, sizeof(statistics));
+    }
+
+    /**
+     * \brief Starts periodic report.
+     */
+    void start_report()
+    {
+      m_timer.expires_after(std::chrono::seconds(1));
+      m_timer.async_wait(boost::bind(&uring_listener::report, this,
+            boost::asio::placeholders::error));
+    }
+
+    /**
+     * \brief Receive callback.
+     * \param error error value.
+     * \param nb number of bytes transferred.
+     */
+    virtual void handle_recv(
+        const boost::system::error_code& error, size_t nb)
+    {
+      if(error && error != boost::asio::error::message_size)
+      {
+        std::cerr << "Error receiving: " << error << std::endl;
+      }
+
+      m_bytes += nb;
+
+      // start again an asynchronous receive
+      async_recv();
+    }
+
+    /**
+     * \brief Send callback.
+     * \param error error value.
+     * \param nb number of bytes transferred.
+     */
+    virtual void handle_send(const boost::system::error_code& error,
+        size_t nb)
+    {
+      if(error)
+      {
+        std::cerr << "Error sending packet: " << error << std::endl;
+        return;
+      }
+
+      std::cout << "Send packet of " << nb << " bytes" << std::endl;
+    }
+
+  private:
+    /**
+     * \brief Prints counters of the last second.
+     * \param error error value.
+     */
+    void report(const boost::system::error_code& error)
+    {
+      const statistics& s = stats();
+      uint64_t frames = s.frames - m_last.frames;
+      uint64_t wakeups = s.wakeups - m_last.wakeups;
+      uint64_t submits = s.submits - m_last.submits;
+      uint64_t no_buffers = s.no_buffers - m_last.no_buffers;
+
+      if(error)
+      {
+        return;
+      }
+
+      std::cout << frames << " frames/s " << m_bytes << " bytes/s, "
+        << wakeups << " wakeups " << submits << " submits " << no_buffers
+        << " out of buffers";
+      if(frames)
+      {
+        std::cout << " (" << static_cast<double>(wakeups + submits) /
+          static_cast<double>(frames) << " per frame)";
+      }
+      std::cout << std::endl;
+
+      m_last = s;
+      m_bytes = 0;
+      start_report();
+    }
+
+    /**
+     * \brief Report timer.
+     */
+    boost::asio::steady_timer m_timer;
+
+    /**
+     * \brief Bytes received since last report.
+     */
+    uint64_t m_bytes;
+
+    /**
+     * \brief Counters at last report.
+     */
+    statistics m_last;
+};
+
+/**
+ * \brief Signal handler.
+ * \param signum signal number.
+ */
+static void signal_handler(const boost::system::error_code& error, int signum,
+    boost::asio::io_service& ios)
+{
+  if(!error)
+  {
+    switch(signum)
+    {
+      case SIGINT:
+      case SIGTERM:
+        ios.stop();
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+/**
+ * \brief Entry point of the program.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+int main(int argc, char** argv)
+{
+  char* ifname = nullptr;
+
+  if(argc > 1)
+  {
+    ifname = argv[1];
+  }
+
+  try
+  {
+    boost::asio::io_service ios;
+    uring_listener server(ios, ifname ? ifname : "");
+
+    // signals handling
+    boost::asio::signal_set signals(ios, SIGINT, SIGTERM);
+    signals.async_wait(boost::bind(signal_handler, _1, _2,
+          boost::ref(ios)));
+
+    std::cout << "Raw socket running ("
+      << (server.uring_enabled() ? "io_uring" : "reactor") << ")"
+      << std::endl;
+    server.async_recv();
+    server.start_report();
+
+    /* send invalid packet */
+    {
+      char buf[14] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+        0x09, 0x0A, 0x0B, static_cast<char>(0x86), static_cast<char>(0xDD)};
+
+      server.async_send(buf, sizeof(buf));
+    }
+
+    ios.run();
+  }
+  catch(std::exception& e)
+  {
+    std::cerr << "Error: " << e.what() << std::endl;
+  }
+
+  std::cout << "Exiting..." << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,177 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file vlan_listener.cpp
+ * \brief Asynchronous per-VLAN listener sample.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <cstdlib>
+
+#include <iostream>
+
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+
+#include "ll_protocol.hpp"
+#include "async_raw_server.hpp"
+#include "vlan_dispatcher.hpp"
+
+using namespace asio::raw::ll;
+
+/**
+ * \class vlan_listener
+ * \brief Dispatches received frames per VLAN.
+ */
+class vlan_listener : public async_raw_server
+{
+  public:
+    vlan_listener(boost::asio::io_service& ios, const std::string& ifname,
+        const vlan_dispatcher& dispatcher)
+      : async_raw_server(ios, ifname, ETH_P_ALL),
+      m_dispatcher(dispatcher)
+    {
+      // recover tags stripped by the NIC (rx-vlan-offload)
+      set_auxdata(true);
+    }
+
+    /**
+     * \brief Receive callback.
+     * \param error error value.
+     * \param nb number of bytes transferred.
+     */
+    virtual void handle_recv(
+        const boost::system::error_code& error, size_t nb)
+    {
+      if(error && error != boost::asio::error::message_size)
+      {
+        std::cerr << "Error receiving: " << error << std::endl;
+        async_recv();
+        return;
+      }
+
+      if(nb >= sizeof(struct ether_header))
+      {
+        m_dispatcher.dispatch(vlan(), buffer().data(), nb);
+      }
+
+      // start again an asynchronous receive
+      async_recv();
+    }
+
+    /**
+     * \brief Send callback.
+     * \param error error value.
+     * \param nb number of bytes transferred.
+     */
+    virtual void handle_send(const boost::system::error_code& error,
+        size_t nb)
+    {
+      (void)error;
+      (void)nb;
+    }
+
+  private:
+    /**
+     * \brief VLAN dispatcher.
+     */
+    const vlan_dispatcher& m_dispatcher;
+};
+
+/**
+ * \brief Prints a frame received on a VLAN.
+ * \param name handler name.
+ * \param tag VLAN tag.
+ * \param data frame.
+ * \param len frame length.
+ */
+static void print_frame(const std::string& name, const vlan_tag& tag,
+    const char* data, size_t len)
+{
+  const struct ether_header* hdr =
+    reinterpret_cast<const struct ether_header*>(data);
+
+  std::cout << name << ": vid=" << tag.vid() << " pcp="
+    << static_cast<uint32_t>(tag.pcp()) << " tpid=0x" << std::hex
+    << tag.tpid << " type=0x" << ntohs(hdr->ether_type) << std::dec
+    << " len=" << len << std::endl;
+}
+
+/**
+ * \brief Signal handler.
+ * \param signum signal number.
+ */
+static void signal_handler(const boost::system::error_code& error, int signum,
+    boost::asio::io_service& ios)
+{
+  if(!error)
+  {
+    switch(signum)
+    {
+      case SIGINT:
+      case SIGTERM:
+        ios.stop();
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+/**
+ * \brief Entry point of the program.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+int main(int argc, char** argv)
+{
+  vlan_dispatcher dispatcher;
+
+  if(argc < 2)
+  {
+    std::cerr << "Usage: " << argv[0] << " ifname [vid...]" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  try
+  {
+    for(int i = 2 ; i < argc ; i++)
+    {
+      std::string name = std::string("vlan ") + argv[i];
+
+      dispatcher.add(static_cast<uint16_t>(atoi(argv[i])),
+          boost::bind(print_frame, name, _1, _2, _3));
+    }
+
+    dispatcher.set_default(boost::bind(print_frame, "other vlan", _1, _2,
+          _3));
+
+    boost::asio::io_service ios;
+    vlan_listener server(ios, argv[1], dispatcher);
+
+    // signals handling
+    boost::asio::signal_set signals(ios, SIGINT, SIGTERM);
+    signals.async_wait(boost::bind(signal_handler, _1, _2,
+          boost::ref(ios)));
+
+    std::cout << "Raw socket running" << std::endl;
+    server.async_recv();
+
+    ios.run();
+  }
+  catch(std::exception& e)
+  {
+    std::cerr << "Error: " << e.what() << std::endl;
+  }
+
+  std::cout << "Exiting..." << std::endl;
+  return EXIT_SUCCESS;
+}
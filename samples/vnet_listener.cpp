@@ -0,0 +1,157 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file vnet_listener.cpp
+ * \brief Asynchronous GRO super-frame listener sample.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <cstdlib>
+
+#include <iostream>
+
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+
+#include "ll_protocol.hpp"
+#include "async_vnet_server.hpp"
+
+using namespace asio::raw::ll;
+
+/**
+ * \class vnet_listener
+ * \brief Super-frame listener.
+ */
+class vnet_listener : public async_vnet_server
+{
+  public:
+    vnet_listener(boost::asio::io_service& ios, const std::string& ifname,
+        int protocol = ETH_P_ALL)
+      : async_vnet_server(ios, ifname, protocol)
+    {
+    }
+
+    /**
+     * \brief Receive callback.
+     * \param error error value.
+     * \param nb number of bytes transferred.
+     */
+    virtual void handle_recv(
+        const boost::system::error_code& error, size_t nb)
+    {
+      const struct ether_header* hdr = nullptr;
+
+      if(error && error != boost::asio::error::message_size)
+      {
+        std::cerr << "Error receiving: " << error << std::endl;
+        async_recv();
+        return;
+      }
+
+      if(nb < sizeof(struct ether_header))
+      {
+        // data too small
+        async_recv();
+        return;
+      }
+
+      hdr = reinterpret_cast<const struct ether_header*>(buffer().data());
+
+      std::cout << "Frame received: type=0x" << std::hex
+        << ntohs(hdr->ether_type) << std::dec << " "
+        << "len=" << nb << " "
+        << "gso_type=" << static_cast<uint32_t>(gso().gso_type) << " "
+        << "gso_size=" << gso().gso_size << " "
+        << "segments=" << gso().segments(nb) << " "
+        << "csum=" << (gso().needs_csum ? "partial" :
+            gso().data_valid ? "valid" : "none")
+        << std::endl;
+
+      // start again an asynchronous receive
+      async_recv();
+    }
+
+    /**
+     * \brief Send callback.
+     * \param error error value.
+     * \param nb number of bytes transferred.
+     */
+    virtual void handle_send(const boost::system::error_code& error,
+        size_t nb)
+    {
+      if(error)
+      {
+        std::cerr << "Error sending packet: " << error << std::endl;
+        return;
+      }
+
+      std::cout << "Send super-frame of " << nb << " bytes" << std::endl;
+    }
+};
+
+/**
+ * \brief Signal handler.
+ * \param signum signal number.
+ */
+static void signal_handler(const boost::system::error_code& error, int signum,
+    boost::asio::io_service& ios)
+{
+  if(!error)
+  {
+    switch(signum)
+    {
+      case SIGINT:
+      case SIGTERM:
+        ios.stop();
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+/**
+ * \brief Entry point of the program.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+int main(int argc, char** argv)
+{
+  char* ifname = nullptr;
+
+  if(argc > 1)
+  {
+    ifname = argv[1];
+  }
+
+  try
+  {
+    boost::asio::io_service ios;
+    vnet_listener server(ios, ifname ? ifname : "", ETH_P_ALL);
+
+    // signals handling
+    boost::asio::signal_set signals(ios, SIGINT, SIGTERM);
+    signals.async_wait(boost::bind(signal_handler, _1, _2,
+          boost::ref(ios)));
+
+    std::cout << "Raw socket running" << std::endl;
+    server.async_recv();
+
+    ios.run();
+  }
+  catch(std::exception& e)
+  {
+    std::cerr << "Error: " << e.what() << std::endl;
+  }
+
+  std::cout << "Exiting..." << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,217 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file xdp_listener.cpp
+ * \brief Asynchronous AF_XDP listener sample.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <cstdlib>
+#include <cstring>
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+
+#include <arpa/inet.h>
+
+#include "ll_protocol.hpp"
+#include "async_xdp_server.hpp"
+
+using namespace asio::raw::ll;
+
+/**
+ * \class xdp_listener
+ * \brief Ethernet frame listener on an AF_XDP socket.
+ */
+class xdp_listener : public async_xdp_server
+{
+  public:
+    xdp_listener(boost::asio::io_service& ios, const std::string& ifname,
+        int protocol = ETH_P_ALL, uint32_t queue_id = 0)
+      : async_xdp_server(ios, ifname, protocol, queue_id)
+    {
+    }
+
+    /**
+     * \brief Receive callback.
+     * \param error error value.
+     * \param nb number of bytes transferred.
+     */
+    virtual void handle_recv(
+        const boost::system::error_code& error, size_t nb)
+    {
+      const struct ether_header* hdr = nullptr;
+
+      if(error)
+      {
+        std::cerr << "Error receiving: " << error << std::endl;
+        return;
+      }
+
+      if(nb < sizeof(struct ether_header))
+      {
+        // data too small
+        async_recv();
+        return;
+      }
+
+      // frame is read in place from the UMEM
+      hdr = reinterpret_cast<const struct ether_header*>(buffer());
+
+      // print out ethernet header information
+      std::cout << "Packet received: type=0x" << std::hex
+        << ntohs(hdr->ether_type) << std::dec << " "
+        << "dst_addr="
+        << eth_ntop(hdr->ether_dhost) << " "
+        << "src_addr="
+        << eth_ntop(hdr->ether_shost) << " "
+        << "len=" << nb
+        << std::endl;
+
+      // start again an asynchronous receive
+      async_recv();
+    }
+
+    /**
+     * \brief Send callback.
+     * \param error error value.
+     * \param nb number of bytes transferred.
+     */
+    virtual void handle_send(const boost::system::error_code& error,
+        size_t nb)
+    {
+      if(error)
+      {
+        std::cerr << "Error sending packet: " << error << std::endl;
+        return;
+      }
+
+      std::cout << "Send packet of " << nb << " bytes" << std::endl;
+    }
+
+  private:
+    /**
+     * \brief Converts ethernet address to human-readable form.
+     * \param src binary ethernet address.
+     * \return std::string containing human-readable form.
+     */
+    static std::string eth_ntop(const void* src)
+    {
+      const uint8_t* s = reinterpret_cast<const uint8_t*>(src);
+      std::ostringstream oss;
+
+      oss << std::setw(2) << std::setfill('0') << std::hex
+        << static_cast<uint32_t>(s[0]);
+      for(size_t i = 1 ; i < ETH_ALEN ; i++)
+      {
+        oss << ":" << std::setw(2) << std::setfill('0') << std::hex
+          << static_cast<uint32_t>(s[i]);
+      }
+
+      return oss.str();
+    }
+};
+
+/**
+ * \brief Signal handler.
+ * \param signum signal number.
+ */
+static void signal_handler(const boost::system::error_code& error, int signum,
+    boost::asio::io_service& ios)
+{
+  if(!error)
+  {
+    switch(signum)
+    {
+      case SIGINT:
+      case SIGTERM:
+        ios.stop();
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+/**
+ * \brief Entry point of the program.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+int main(int argc, char** argv)
+{
+  int protocol = ETH_P_ALL;
+  uint32_t queue_id = 0;
+
+  if(argc < 2)
+  {
+    std::cerr << "Usage: " << argv[0] << " ifname [ethertype] [queue]"
+      << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if(argc > 2)
+  {
+    protocol = static_cast<int>(strtol(argv[2], nullptr, 0));
+  }
+
+  if(argc > 3)
+  {
+    queue_id = static_cast<uint32_t>(strtoul(argv[3], nullptr, 0));
+  }
+
+  try
+  {
+    boost::asio::io_service ios;
+    xdp_listener server(ios, argv[1], protocol, queue_id);
+
+    // signals handling
+    boost::asio::signal_set signals(ios, SIGINT, SIGTERM);
+    signals.async_wait(boost::bind(signal_handler, _1, _2,
+          boost::ref(ios)));
+
+    std::cout << "XDP socket running ("
+      << (server.zero_copy() ? "zero-copy" : "copy") << " mode)"
+      << std::endl;
+    server.async_recv();
+
+    /* send invalid packet */
+    {
+      char buf[14] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+        0x09, 0x0A, 0x0B, static_cast<char>(0x86), static_cast<char>(0xDD)};
+
+      server.async_send(buf, sizeof(buf));
+    }
+
+    ios.run();
+
+    {
+      struct xdp_statistics stats = server.xdp_stats();
+
+      std::cout << "Dropped: " << stats.rx_dropped << " invalid: "
+        << stats.rx_invalid_descs << " RX ring full: "
+        << stats.rx_ring_full << " fill ring empty: "
+        << stats.rx_fill_ring_empty_descs << std::endl;
+    }
+  }
+  catch(std::exception& e)
+  {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Exiting..." << std::endl;
+  return EXIT_SUCCESS;
+}
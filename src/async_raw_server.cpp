@@ -5,8 +5,13 @@
  * \date 2017
  */
 
+#include <cerrno>
+#include <cstring>
+
 #include <memory>
 
+#include <sys/socket.h>
+
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 
@@ -19,55 +24,193 @@ namespace asio
     namespace ll
     {
       async_raw_server::async_raw_server(boost::asio::io_service& ios,
-          const std::string& ifname, int protocol)
-        : m_endpoint(ifname, protocol),
-        m_socket(ios, m_endpoint)
+          const std::string& ifname, int protocol,
+          const socket_profile& profile)
+        : m_auxdata(false),
+        m_dedup(nullptr),
+        m_endpoint(ifname, protocol),
+        m_socket(ios, m_endpoint),
+        m_send_pool(send_slots, send_slot_size)
+      {
+        profile.apply(m_socket, m_endpoint);
+      }
+
+      async_raw_server::async_raw_server(boost::asio::io_service& ios,
+          int fd, int protocol)
+        : m_auxdata(false),
+        m_dedup(nullptr),
+        m_endpoint(protocol),
+        m_socket(ios, ll_protocol(protocol), fd),
+        m_send_pool(send_slots, send_slot_size)
       {
       }
 
       void async_raw_server::async_recv()
       {
-        asio::raw::ll::ll_protocol::endpoint remote;
+        if(m_auxdata)
+        {
+          // Boost.Asio receive does not expose control messages
+          m_socket.async_wait(ll_protocol::socket::wait_read,
+              make_allocating_handler(m_recv_memory,
+                boost::bind(&async_raw_server::handle_readable, this,
+                  boost::asio::placeholders::error)));
+          return;
+        }
 
-        m_socket.async_receive_from(boost::asio::buffer(m_buffer), remote,
-            boost::bind(&async_raw_server::handle_recv, this,
-              boost::asio::placeholders::error,
-              boost::asio::placeholders::bytes_transferred));
+        m_socket.async_receive_from(boost::asio::buffer(m_buffer), m_remote,
+            make_allocating_handler(m_recv_memory,
+              boost::bind(&async_raw_server::deliver, this,
+                boost::asio::placeholders::error,
+                boost::asio::placeholders::bytes_transferred)));
       }
 
       void async_raw_server::async_send(const std::vector<char>& data)
       {
-        asio::raw::ll::ll_protocol::endpoint remote;
-        const struct ether_header* hdr =
-          reinterpret_cast<const struct ether_header*>(data.data());
-        struct sockaddr_ll addr = *reinterpret_cast<struct sockaddr_ll*>(
-            m_endpoint.data());
+        async_send(data.data(), data.size());
+      }
+
+      void async_raw_server::async_send(const char* data, size_t data_len)
+      {
+        uint32_t slot = 0;
+        char* buf = m_send_pool.acquire(data_len, slot);
 
-        addr.sll_halen = ETH_ALEN;
-        memcpy(&addr.sll_addr, hdr->ether_dhost, ETH_ALEN);
+        // socket is bound to the interface and the frame carries the
+        // link-layer header: no destination address needed
+        if(buf)
+        {
+          memcpy(buf, data, data_len);
 
-        remote = asio::raw::ll::ll_protocol::endpoint(addr);
+          m_socket.async_send(boost::asio::buffer(buf, data_len),
+              m_send_pool.wrap(slot,
+                boost::bind(&async_raw_server::handle_send, this,
+                  boost::asio::placeholders::error,
+                  boost::asio::placeholders::bytes_transferred)));
+          return;
+        }
 
         // be sure to hold data lifetime in memory until send finished
         std::shared_ptr<std::vector<char>> copy =
-          std::make_shared<std::vector<char>>(data);
+          std::make_shared<std::vector<char>>(data, data + data_len);
 
-        m_socket.async_send_to(boost::asio::buffer(*copy), remote,
-            boost::bind(&async_raw_server::handle_send, this,
+        m_socket.async_send(boost::asio::buffer(*copy),
+            boost::bind(&async_raw_server::on_send, this,
               boost::asio::placeholders::error,
-              boost::asio::placeholders::bytes_transferred));
+              boost::asio::placeholders::bytes_transferred, copy));
       }
 
-      void async_raw_server::async_send(const char* data, size_t data_len)
+      const std::array<char, 1500>& async_raw_server::buffer() const
       {
-        std::vector<char> copy(data, data + data_len);
+        return m_buffer;
+      }
 
-        async_send(copy);
+      void async_raw_server::set_auxdata(bool enable)
+      {
+        m_socket.set_option(ll_protocol::auxdata(enable));
+        m_auxdata = enable;
+        m_vlan = vlan_tag();
       }
 
-      const std::array<char, 1500>& async_raw_server::buffer() const
+      const vlan_tag& async_raw_server::vlan() const
       {
-        return m_buffer;
+        return m_vlan;
+      }
+
+      void async_raw_server::set_dedup(frame_dedup* dedup)
+      {
+        m_dedup = dedup;
+      }
+
+      asio::raw::ll::ll_protocol::socket& async_raw_server::socket()
+      {
+        return m_socket;
+      }
+
+      void async_raw_server::on_send(const boost::system::error_code& error,
+          size_t nb, std::shared_ptr<std::vector<char>> data)
+      {
+        (void)data;
+        handle_send(error, nb);
+      }
+
+      void async_raw_server::handle_readable(
+          const boost::system::error_code& error)
+      {
+        char control[CMSG_SPACE(sizeof(packet_auxdata))];
+        struct iovec iov;
+        struct msghdr msg;
+        ssize_t ret = 0;
+
+        if(error)
+        {
+          handle_recv(error, 0);
+          return;
+        }
+
+        iov.iov_base = m_buffer.data();
+        iov.iov_len = m_buffer.size();
+
+        memset(&msg, 0x00, sizeof(struct msghdr));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        ret = recvmsg(m_socket.native_handle(), &msg, MSG_DONTWAIT);
+        if(ret < 0)
+        {
+          if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+          {
+            // spurious wakeup, frame consumed by someone else
+            async_recv();
+            return;
+          }
+
+          handle_recv(boost::system::error_code(errno,
+                boost::system::system_category()), 0);
+          return;
+        }
+
+        m_vlan = vlan_tag();
+
+        for(struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg) ; cmsg != nullptr ;
+            cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+          packet_auxdata aux;
+
+          if(cmsg->cmsg_level != SOL_PACKET ||
+              cmsg->cmsg_type != PACKET_AUXDATA ||
+              cmsg->cmsg_len < CMSG_LEN(sizeof(packet_auxdata)))
+          {
+            continue;
+          }
+
+          memcpy(&aux, CMSG_DATA(cmsg), sizeof(packet_auxdata));
+
+          if(aux.tp_status & TP_STATUS_VLAN_VALID)
+          {
+            m_vlan = vlan_tag(aux.tp_vlan_tci,
+                (aux.tp_status & TP_STATUS_VLAN_TPID_VALID) ?
+                aux.tp_vlan_tpid : ETH_P_8021Q);
+          }
+        }
+
+        deliver((msg.msg_flags & MSG_TRUNC) ?
+            boost::asio::error::message_size : boost::system::error_code(),
+            static_cast<size_t>(ret));
+      }
+
+      void async_raw_server::deliver(const boost::system::error_code& error,
+          size_t nb)
+      {
+        if(m_dedup && (!error || error == boost::asio::error::message_size) &&
+            m_dedup->duplicate(m_buffer.data(), nb < m_buffer.size() ? nb :
+              m_buffer.size()))
+        {
+          async_recv();
+          return;
+        }
+
+        handle_recv(error, nb);
       }
     } /* namespace ll */
   } /* namespace raw */
@@ -0,0 +1,516 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file async_uring_server.cpp
+ * \brief Raw socket server with io_uring backend.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <cstring>
+
+#include <stdexcept>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+
+#include "async_uring_server.hpp"
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \brief user_data of the multishot receive, send use their slot.
+       */
+      static const uint64_t recv_tag = ~static_cast<uint64_t>(0);
+
+      /**
+       * \brief Provided buffer group identifier.
+       */
+      static const uint16_t buf_group = 0;
+
+      async_uring_server::async_uring_server(boost::asio::io_service& ios,
+          const std::string& ifname, int protocol, size_t buffers,
+          size_t frame_size)
+        : m_ios(ios),
+        m_endpoint(ifname, protocol),
+        m_socket(ios, m_endpoint),
+        m_buffers(buffers),
+        m_frame_size(frame_size),
+        m_ring_desc(ios),
+        m_buf_ring(static_cast<struct io_uring_buf_ring*>(MAP_FAILED)),
+        m_buf_ring_size(0),
+        m_buf_tail(0),
+        m_pending_head(0),
+        m_pending_count(0),
+        m_frame(nullptr),
+        m_recv_active(false),
+        m_recv_wanted(false),
+        m_armed(false),
+        m_waiting(false),
+        m_delivering(false),
+        m_posted(false),
+        m_tx_inflight(0)
+      {
+        if(buffers == 0 || buffers > 32768 || (buffers & (buffers - 1)))
+        {
+          throw std::invalid_argument("buffers must be a power of 2 up to "
+              "32768");
+        }
+
+        if(frame_size < sizeof(struct io_uring_recvmsg_out) +
+            sizeof(struct ether_header) || frame_size > 65536)
+        {
+          throw std::invalid_argument("invalid frame size");
+        }
+
+        memset(&m_stats, 0x00, sizeof(statistics));
+        memset(&m_msg, 0x00, sizeof(struct msghdr));
+
+        try
+        {
+          setup_uring();
+        }
+        catch(const boost::system::system_error& e)
+        {
+          (void)e;
+
+          // io_uring disabled or too old: Boost.Asio reactor
+          m_ring.reset();
+
+          if(m_ring_desc.is_open())
+          {
+            m_ring_desc.close();
+          }
+
+          if(m_buf_ring != MAP_FAILED)
+          {
+            munmap(m_buf_ring, m_buf_ring_size);
+            m_buf_ring = static_cast<struct io_uring_buf_ring*>(MAP_FAILED);
+          }
+
+          m_pending.clear();
+          m_rx.assign(m_frame_size, 0);
+
+          // send buffers serve the socket path, without allocation either
+          m_tx.reset(m_buffers, m_frame_size);
+        }
+      }
+
+      async_uring_server::~async_uring_server()
+      {
+        if(m_ring_desc.is_open())
+        {
+          m_ring_desc.close();
+        }
+
+        // closing the ring cancels requests and unpins buffers
+        m_ring.reset();
+
+        if(m_buf_ring != MAP_FAILED)
+        {
+          munmap(m_buf_ring, m_buf_ring_size);
+        }
+      }
+
+      void async_uring_server::setup_uring()
+      {
+        std::unique_ptr<uring> ring(new uring(
+              static_cast<unsigned>(m_buffers),
+              static_cast<unsigned>(m_buffers * 2)));
+        int fd = m_socket.native_handle();
+        struct iovec iov;
+        long page = sysconf(_SC_PAGESIZE);
+
+        // multishot recvmsg came with IORING_OP_SEND_ZC in Linux 6.0
+        if(!ring->supports(IORING_OP_RECVMSG) ||
+            !ring->supports(IORING_OP_WRITE_FIXED) ||
+            !ring->supports(IORING_OP_SEND_ZC))
+        {
+          throw boost::system::system_error(
+              boost::asio::error::operation_not_supported);
+        }
+
+        m_rx.assign(m_buffers * m_frame_size, 0);
+        m_tx.reset(m_buffers, m_frame_size, false);
+        m_pending.resize(m_buffers);
+
+        ring->register_files(&fd, 1);
+
+        iov.iov_base = m_tx.data();
+        iov.iov_len = m_tx.size();
+        ring->register_buffers(&iov, 1);
+
+        m_buf_ring_size = m_buffers * sizeof(struct io_uring_buf);
+        m_buf_ring_size = (m_buf_ring_size + page - 1) & ~(page - 1);
+        m_buf_ring = static_cast<struct io_uring_buf_ring*>(mmap(nullptr,
+              m_buf_ring_size, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if(m_buf_ring == MAP_FAILED)
+        {
+          throw boost::system::system_error(errno,
+              boost::system::system_category(), "mmap");
+        }
+
+        ring->register_buf_ring(m_buf_ring,
+            static_cast<unsigned>(m_buffers), buf_group);
+
+        for(size_t i = 0 ; i < m_buffers ; i++)
+        {
+          recycle(static_cast<uint16_t>(i));
+        }
+
+        // ring is pollable, reactor wakes us when completions are posted
+        m_ring_desc.assign(dup(ring->fd()));
+        m_ring = std::move(ring);
+      }
+
+      void async_uring_server::async_recv()
+      {
+        if(!m_ring)
+        {
+          m_socket.async_receive(boost::asio::buffer(m_rx),
+              make_allocating_handler(m_recv_memory,
+                boost::bind(&async_uring_server::handle_recv, this,
+                  boost::asio::placeholders::error,
+                  boost::asio::placeholders::bytes_transferred)));
+          return;
+        }
+
+        m_recv_wanted = true;
+        m_recv_active = true;
+
+        // called from handle_recv(), deliver() loops
+        if(!m_delivering)
+        {
+          schedule();
+        }
+      }
+
+      void async_uring_server::async_send(const std::vector<char>& data)
+      {
+        async_send(data.data(), data.size());
+      }
+
+      void async_uring_server::async_send(const char* data, size_t data_len)
+      {
+        struct io_uring_sqe* sqe = nullptr;
+        uint32_t slot = 0;
+        char* buf = nullptr;
+
+        if(!m_ring)
+        {
+          if((buf = m_tx.acquire(data_len, slot)) != nullptr)
+          {
+            memcpy(buf, data, data_len);
+
+            m_socket.async_send(boost::asio::buffer(buf, data_len),
+                m_tx.wrap(slot,
+                  boost::bind(&async_uring_server::handle_send, this,
+                    boost::asio::placeholders::error,
+                    boost::asio::placeholders::bytes_transferred)));
+            return;
+          }
+
+          // be sure to hold data lifetime in memory until send finished
+          std::shared_ptr<std::vector<char>> copy =
+            std::make_shared<std::vector<char>>(data, data + data_len);
+
+          m_socket.async_send(boost::asio::buffer(*copy),
+              boost::bind(&async_uring_server::on_send, this,
+                boost::asio::placeholders::error,
+                boost::asio::placeholders::bytes_transferred, copy));
+          return;
+        }
+
+        if(data_len > m_frame_size)
+        {
+          m_ios.post(boost::bind(&async_uring_server::handle_send, this,
+                boost::system::error_code(boost::asio::error::message_size),
+                0));
+          return;
+        }
+
+        if((buf = m_tx.acquire(data_len, slot)) == nullptr ||
+            (sqe = m_ring->get_sqe()) == nullptr)
+        {
+          if(buf)
+          {
+            m_tx.release(slot);
+          }
+
+          m_ios.post(boost::bind(&async_uring_server::handle_send, this,
+                boost::system::error_code(
+                  boost::asio::error::no_buffer_space), 0));
+          return;
+        }
+
+        memcpy(buf, data, data_len);
+
+        sqe->opcode = IORING_OP_WRITE_FIXED;
+        sqe->flags = IOSQE_FIXED_FILE;
+        sqe->fd = 0;
+        sqe->addr = reinterpret_cast<uintptr_t>(buf);
+        sqe->len = static_cast<uint32_t>(data_len);
+        sqe->off = 0;
+        sqe->buf_index = 0;
+        sqe->user_data = slot;
+        m_tx_inflight++;
+
+        // sends queued in the same handler go with one io_uring_enter()
+        schedule();
+      }
+
+      const char* async_uring_server::buffer() const
+      {
+        return m_ring ? m_frame : m_rx.data();
+      }
+
+      bool async_uring_server::uring_enabled() const
+      {
+        return static_cast<bool>(m_ring);
+      }
+
+      const async_uring_server::statistics& async_uring_server::stats() const
+      {
+        return m_stats;
+      }
+
+      asio::raw::ll::ll_protocol::socket& async_uring_server::socket()
+      {
+        return m_socket;
+      }
+
+      void async_uring_server::handle_ring(
+          const boost::system::error_code& error)
+      {
+        if(error == boost::asio::error::operation_aborted)
+        {
+          return;
+        }
+
+        m_waiting = false;
+        m_stats.wakeups++;
+
+        if(error)
+        {
+          m_recv_error = error;
+        }
+
+        process();
+      }
+
+      void async_uring_server::handle_posted()
+      {
+        m_posted = false;
+        process();
+      }
+
+      void async_uring_server::process()
+      {
+        reap();
+        deliver();
+        flush();
+      }
+
+      void async_uring_server::reap()
+      {
+        const struct io_uring_cqe* cqe = nullptr;
+
+        while((cqe = m_ring->peek()) != nullptr)
+        {
+          uint64_t tag = cqe->user_data;
+          int32_t res = cqe->res;
+          uint32_t flags = cqe->flags;
+
+          m_ring->advance();
+
+          if(tag != recv_tag)
+          {
+            m_tx.release(static_cast<uint32_t>(tag));
+            m_tx_inflight--;
+
+            if(res < 0)
+            {
+              handle_send(boost::system::error_code(-res,
+                    boost::system::system_category()), 0);
+            }
+            else
+            {
+              handle_send(boost::system::error_code(),
+                  static_cast<size_t>(res));
+            }
+            continue;
+          }
+
+          // request ended (error or out of buffers), flush() re-arms it
+          if(!(flags & IORING_CQE_F_MORE))
+          {
+            m_armed = false;
+          }
+
+          if(res < 0)
+          {
+            if(res == -ENOBUFS)
+            {
+              m_stats.no_buffers++;
+            }
+            else
+            {
+              m_recv_error = boost::system::error_code(-res,
+                  boost::system::system_category());
+            }
+            continue;
+          }
+
+          if(flags & IORING_CQE_F_BUFFER)
+          {
+            uint16_t bid = static_cast<uint16_t>(
+                flags >> IORING_CQE_BUFFER_SHIFT);
+            const struct io_uring_recvmsg_out* out =
+              reinterpret_cast<const struct io_uring_recvmsg_out*>(
+                  &m_rx[bid * m_frame_size]);
+            completion& c = m_pending[(m_pending_head + m_pending_count) &
+              (m_buffers - 1)];
+            size_t offset = sizeof(struct io_uring_recvmsg_out) +
+              m_msg.msg_namelen + m_msg.msg_controllen;
+
+            // name and control areas have the size reserved in m_msg
+            c.bid = bid;
+            c.truncated = (out->flags & MSG_TRUNC) != 0;
+            c.offset = static_cast<uint32_t>(offset);
+            c.len = static_cast<uint32_t>(static_cast<size_t>(res) > offset ?
+                res - offset : 0);
+            m_pending_count++;
+          }
+        }
+      }
+
+      void async_uring_server::deliver()
+      {
+        m_delivering = true;
+
+        while(m_recv_wanted)
+        {
+          if(m_recv_error)
+          {
+            boost::system::error_code error = m_recv_error;
+
+            m_recv_error = boost::system::error_code();
+            m_recv_wanted = false;
+            handle_recv(error, 0);
+            continue;
+          }
+
+          if(m_pending_count == 0)
+          {
+            break;
+          }
+
+          completion c = m_pending[m_pending_head];
+
+          m_pending_head = (m_pending_head + 1) & (m_buffers - 1);
+          m_pending_count--;
+          m_recv_wanted = false;
+          m_frame = &m_rx[c.bid * m_frame_size + c.offset];
+          m_stats.frames++;
+
+          handle_recv(c.truncated ? boost::asio::error::message_size :
+              boost::system::error_code(), c.len);
+
+          m_frame = nullptr;
+          recycle(c.bid);
+        }
+
+        m_delivering = false;
+      }
+
+      void async_uring_server::flush()
+      {
+        // do not re-arm into an empty buffer ring
+        if(m_recv_active && !m_armed && m_pending_count < m_buffers)
+        {
+          struct io_uring_sqe* sqe = m_ring->get_sqe();
+
+          if(sqe)
+          {
+            sqe->opcode = IORING_OP_RECVMSG;
+            sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+            sqe->fd = 0;
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->addr = reinterpret_cast<uintptr_t>(&m_msg);
+            sqe->len = 0;
+            sqe->buf_group = buf_group;
+            sqe->user_data = recv_tag;
+            m_armed = true;
+          }
+        }
+
+        if(m_ring->pending())
+        {
+          m_ring->submit();
+          m_stats.submits++;
+        }
+
+        // completions posted inline by io_uring_enter()
+        if(m_ring->peek())
+        {
+          schedule();
+        }
+
+        if(!m_waiting && (m_armed || m_tx_inflight))
+        {
+          m_waiting = true;
+          m_ring_desc.async_wait(
+              boost::asio::posix::stream_descriptor::wait_read,
+              boost::bind(&async_uring_server::handle_ring, this,
+                boost::asio::placeholders::error));
+        }
+      }
+
+      void async_uring_server::schedule()
+      {
+        if(!m_posted)
+        {
+          m_posted = true;
+          m_ios.post(boost::bind(&async_uring_server::handle_posted, this));
+        }
+      }
+
+      void async_uring_server::recycle(uint16_t bid)
+      {
+        // not m_buf_ring->bufs: __DECLARE_FLEX_ARRAY shifts it in C++
+        struct io_uring_buf* buf = reinterpret_cast<struct io_uring_buf*>(
+            m_buf_ring) + (m_buf_tail & (m_buffers - 1));
+
+        buf->addr = reinterpret_cast<uintptr_t>(&m_rx[bid * m_frame_size]);
+        buf->len = static_cast<uint32_t>(m_frame_size);
+        buf->bid = bid;
+        m_buf_tail++;
+
+        __atomic_store_n(&m_buf_ring->tail, m_buf_tail, __ATOMIC_RELEASE);
+      }
+
+      void async_uring_server::on_send(const boost::system::error_code& error,
+          size_t nb, std::shared_ptr<std::vector<char>> data)
+      {
+        (void)data;
+
+        handle_send(error, nb);
+      }
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
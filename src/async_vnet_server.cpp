@@ -0,0 +1,232 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file async_vnet_server.cpp
+ * \brief Raw socket server with GSO/GRO offload (PACKET_VNET_HDR).
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <cstring>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+
+#include "async_vnet_server.hpp"
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      // packet sockets exchange virtio_net_hdr fields in host byte order
+      // (legacy virtio, little-endian only on little-endian hosts)
+
+      gso_info::gso_info()
+        : gso_type(VIRTIO_NET_HDR_GSO_NONE),
+        ecn(false),
+        hdr_len(0),
+        gso_size(0),
+        needs_csum(false),
+        data_valid(false),
+        csum_start(0),
+        csum_offset(0)
+      {
+      }
+
+      gso_info gso_info::tcp(bool ipv6, uint16_t l4_offset, uint16_t l4_len,
+          uint16_t mss)
+      {
+        gso_info info = csum(l4_offset, 16);
+
+        info.gso_type = ipv6 ? VIRTIO_NET_HDR_GSO_TCPV6 :
+          VIRTIO_NET_HDR_GSO_TCPV4;
+        info.hdr_len = static_cast<uint16_t>(l4_offset + l4_len);
+        info.gso_size = mss;
+        return info;
+      }
+
+      gso_info gso_info::udp(uint16_t l4_offset, uint16_t mss)
+      {
+        gso_info info = csum(l4_offset, 6);
+
+        info.gso_type = VIRTIO_NET_HDR_GSO_UDP_L4;
+        info.hdr_len = static_cast<uint16_t>(l4_offset + 8);
+        info.gso_size = mss;
+        return info;
+      }
+
+      gso_info gso_info::csum(uint16_t l4_offset, uint16_t csum_field)
+      {
+        gso_info info;
+
+        info.needs_csum = true;
+        info.csum_start = l4_offset;
+        info.csum_offset = csum_field;
+        return info;
+      }
+
+      void gso_info::from_hdr(const struct virtio_net_hdr& hdr)
+      {
+        gso_type = hdr.gso_type & ~VIRTIO_NET_HDR_GSO_ECN;
+        ecn = hdr.gso_type & VIRTIO_NET_HDR_GSO_ECN;
+        hdr_len = hdr.hdr_len;
+        gso_size = hdr.gso_size;
+        needs_csum = hdr.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM;
+        data_valid = hdr.flags & VIRTIO_NET_HDR_F_DATA_VALID;
+        csum_start = hdr.csum_start;
+        csum_offset = hdr.csum_offset;
+      }
+
+      void gso_info::to_hdr(struct virtio_net_hdr& hdr) const
+      {
+        memset(&hdr, 0x00, sizeof(struct virtio_net_hdr));
+
+        hdr.gso_type = gso_type | (ecn ? VIRTIO_NET_HDR_GSO_ECN : 0);
+        hdr.hdr_len = hdr_len;
+        hdr.gso_size = gso_size;
+        hdr.flags = needs_csum ? VIRTIO_NET_HDR_F_NEEDS_CSUM : 0;
+        hdr.csum_start = csum_start;
+        hdr.csum_offset = csum_offset;
+      }
+
+      bool gso_info::is_gso() const
+      {
+        return gso_type != VIRTIO_NET_HDR_GSO_NONE && gso_size;
+      }
+
+      size_t gso_info::segments(size_t frame_len) const
+      {
+        // on receive hdr_len is the linear part of the skb, which is only
+        // a hint of the headers length: use csum_start when available
+        size_t hdr = needs_csum && csum_start > hdr_len ? csum_start :
+          hdr_len;
+
+        if(!is_gso() || frame_len <= hdr)
+        {
+          return 1;
+        }
+
+        return (frame_len - hdr + gso_size - 1) / gso_size;
+      }
+
+      async_vnet_server::async_vnet_server(boost::asio::io_service& ios,
+          const std::string& ifname, int protocol)
+        : m_buffer(max_frame_size),
+        m_endpoint(ifname, protocol),
+        m_socket(ios, m_endpoint),
+        m_send_pool(send_slots, sizeof(struct virtio_net_hdr) +
+            send_slot_size)
+      {
+        memset(&m_hdr, 0x00, sizeof(struct virtio_net_hdr));
+        m_socket.set_option(ll_protocol::vnet_hdr(true));
+      }
+
+      void async_vnet_server::async_recv()
+      {
+        std::array<boost::asio::mutable_buffer, 2> bufs = {{
+          boost::asio::buffer(&m_hdr, sizeof(struct virtio_net_hdr)),
+          boost::asio::buffer(m_buffer)
+        }};
+
+        // header and frame land in separate buffers, no copy needed
+        m_socket.async_receive_from(bufs, m_remote,
+            make_allocating_handler(m_recv_memory,
+              boost::bind(&async_vnet_server::on_recv, this,
+                boost::asio::placeholders::error,
+                boost::asio::placeholders::bytes_transferred)));
+      }
+
+      void async_vnet_server::async_send(const gso_info& info,
+          const char* data, size_t data_len)
+      {
+        struct virtio_net_hdr hdr;
+        const char* h = reinterpret_cast<const char*>(&hdr);
+        uint32_t slot = 0;
+        char* buf = m_send_pool.acquire(sizeof(struct virtio_net_hdr) +
+            data_len, slot);
+
+        info.to_hdr(hdr);
+
+        if(buf)
+        {
+          memcpy(buf, h, sizeof(struct virtio_net_hdr));
+          memcpy(buf + sizeof(struct virtio_net_hdr), data, data_len);
+
+          m_socket.async_send_to(boost::asio::buffer(buf,
+                sizeof(struct virtio_net_hdr) + data_len), m_endpoint,
+              m_send_pool.wrap(slot,
+                boost::bind(&async_vnet_server::on_send_slot, this,
+                  boost::asio::placeholders::error,
+                  boost::asio::placeholders::bytes_transferred)));
+          return;
+        }
+
+        // be sure to hold data lifetime in memory until send finished
+        std::shared_ptr<std::vector<char>> copy =
+          std::make_shared<std::vector<char>>();
+
+        copy->reserve(sizeof(struct virtio_net_hdr) + data_len);
+        copy->insert(copy->end(), h, h + sizeof(struct virtio_net_hdr));
+        copy->insert(copy->end(), data, data + data_len);
+
+        m_socket.async_send_to(boost::asio::buffer(*copy), m_endpoint,
+            boost::bind(&async_vnet_server::on_send, this,
+              boost::asio::placeholders::error,
+              boost::asio::placeholders::bytes_transferred, copy));
+      }
+
+      void async_vnet_server::async_send(const char* data, size_t data_len)
+      {
+        async_send(gso_info(), data, data_len);
+      }
+
+      const std::vector<char>& async_vnet_server::buffer() const
+      {
+        return m_buffer;
+      }
+
+      const gso_info& async_vnet_server::gso() const
+      {
+        return m_gso;
+      }
+
+      void async_vnet_server::on_recv(const boost::system::error_code& error,
+          size_t nb)
+      {
+        if(!error && nb < sizeof(struct virtio_net_hdr))
+        {
+          handle_recv(boost::asio::error::message_size, 0);
+          return;
+        }
+
+        m_gso.from_hdr(m_hdr);
+        handle_recv(error, nb >= sizeof(struct virtio_net_hdr) ?
+            nb - sizeof(struct virtio_net_hdr) : 0);
+      }
+
+      void async_vnet_server::on_send(const boost::system::error_code& error,
+          size_t nb, std::shared_ptr<std::vector<char>> data)
+      {
+        (void)data;
+
+        handle_send(error, nb >= sizeof(struct virtio_net_hdr) ?
+            nb - sizeof(struct virtio_net_hdr) : 0);
+      }
+
+      void async_vnet_server::on_send_slot(
+          const boost::system::error_code& error, size_t nb)
+      {
+        handle_send(error, nb >= sizeof(struct virtio_net_hdr) ?
+            nb - sizeof(struct virtio_net_hdr) : 0);
+      }
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
@@ -0,0 +1,606 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file async_xdp_server.cpp
+ * \brief AF_XDP socket server.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <cerrno>
+#include <cstring>
+
+#include <stdexcept>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+
+#include "async_xdp_server.hpp"
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \brief Returns number of descriptors a producer can write.
+       * \param consumer consumer index.
+       * \param cached local producer index.
+       * \param mask number of descriptors minus one.
+       * \return free descriptors.
+       */
+      static uint32_t ring_free(const uint32_t* consumer, uint32_t cached,
+          uint32_t mask)
+      {
+        return mask + 1 - (cached - __atomic_load_n(consumer,
+              __ATOMIC_ACQUIRE));
+      }
+
+      /**
+       * \brief Returns number of descriptors a consumer can read.
+       * \param producer producer index.
+       * \param cached local consumer index.
+       * \return available descriptors.
+       */
+      static uint32_t ring_avail(const uint32_t* producer, uint32_t cached)
+      {
+        return __atomic_load_n(producer, __ATOMIC_ACQUIRE) - cached;
+      }
+
+      async_xdp_server::async_xdp_server(boost::asio::io_service& ios,
+          const std::string& ifname, int protocol, uint32_t queue_id,
+          xdp_program::attach_mode mode, uint32_t frames, uint32_t frame_size)
+        : m_ios(ios),
+        m_endpoint(ifname, protocol, queue_id),
+        m_program(std::make_shared<xdp_program>(m_endpoint.ifindex(),
+              protocol, mode)),
+        m_socket(ios),
+        m_frames(frames),
+        m_frame_size(frame_size),
+        m_umem(static_cast<char*>(MAP_FAILED)),
+        m_tx_outstanding(0),
+        m_tx_kick(false),
+        m_tx_polls(0),
+        m_tx_timer(ios),
+        m_tx_timer_armed(false),
+        m_frame(nullptr),
+        m_recv_wanted(false),
+        m_waiting(false),
+        m_delivering(false),
+        m_posted(false),
+        m_zero_copy(false)
+      {
+        try
+        {
+          setup(static_cast<uint16_t>(protocol));
+        }
+        catch(...)
+        {
+          release();
+          throw;
+        }
+      }
+
+      async_xdp_server::async_xdp_server(boost::asio::io_service& ios,
+          const std::shared_ptr<xdp_program>& program, uint32_t queue_id,
+          uint32_t frames, uint32_t frame_size)
+        : m_ios(ios),
+        m_endpoint(program->ifindex(), program->eth_protocol(), queue_id),
+        m_program(program),
+        m_socket(ios),
+        m_frames(frames),
+        m_frame_size(frame_size),
+        m_umem(static_cast<char*>(MAP_FAILED)),
+        m_tx_outstanding(0),
+        m_tx_kick(false),
+        m_tx_polls(0),
+        m_tx_timer(ios),
+        m_tx_timer_armed(false),
+        m_frame(nullptr),
+        m_recv_wanted(false),
+        m_waiting(false),
+        m_delivering(false),
+        m_posted(false),
+        m_zero_copy(false)
+      {
+        try
+        {
+          setup(program->eth_protocol());
+        }
+        catch(...)
+        {
+          release();
+          throw;
+        }
+      }
+
+      async_xdp_server::~async_xdp_server()
+      {
+        if(m_socket.is_open())
+        {
+          m_program->remove_socket(m_endpoint.queue_id());
+        }
+
+        release();
+      }
+
+      void async_xdp_server::setup(uint16_t eth_protocol)
+      {
+        long page = sysconf(_SC_PAGESIZE);
+        uint32_t half = m_frames / 2;
+        size_t len = static_cast<size_t>(m_frames) * m_frame_size;
+        struct xdp_mmap_offsets off;
+        socklen_t optlen = sizeof(off);
+        boost::system::error_code ec;
+        uint64_t* fill = nullptr;
+
+        memset(&m_fill, 0x00, sizeof(ring));
+        memset(&m_comp, 0x00, sizeof(ring));
+        memset(&m_rx, 0x00, sizeof(ring));
+        memset(&m_tx, 0x00, sizeof(ring));
+
+        if(m_frames < 2 || (m_frames & (m_frames - 1)))
+        {
+          throw std::invalid_argument("frames must be a power of 2");
+        }
+
+        if(m_frame_size < 2048 || m_frame_size > page ||
+            (m_frame_size & (m_frame_size - 1)))
+        {
+          throw std::invalid_argument("frame size must be a power of 2 from "
+              "2048 to page size");
+        }
+
+        m_umem = static_cast<char*>(mmap(nullptr, len,
+              PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0));
+        if(m_umem == MAP_FAILED)
+        {
+          throw boost::system::system_error(errno,
+              boost::system::system_category(), "mmap");
+        }
+
+        m_socket.open(xdp_protocol(eth_protocol));
+        m_socket.set_option(xdp_protocol::umem_reg(m_umem, len,
+              m_frame_size));
+
+        // first half of the UMEM receives, second half sends
+        m_socket.set_option(xdp_protocol::fill_ring(half));
+        m_socket.set_option(xdp_protocol::completion_ring(half));
+        m_socket.set_option(xdp_protocol::rx_ring(half));
+        m_socket.set_option(xdp_protocol::tx_ring(half));
+
+        if(getsockopt(m_socket.native_handle(), SOL_XDP, XDP_MMAP_OFFSETS,
+              &off, &optlen) != 0)
+        {
+          throw boost::system::system_error(errno,
+              boost::system::system_category(), "XDP_MMAP_OFFSETS");
+        }
+
+        map_ring(m_fill, off.fr, half, sizeof(uint64_t),
+            XDP_UMEM_PGOFF_FILL_RING);
+        map_ring(m_comp, off.cr, half, sizeof(uint64_t),
+            XDP_UMEM_PGOFF_COMPLETION_RING);
+        map_ring(m_rx, off.rx, half, sizeof(struct xdp_desc),
+            XDP_PGOFF_RX_RING);
+        map_ring(m_tx, off.tx, half, sizeof(struct xdp_desc),
+            XDP_PGOFF_TX_RING);
+
+        fill = static_cast<uint64_t*>(m_fill.desc);
+        for(uint32_t i = 0 ; i < half ; i++)
+        {
+          fill[i] = static_cast<uint64_t>(i) * m_frame_size;
+        }
+        m_fill.cached = half;
+        __atomic_store_n(m_fill.producer, m_fill.cached, __ATOMIC_RELEASE);
+
+        m_tx_free.reserve(half);
+        for(uint32_t i = m_frames ; i > half ; i--)
+        {
+          m_tx_free.push_back(static_cast<uint64_t>(i - 1) * m_frame_size);
+        }
+        m_tx_len.assign(m_frames, 0);
+
+        // zero-copy needs the program in the driver, copy mode works on
+        // any interface
+        if(m_program->native())
+        {
+          m_endpoint.set_flags(XDP_USE_NEED_WAKEUP | XDP_ZEROCOPY);
+          m_socket.bind(m_endpoint, ec);
+          m_zero_copy = !ec;
+        }
+
+        if(!m_zero_copy)
+        {
+          m_endpoint.set_flags(XDP_USE_NEED_WAKEUP | XDP_COPY);
+          m_socket.bind(m_endpoint);
+        }
+
+        m_program->add_socket(m_endpoint.queue_id(), m_socket.native_handle());
+      }
+
+      void async_xdp_server::release()
+      {
+        ring* rings[] = {&m_fill, &m_comp, &m_rx, &m_tx};
+
+        // closing the socket cancels pending wait and unpins the UMEM
+        if(m_socket.is_open())
+        {
+          boost::system::error_code ec;
+
+          m_socket.close(ec);
+        }
+
+        for(size_t i = 0 ; i < sizeof(rings) / sizeof(ring*) ; i++)
+        {
+          if(rings[i]->map)
+          {
+            munmap(rings[i]->map, rings[i]->map_size);
+            rings[i]->map = nullptr;
+          }
+        }
+
+        if(m_umem != MAP_FAILED)
+        {
+          munmap(m_umem, static_cast<size_t>(m_frames) * m_frame_size);
+          m_umem = static_cast<char*>(MAP_FAILED);
+        }
+      }
+
+      void async_xdp_server::map_ring(ring& r,
+          const struct xdp_ring_offset& off, uint32_t count, size_t desc_size,
+          uint64_t pgoff)
+      {
+        char* map = nullptr;
+
+        r.map_size = off.desc + count * desc_size;
+        r.map = mmap(nullptr, r.map_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, m_socket.native_handle(),
+            static_cast<off_t>(pgoff));
+        if(r.map == MAP_FAILED)
+        {
+          r.map = nullptr;
+          throw boost::system::system_error(errno,
+              boost::system::system_category(), "mmap");
+        }
+
+        map = static_cast<char*>(r.map);
+        r.producer = reinterpret_cast<uint32_t*>(map + off.producer);
+        r.consumer = reinterpret_cast<uint32_t*>(map + off.consumer);
+        r.flags = reinterpret_cast<uint32_t*>(map + off.flags);
+        r.desc = map + off.desc;
+        r.mask = count - 1;
+        r.cached = 0;
+      }
+
+      void async_xdp_server::async_recv()
+      {
+        m_recv_wanted = true;
+
+        // called from handle_recv(), deliver() loops
+        if(!m_delivering)
+        {
+          schedule();
+        }
+      }
+
+      void async_xdp_server::async_send(const std::vector<char>& data)
+      {
+        async_send(data.data(), data.size());
+      }
+
+      void async_xdp_server::async_send(const char* data, size_t data_len)
+      {
+        struct xdp_desc* desc = nullptr;
+        uint64_t addr = 0;
+
+        if(m_tx_error)
+        {
+          m_ios.post(boost::bind(&async_xdp_server::handle_send, this,
+                m_tx_error, 0));
+          return;
+        }
+
+        if(data_len > m_frame_size)
+        {
+          m_ios.post(boost::bind(&async_xdp_server::handle_send, this,
+                boost::system::error_code(boost::asio::error::message_size),
+                0));
+          return;
+        }
+
+        if(m_tx_free.empty() ||
+            ring_free(m_tx.consumer, m_tx.cached, m_tx.mask) == 0)
+        {
+          m_ios.post(boost::bind(&async_xdp_server::handle_send, this,
+                boost::system::error_code(
+                  boost::asio::error::no_buffer_space), 0));
+          return;
+        }
+
+        addr = m_tx_free.back();
+        m_tx_free.pop_back();
+        memcpy(m_umem + addr, data, data_len);
+        m_tx_len[addr / m_frame_size] = static_cast<uint32_t>(data_len);
+
+        desc = static_cast<struct xdp_desc*>(m_tx.desc) +
+          (m_tx.cached & m_tx.mask);
+        desc->addr = addr;
+        desc->len = static_cast<uint32_t>(data_len);
+        desc->options = 0;
+        m_tx.cached++;
+        __atomic_store_n(m_tx.producer, m_tx.cached, __ATOMIC_RELEASE);
+
+        m_tx_outstanding++;
+        m_tx_kick = true;
+        m_tx_polls = 0;
+
+        // sends queued in the same handler go with one sendto()
+        schedule();
+      }
+
+      const char* async_xdp_server::buffer() const
+      {
+        return m_frame;
+      }
+
+      bool async_xdp_server::zero_copy() const
+      {
+        return m_zero_copy;
+      }
+
+      struct xdp_statistics async_xdp_server::xdp_stats()
+      {
+        struct xdp_statistics stats;
+        socklen_t len = sizeof(stats);
+
+        memset(&stats, 0x00, sizeof(stats));
+        if(getsockopt(m_socket.native_handle(), SOL_XDP, XDP_STATISTICS,
+              &stats, &len) != 0)
+        {
+          throw boost::system::system_error(errno,
+              boost::system::system_category(), "XDP_STATISTICS");
+        }
+        return stats;
+      }
+
+      asio::raw::ll::xdp_protocol::socket& async_xdp_server::socket()
+      {
+        return m_socket;
+      }
+
+      void async_xdp_server::handle_readable(
+          const boost::system::error_code& error)
+      {
+        if(error == boost::asio::error::operation_aborted)
+        {
+          return;
+        }
+
+        m_waiting = false;
+
+        if(error && m_recv_wanted)
+        {
+          m_recv_wanted = false;
+          handle_recv(error, 0);
+        }
+
+        process();
+      }
+
+      void async_xdp_server::handle_posted()
+      {
+        m_posted = false;
+        process();
+      }
+
+      void async_xdp_server::process()
+      {
+        if(m_tx_kick)
+        {
+          // copy mode transmits from sendto(), zero-copy only when asked
+          if(!m_zero_copy ||
+              (__atomic_load_n(m_tx.flags, __ATOMIC_ACQUIRE) &
+               XDP_RING_NEED_WAKEUP))
+          {
+            if(sendto(m_socket.native_handle(), nullptr, 0, MSG_DONTWAIT,
+                  nullptr, 0) == 0)
+            {
+              m_tx_kick = false;
+            }
+            else if(errno != EAGAIN && errno != EBUSY && errno != ENOBUFS)
+            {
+              fail_tx(boost::system::error_code(errno,
+                    boost::system::system_category()));
+            }
+            // otherwise try again on next poll
+          }
+          else
+          {
+            m_tx_kick = false;
+          }
+        }
+
+        if(m_tx_outstanding && reap_tx())
+        {
+          m_tx_polls = 0;
+        }
+
+        deliver();
+
+        if(m_tx_outstanding)
+        {
+          poll_tx();
+        }
+
+        if(m_recv_wanted && !m_waiting)
+        {
+          m_waiting = true;
+          m_socket.async_wait(boost::asio::socket_base::wait_read,
+              boost::bind(&async_xdp_server::handle_readable, this,
+                boost::asio::placeholders::error));
+        }
+      }
+
+      void async_xdp_server::deliver()
+      {
+        const struct xdp_desc* rx = static_cast<const struct xdp_desc*>(
+            m_rx.desc);
+        uint64_t* fill = static_cast<uint64_t*>(m_fill.desc);
+        uint32_t avail = 0;
+        uint32_t done = 0;
+
+        m_delivering = true;
+
+        while(m_recv_wanted)
+        {
+          if(avail == 0)
+          {
+            avail = ring_avail(m_rx.producer, m_rx.cached);
+
+            if(avail == 0)
+            {
+              break;
+            }
+          }
+
+          struct xdp_desc desc = rx[m_rx.cached & m_rx.mask];
+
+          m_rx.cached++;
+          avail--;
+          done++;
+          m_recv_wanted = false;
+          m_frame = m_umem + desc.addr;
+
+          handle_recv(boost::system::error_code(), desc.len);
+
+          m_frame = nullptr;
+
+          // there are as many fill slots as receive frames
+          fill[m_fill.cached & m_fill.mask] = desc.addr &
+            ~static_cast<uint64_t>(m_frame_size - 1);
+          m_fill.cached++;
+        }
+
+        m_delivering = false;
+
+        if(done == 0)
+        {
+          return;
+        }
+
+        // give back the whole batch at once
+        __atomic_store_n(m_rx.consumer, m_rx.cached, __ATOMIC_RELEASE);
+        __atomic_store_n(m_fill.producer, m_fill.cached, __ATOMIC_RELEASE);
+
+        if(__atomic_load_n(m_fill.flags, __ATOMIC_ACQUIRE) &
+            XDP_RING_NEED_WAKEUP)
+        {
+          recvfrom(m_socket.native_handle(), nullptr, 0, MSG_DONTWAIT,
+              nullptr, nullptr);
+        }
+      }
+
+      uint32_t async_xdp_server::reap_tx()
+      {
+        const uint64_t* comp = static_cast<const uint64_t*>(m_comp.desc);
+        uint32_t avail = ring_avail(m_comp.producer, m_comp.cached);
+
+        for(uint32_t i = 0 ; i < avail ; i++)
+        {
+          uint64_t addr = comp[m_comp.cached & m_comp.mask];
+
+          m_comp.cached++;
+          m_tx_free.push_back(addr);
+          m_tx_outstanding--;
+
+          handle_send(boost::system::error_code(),
+              m_tx_len[addr / m_frame_size]);
+        }
+
+        if(avail)
+        {
+          __atomic_store_n(m_comp.consumer, m_comp.cached, __ATOMIC_RELEASE);
+        }
+        return avail;
+      }
+
+      void async_xdp_server::fail_tx(const boost::system::error_code& error)
+      {
+        std::vector<bool> is_free(m_frames, false);
+
+        // descriptors may stay in the TX ring and be sent later: their
+        // frames are not handed out again, later sends fail too
+        m_tx_error = error;
+        m_tx_kick = false;
+        m_tx_polls = 0;
+
+        for(uint64_t addr : m_tx_free)
+        {
+          is_free[addr / m_frame_size] = true;
+        }
+
+        for(uint32_t i = m_frames / 2 ; i < m_frames ; i++)
+        {
+          if(!is_free[i])
+          {
+            m_tx_free.push_back(static_cast<uint64_t>(i) * m_frame_size);
+            m_tx_outstanding--;
+            handle_send(error, 0);
+          }
+        }
+      }
+
+      void async_xdp_server::poll_tx()
+      {
+        // completions usually follow the kick within a few rounds, do
+        // not spin on the IO service when they do not
+        if(++m_tx_polls <= tx_spin_polls)
+        {
+          schedule();
+        }
+        else if(!m_tx_timer_armed)
+        {
+          m_tx_timer_armed = true;
+          m_tx_timer.expires_from_now(
+              boost::posix_time::microseconds(tx_poll_interval));
+          m_tx_timer.async_wait(boost::bind(
+                &async_xdp_server::handle_tx_timer, this,
+                boost::asio::placeholders::error));
+        }
+      }
+
+      void async_xdp_server::handle_tx_timer(
+          const boost::system::error_code& error)
+      {
+        if(error == boost::asio::error::operation_aborted)
+        {
+          return;
+        }
+
+        m_tx_timer_armed = false;
+        process();
+      }
+
+      void async_xdp_server::schedule()
+      {
+        if(!m_posted)
+        {
+          m_posted = true;
+          m_ios.post(boost::bind(&async_xdp_server::handle_posted, this));
+        }
+      }
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
@@ -0,0 +1,615 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file capture_writer.cpp
+ * \brief Rotating pcap capture writer.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <iomanip>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/system/system_error.hpp>
+
+#include "capture_writer.hpp"
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \brief No block.
+       */
+      static const size_t npos = ~static_cast<size_t>(0);
+
+      /**
+       * \brief O_DIRECT offset, length and memory alignment.
+       */
+      static const size_t direct_alignment = 4096;
+
+      /**
+       * \brief pcap magic number for nanosecond timestamps.
+       */
+      static const uint32_t pcap_magic_ns = 0xa1b23c4d;
+
+      /**
+       * \brief pcap link type for Ethernet.
+       */
+      static const uint32_t pcap_linktype_ethernet = 1;
+
+      /**
+       * \brief pcap file header.
+       */
+      struct pcap_file_header
+      {
+        /**
+         * \brief Magic number.
+         */
+        uint32_t magic;
+
+        /**
+         * \brief Major version.
+         */
+        uint16_t version_major;
+
+        /**
+         * \brief Minor version.
+         */
+        uint16_t version_minor;
+
+        /**
+         * \brief Time zone offset (unused).
+         */
+        int32_t thiszone;
+
+        /**
+         * \brief Timestamp accuracy (unused).
+         */
+        uint32_t sigfigs;
+
+        /**
+         * \brief Maximum bytes saved per frame.
+         */
+        uint32_t snaplen;
+
+        /**
+         * \brief Link type.
+         */
+        uint32_t linktype;
+      };
+
+      /**
+       * \brief pcap record header.
+       */
+      struct pcap_record_header
+      {
+        /**
+         * \brief Seconds.
+         */
+        uint32_t ts_sec;
+
+        /**
+         * \brief Nanoseconds.
+         */
+        uint32_t ts_nsec;
+
+        /**
+         * \brief Number of bytes saved.
+         */
+        uint32_t caplen;
+
+        /**
+         * \brief Frame length.
+         */
+        uint32_t len;
+      };
+
+      capture_writer::statistics::statistics()
+        : frames(0),
+        bytes(0),
+        dropped(0),
+        blocks(0),
+        files(0)
+      {
+      }
+
+      capture_writer::capture_writer(const std::string& prefix,
+          uint64_t file_size, size_t max_files, size_t block_size,
+          size_t blocks, uint32_t snaplen)
+        : m_prefix(prefix),
+        m_file_size(file_size),
+        m_max_files(max_files),
+        m_block_size(block_size),
+        m_snaplen(snaplen),
+        m_memory(nullptr),
+        m_current(npos),
+        m_fill(0),
+        m_file_bytes(0),
+        m_queue_head(0),
+        m_queue_count(0),
+        m_stop(false),
+        m_fd(-1),
+        m_index(0),
+        m_offset(0),
+        m_direct(true),
+        m_error(0),
+        m_blocks(0),
+        m_files(0)
+      {
+        void* mem = nullptr;
+
+        if(block_size == 0 || block_size % direct_alignment)
+        {
+          throw std::invalid_argument(
+              "block size must be a multiple of 4096");
+        }
+
+        if(blocks < 2)
+        {
+          throw std::invalid_argument("at least 2 blocks are needed");
+        }
+
+        // a frame with both headers always fits in one block
+        if(snaplen == 0 || sizeof(struct pcap_file_header) +
+            sizeof(struct pcap_record_header) + snaplen > block_size ||
+            file_size == 0)
+        {
+          throw std::invalid_argument("invalid snaplen or file size");
+        }
+
+        if(posix_memalign(&mem, direct_alignment, blocks * block_size) != 0)
+        {
+          throw std::bad_alloc();
+        }
+        m_memory = static_cast<char*>(mem);
+
+        // block 0 taken first
+        m_free.reserve(blocks);
+        for(size_t i = blocks ; i > 0 ; i--)
+        {
+          m_free.push_back(i - 1);
+        }
+
+        // each block plus a file end without block after each of them
+        m_queue.resize(2 * blocks + 1);
+
+        try
+        {
+          open_file();
+        }
+        catch(...)
+        {
+          free(m_memory);
+          throw;
+        }
+
+        m_thread = std::thread(&capture_writer::run, this);
+      }
+
+      capture_writer::~capture_writer()
+      {
+        if(m_thread.joinable())
+        {
+          rotate();
+          shutdown();
+        }
+
+        free(m_memory);
+      }
+
+      bool capture_writer::write(const char* data, size_t len)
+      {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_REALTIME, &ts);
+        return write(data, len, static_cast<uint64_t>(ts.tv_sec) *
+            1000000000ULL + static_cast<uint64_t>(ts.tv_nsec));
+      }
+
+      bool capture_writer::write(const char* data, size_t len,
+          uint64_t ts_ns)
+      {
+        size_t caplen = len < m_snaplen ? len : m_snaplen;
+        size_t need = sizeof(struct pcap_record_header) + caplen;
+        struct pcap_record_header rec;
+
+        check_error();
+
+        if(m_file_bytes > 0 && m_file_bytes + need > m_file_size)
+        {
+          rotate();
+        }
+
+        if(m_file_bytes == 0)
+        {
+          need += sizeof(struct pcap_file_header);
+        }
+
+        if(!reserve(need))
+        {
+          m_stats.dropped++;
+          return false;
+        }
+
+        if(m_file_bytes == 0)
+        {
+          struct pcap_file_header hdr;
+
+          hdr.magic = pcap_magic_ns;
+          hdr.version_major = 2;
+          hdr.version_minor = 4;
+          hdr.thiszone = 0;
+          hdr.sigfigs = 0;
+          hdr.snaplen = m_snaplen;
+          hdr.linktype = pcap_linktype_ethernet;
+          append(&hdr, sizeof(hdr));
+        }
+
+        rec.ts_sec = static_cast<uint32_t>(ts_ns / 1000000000ULL);
+        rec.ts_nsec = static_cast<uint32_t>(ts_ns % 1000000000ULL);
+        rec.caplen = static_cast<uint32_t>(caplen);
+        rec.len = static_cast<uint32_t>(len);
+        append(&rec, sizeof(rec));
+        append(data, caplen);
+
+        m_stats.frames++;
+        m_stats.bytes += caplen;
+        return true;
+      }
+
+      void capture_writer::rotate()
+      {
+        if(m_file_bytes == 0)
+        {
+          return;
+        }
+
+        submit(m_current, m_fill, true);
+        m_current = npos;
+        m_fill = 0;
+        m_file_bytes = 0;
+      }
+
+      void capture_writer::close()
+      {
+        if(!m_thread.joinable())
+        {
+          return;
+        }
+
+        rotate();
+        shutdown();
+        check_error();
+      }
+
+      capture_writer::statistics capture_writer::stats() const
+      {
+        statistics ret = m_stats;
+
+        ret.blocks = m_blocks.load(std::memory_order_relaxed);
+        ret.files = m_files.load(std::memory_order_relaxed);
+        return ret;
+      }
+
+      bool capture_writer::direct() const
+      {
+        return m_direct.load(std::memory_order_relaxed);
+      }
+
+      std::string capture_writer::file_name(uint64_t index) const
+      {
+        std::ostringstream oss;
+
+        oss << m_prefix << "-" << std::setw(6) << std::setfill('0') << index
+          << ".pcap";
+        return oss.str();
+      }
+
+      size_t capture_writer::acquire()
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t ret = npos;
+
+        if(!m_free.empty())
+        {
+          ret = m_free.back();
+          m_free.pop_back();
+        }
+        return ret;
+      }
+
+      bool capture_writer::reserve(size_t n)
+      {
+        if(m_current == npos)
+        {
+          m_current = acquire();
+          m_fill = 0;
+
+          if(m_current == npos)
+          {
+            return false;
+          }
+        }
+
+        if(m_block_size - m_fill >= n)
+        {
+          return true;
+        }
+
+        // n never exceeds a block: one more is enough
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return !m_free.empty();
+      }
+
+      void capture_writer::append(const void* data, size_t n)
+      {
+        const char* p = static_cast<const char*>(data);
+
+        while(n)
+        {
+          size_t c = m_block_size - m_fill < n ? m_block_size - m_fill : n;
+
+          memcpy(m_memory + m_current * m_block_size + m_fill, p, c);
+          m_fill += c;
+          m_file_bytes += c;
+          p += c;
+          n -= c;
+
+          if(m_fill == m_block_size)
+          {
+            // the next one was checked by reserve() if n is not 0
+            submit(m_current, m_fill, false);
+            m_current = acquire();
+            m_fill = 0;
+          }
+        }
+      }
+
+      void capture_writer::submit(size_t block, size_t len, bool last)
+      {
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          request& req = m_queue[(m_queue_head + m_queue_count) %
+            m_queue.size()];
+
+          req.block = block;
+          req.len = len;
+          req.last = last;
+          m_queue_count++;
+        }
+        m_cond.notify_one();
+      }
+
+      void capture_writer::check_error() const
+      {
+        int error = m_error.load(std::memory_order_relaxed);
+
+        if(error)
+        {
+          throw boost::system::system_error(error,
+              boost::system::system_category(), "capture write");
+        }
+      }
+
+      void capture_writer::shutdown()
+      {
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+
+          m_stop = true;
+        }
+        m_cond.notify_one();
+        m_thread.join();
+      }
+
+      void capture_writer::run()
+      {
+        for(;;)
+        {
+          request req;
+
+          {
+            std::unique_lock<std::mutex> lock(m_mutex);
+
+            m_cond.wait(lock, [this]()
+            {
+              return m_queue_count > 0 || m_stop;
+            });
+
+            if(m_queue_count == 0)
+            {
+              break;
+            }
+
+            req = m_queue[m_queue_head];
+            m_queue_head = (m_queue_head + 1) % m_queue.size();
+            m_queue_count--;
+          }
+
+          process(req);
+        }
+
+        // drop preallocation of the current file, or the file itself if
+        // nothing was written to it
+        if(m_fd != -1)
+        {
+          try
+          {
+            finish_file();
+          }
+          catch(const boost::system::system_error& e)
+          {
+            m_error.store(e.code().value(), std::memory_order_relaxed);
+          }
+        }
+      }
+
+      void capture_writer::process(const request& req)
+      {
+        if(m_error.load(std::memory_order_relaxed) == 0)
+        {
+          try
+          {
+            if(req.block != npos && req.len > 0)
+            {
+              char* data = m_memory + req.block * m_block_size;
+              // only the last block of a file is partial: pad it to the
+              // alignment, the file is truncated afterwards
+              size_t len = (req.len + direct_alignment - 1) &
+                ~(direct_alignment - 1);
+              size_t done = 0;
+              bool direct = false;
+
+              if(m_fd == -1)
+              {
+                open_file();
+              }
+
+              direct = m_direct.load(std::memory_order_relaxed);
+              memset(data + req.len, 0x00, len - req.len);
+
+              while(done < len)
+              {
+                ssize_t ret = pwrite(m_fd, data + done, len - done,
+                    static_cast<off_t>(m_offset + done));
+
+                if(ret < 0)
+                {
+                  if(errno == EINTR)
+                  {
+                    continue;
+                  }
+
+                  throw boost::system::system_error(errno,
+                      boost::system::system_category(), "pwrite");
+                }
+                done += static_cast<size_t>(ret);
+              }
+
+              if(!direct)
+              {
+                // write back now and drop the pages, as O_DIRECT would
+                sync_file_range(m_fd, static_cast<off_t>(m_offset),
+                    static_cast<off_t>(len), SYNC_FILE_RANGE_WAIT_BEFORE |
+                    SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+                posix_fadvise(m_fd, static_cast<off_t>(m_offset),
+                    static_cast<off_t>(len), POSIX_FADV_DONTNEED);
+              }
+
+              m_offset += req.len;
+              m_blocks.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            if(req.last && m_fd != -1)
+            {
+              finish_file();
+            }
+          }
+          catch(const boost::system::system_error& e)
+          {
+            m_error.store(e.code().value(), std::memory_order_relaxed);
+          }
+        }
+
+        if(req.block != npos)
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+
+          m_free.push_back(req.block);
+        }
+      }
+
+      void capture_writer::open_file()
+      {
+        std::string name = file_name(m_index);
+        int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+        int fd = -1;
+        bool direct = m_direct.load(std::memory_order_relaxed);
+        // padding of the last block may go past the maximum size
+        off_t size = static_cast<off_t>((m_file_size + direct_alignment -
+              1) & ~static_cast<uint64_t>(direct_alignment - 1));
+
+        if(m_max_files && m_index >= m_max_files)
+        {
+          unlink(file_name(m_index - m_max_files).c_str());
+        }
+
+        fd = open(name.c_str(), flags | (direct ? O_DIRECT : 0), 0644);
+        if(fd == -1 && errno == EINVAL && direct)
+        {
+          // file system without O_DIRECT support, i.e. tmpfs
+          m_direct.store(false, std::memory_order_relaxed);
+          fd = open(name.c_str(), flags, 0644);
+        }
+
+        if(fd == -1)
+        {
+          throw boost::system::system_error(errno,
+              boost::system::system_category(), "open " + name);
+        }
+
+        // contiguous extents, no block allocation while capturing
+        if(fallocate(fd, 0, 0, size) != 0 && errno != EOPNOTSUPP)
+        {
+          int err = errno;
+
+          ::close(fd);
+          throw boost::system::system_error(err,
+              boost::system::system_category(), "fallocate " + name);
+        }
+
+        m_fd = fd;
+        m_offset = 0;
+      }
+
+      void capture_writer::finish_file()
+      {
+        int ret = 0;
+        int err = 0;
+
+        if(m_offset == 0)
+        {
+          // closed before any frame: a file without pcap header is not
+          // readable, remove it and reuse its name
+          ::close(m_fd);
+          m_fd = -1;
+          unlink(file_name(m_index).c_str());
+          return;
+        }
+
+        ret = ftruncate(m_fd, static_cast<off_t>(m_offset));
+        err = errno;
+
+        ::close(m_fd);
+        m_fd = -1;
+        m_index++;
+        m_files.fetch_add(1, std::memory_order_relaxed);
+
+        if(ret != 0)
+        {
+          throw boost::system::system_error(err,
+              boost::system::system_category(), "ftruncate");
+        }
+      }
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
@@ -0,0 +1,226 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file checksum.cpp
+ * \brief Internet (ones-complement) checksum helpers.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "checksum.hpp"
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \brief Bulk summing function, adds native 32-bit words of the
+       * largest prefix it can handle to a 64-bit accumulator.
+       * \param p data.
+       * \param len data length.
+       * \param acc accumulator.
+       * \return number of bytes consumed (multiple of 4).
+       */
+      typedef size_t (*bulk_sum_fn)(const uint8_t* p, size_t len,
+          uint64_t& acc);
+
+      /**
+       * \brief Portable bulk sum, two 32-bit words per 64-bit load.
+       * \param p data.
+       * \param len data length.
+       * \param acc accumulator.
+       * \return number of bytes consumed.
+       */
+      static size_t bulk_sum_scalar(const uint8_t* p, size_t len,
+          uint64_t& acc)
+      {
+        size_t n = len & ~static_cast<size_t>(7);
+        uint64_t a0 = 0;
+        uint64_t a1 = 0;
+
+        for(size_t i = 0 ; i < n ; i += 8)
+        {
+          uint64_t w = 0;
+
+          memcpy(&w, p + i, 8);
+          a0 += w & 0xffffffff;
+          a1 += w >> 32;
+        }
+
+        acc += a0 + a1;
+        return n;
+      }
+
+#if defined(__SSE2__)
+      /**
+       * \brief SSE2 bulk sum, 32 bytes per iteration.
+       * \param p data.
+       * \param len data length.
+       * \param acc accumulator.
+       * \return number of bytes consumed.
+       */
+      static size_t bulk_sum_sse2(const uint8_t* p, size_t len,
+          uint64_t& acc)
+      {
+        size_t n = len & ~static_cast<size_t>(31);
+        const __m128i zero = _mm_setzero_si128();
+        __m128i a0 = zero;
+        __m128i a1 = zero;
+        uint64_t lanes[2];
+
+        for(size_t i = 0 ; i < n ; i += 32)
+        {
+          __m128i v0 = _mm_loadu_si128(
+              reinterpret_cast<const __m128i*>(p + i));
+          __m128i v1 = _mm_loadu_si128(
+              reinterpret_cast<const __m128i*>(p + i + 16));
+
+          // zero-extend 32-bit words to 64-bit lanes: no carry is lost
+          a0 = _mm_add_epi64(a0, _mm_unpacklo_epi32(v0, zero));
+          a1 = _mm_add_epi64(a1, _mm_unpackhi_epi32(v0, zero));
+          a0 = _mm_add_epi64(a0, _mm_unpacklo_epi32(v1, zero));
+          a1 = _mm_add_epi64(a1, _mm_unpackhi_epi32(v1, zero));
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes),
+            _mm_add_epi64(a0, a1));
+        acc += lanes[0] + lanes[1];
+        return n;
+      }
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+      /**
+       * \brief AVX2 bulk sum, 64 bytes per iteration.
+       * \param p data.
+       * \param len data length.
+       * \param acc accumulator.
+       * \return number of bytes consumed.
+       */
+      __attribute__((target("avx2")))
+      static size_t bulk_sum_avx2(const uint8_t* p, size_t len,
+          uint64_t& acc)
+      {
+        size_t n = len & ~static_cast<size_t>(63);
+        const __m256i zero = _mm256_setzero_si256();
+        __m256i a0 = zero;
+        __m256i a1 = zero;
+        uint64_t lanes[4];
+
+        for(size_t i = 0 ; i < n ; i += 64)
+        {
+          __m256i v0 = _mm256_loadu_si256(
+              reinterpret_cast<const __m256i*>(p + i));
+          __m256i v1 = _mm256_loadu_si256(
+              reinterpret_cast<const __m256i*>(p + i + 32));
+
+          a0 = _mm256_add_epi64(a0, _mm256_unpacklo_epi32(v0, zero));
+          a1 = _mm256_add_epi64(a1, _mm256_unpackhi_epi32(v0, zero));
+          a0 = _mm256_add_epi64(a0, _mm256_unpacklo_epi32(v1, zero));
+          a1 = _mm256_add_epi64(a1, _mm256_unpackhi_epi32(v1, zero));
+        }
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes),
+            _mm256_add_epi64(a0, a1));
+        acc += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        return n;
+      }
+#endif
+
+      /**
+       * \brief Selected bulk implementation.
+       */
+      struct bulk_sum_impl
+      {
+        /**
+         * \brief Function.
+         */
+        bulk_sum_fn fn;
+
+        /**
+         * \brief Name.
+         */
+        const char* name;
+      };
+
+      /**
+       * \brief Selects the best bulk implementation for this CPU.
+       * \return implementation.
+       */
+      static const bulk_sum_impl& bulk_sum()
+      {
+        static const bulk_sum_impl impl = []()
+        {
+          bulk_sum_impl ret = {bulk_sum_scalar, "scalar"};
+
+#if defined(__x86_64__) || defined(__i386__)
+          if(__builtin_cpu_supports("avx2"))
+          {
+            ret.fn = bulk_sum_avx2;
+            ret.name = "avx2";
+            return ret;
+          }
+#endif
+#if defined(__SSE2__)
+          ret.fn = bulk_sum_sse2;
+          ret.name = "sse2";
+#endif
+          return ret;
+        }();
+
+        return impl;
+      }
+
+      uint32_t checksum::partial(const void* data, size_t len, uint32_t sum)
+      {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+
+        // vector setup does not pay off for headers
+        if(len >= 64)
+        {
+          uint64_t acc = 0;
+          size_t n = bulk_sum().fn(p, len, acc);
+          uint32_t folded = 0;
+
+          acc = (acc & 0xffffffff) + (acc >> 32);
+          acc = (acc & 0xffffffff) + (acc >> 32);
+          acc = (acc & 0xffff) + (acc >> 16);
+          acc = (acc & 0xffff) + (acc >> 16);
+          acc = (acc & 0xffff) + (acc >> 16);
+          folded = static_cast<uint32_t>(acc);
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+          // native sum of a little-endian host is byte-swapped
+          folded = ((folded & 0xff) << 8) | (folded >> 8);
+#endif
+
+          sum = reduce(static_cast<uint64_t>(sum) + folded);
+          p += n;
+          len -= n;
+        }
+
+        // n is even so the tail keeps its word alignment
+        return partial_scalar(p, len, sum);
+      }
+
+      const char* checksum::implementation()
+      {
+        return bulk_sum().name;
+      }
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
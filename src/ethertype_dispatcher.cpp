@@ -0,0 +1,148 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file ethertype_dispatcher.cpp
+ * \brief Per-ethertype frame dispatch on a single ETH_P_ALL socket.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <cerrno>
+
+#include <stdexcept>
+
+#include <sys/socket.h>
+
+#include "ethertype_dispatcher.hpp"
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      ethertype_dispatcher::ethertype_dispatcher()
+        : m_index(65536, 0),
+        m_handlers(1)
+      {
+      }
+
+      void ethertype_dispatcher::add(uint16_t type, const handler& h)
+      {
+        if(m_index[type] != 0)
+        {
+          m_handlers[m_index[type]] = h;
+          return;
+        }
+
+        if(m_types.size() >= max_types)
+        {
+          throw std::length_error("too many ethertypes");
+        }
+
+        m_handlers.push_back(h);
+        m_types.push_back(type);
+        m_index[type] = static_cast<uint8_t>(m_handlers.size() - 1);
+      }
+
+      void ethertype_dispatcher::set_default(const handler& h)
+      {
+        m_handlers[0] = h;
+      }
+
+      bool ethertype_dispatcher::dispatch(const char* data, size_t len) const
+      {
+        uint16_t type = 0;
+        const handler* h = nullptr;
+
+        if(len < sizeof(struct ether_header))
+        {
+          return false;
+        }
+
+        type = ethertype(data, len);
+        h = &m_handlers[m_index[type]];
+
+        if(!*h)
+        {
+          return false;
+        }
+
+        (*h)(type, data, len);
+        return true;
+      }
+
+      std::vector<struct sock_filter> ethertype_dispatcher::filter() const
+      {
+        return make_filter(m_types.data(), m_types.size(),
+            static_cast<bool>(m_handlers[0]));
+      }
+
+      void ethertype_dispatcher::attach(ll_protocol::socket& socket) const
+      {
+        attach(socket, filter());
+      }
+
+      std::vector<struct sock_filter> ethertype_dispatcher::make_filter(
+          const uint16_t* types, size_t count, bool accept_all)
+      {
+        std::vector<struct sock_filter> program;
+        const struct sock_filter accept = BPF_STMT(BPF_RET | BPF_K,
+            0xffffffff);
+        const struct sock_filter drop = BPF_STMT(BPF_RET | BPF_K, 0);
+
+        if(count > max_types)
+        {
+          throw std::length_error("too many ethertypes");
+        }
+
+        if(accept_all)
+        {
+          program.push_back(accept);
+          return program;
+        }
+
+        // ldh [12]; jeq #type, accept; ...; ret #0; accept: ret #-1
+        program.push_back(BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12));
+
+        for(size_t i = 0 ; i < count ; i++)
+        {
+          struct sock_filter jeq = BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+              types[i], static_cast<uint8_t>(count - i), 0);
+
+          program.push_back(jeq);
+        }
+
+        program.push_back(drop);
+        program.push_back(accept);
+        return program;
+      }
+
+      void ethertype_dispatcher::attach(ll_protocol::socket& socket,
+          const std::vector<struct sock_filter>& program)
+      {
+        const std::vector<struct sock_filter> drop_all(1,
+            BPF_STMT(BPF_RET | BPF_K, 0));
+        char dummy = 0;
+
+        // frames queued between bind() and the filter are unfiltered: drop
+        // everything while flushing them so that the queue runs dry, and
+        // frames accepted by the real program are not flushed with them
+        socket.set_option(ll_protocol::attach_filter(drop_all));
+
+        while(recv(socket.native_handle(), &dummy, sizeof(dummy),
+              MSG_DONTWAIT | MSG_TRUNC) >= 0 || errno == EINTR)
+        {
+        }
+
+        socket.set_option(ll_protocol::attach_filter(program));
+      }
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
@@ -0,0 +1,342 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file frame_builder.cpp
+ * \brief Ethernet/IP/UDP/TCP frame builder.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <cstring>
+
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <net/ethernet.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
+
+#include "checksum.hpp"
+#include "frame_builder.hpp"
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \brief Writes a 16-bit value in network byte order.
+       * \param p destination.
+       * \param v value in host byte order.
+       */
+      static void store16(char* p, uint16_t v)
+      {
+        p[0] = static_cast<char>(v >> 8);
+        p[1] = static_cast<char>(v & 0xff);
+      }
+
+      frame_builder::frame_builder()
+        : m_type_offset(0),
+        m_l3(0),
+        m_l4(0),
+        m_ip_version(0),
+        m_l4_proto(0),
+        m_ip_sum(0),
+        m_l4_sum(0)
+      {
+      }
+
+      frame_builder& frame_builder::ethernet(const uint8_t* dst,
+          const uint8_t* src)
+      {
+        struct ether_header hdr;
+        const char* p = reinterpret_cast<const char*>(&hdr);
+
+        if(!m_header.empty())
+        {
+          throw std::logic_error("ethernet must be the first header");
+        }
+
+        memcpy(hdr.ether_dhost, dst, ETH_ALEN);
+        memcpy(hdr.ether_shost, src, ETH_ALEN);
+        hdr.ether_type = 0;
+
+        m_header.insert(m_header.end(), p, p + sizeof(hdr));
+        m_type_offset = offsetof(struct ether_header, ether_type);
+        return *this;
+      }
+
+      frame_builder& frame_builder::vlan(uint16_t tci)
+      {
+        char tag[4];
+
+        check_l3();
+        set_ethertype(ETHERTYPE_VLAN);
+
+        store16(tag, tci);
+        store16(tag + 2, 0);
+        m_header.insert(m_header.end(), tag, tag + sizeof(tag));
+        m_type_offset = m_header.size() - 2;
+        return *this;
+      }
+
+      frame_builder& frame_builder::ipv4(uint32_t src, uint32_t dst,
+          uint8_t ttl, uint8_t tos)
+      {
+        struct iphdr hdr;
+        const char* p = reinterpret_cast<const char*>(&hdr);
+
+        check_l3();
+        set_ethertype(ETHERTYPE_IP);
+
+        memset(&hdr, 0x00, sizeof(hdr));
+        hdr.version = 4;
+        hdr.ihl = 5;
+        hdr.tos = tos;
+        hdr.frag_off = htons(IP_DF);
+        hdr.ttl = ttl;
+        hdr.saddr = src;
+        hdr.daddr = dst;
+
+        m_l3 = m_header.size();
+        m_ip_version = 4;
+        m_header.insert(m_header.end(), p, p + sizeof(hdr));
+        prepare();
+        return *this;
+      }
+
+      frame_builder& frame_builder::ipv6(const struct in6_addr& src,
+          const struct in6_addr& dst, uint8_t hop_limit)
+      {
+        struct ip6_hdr hdr;
+        const char* p = reinterpret_cast<const char*>(&hdr);
+
+        check_l3();
+        set_ethertype(ETHERTYPE_IPV6);
+
+        memset(&hdr, 0x00, sizeof(hdr));
+        hdr.ip6_flow = htonl(6 << 28);
+        hdr.ip6_hlim = hop_limit;
+        hdr.ip6_src = src;
+        hdr.ip6_dst = dst;
+
+        m_l3 = m_header.size();
+        m_ip_version = 6;
+        m_header.insert(m_header.end(), p, p + sizeof(hdr));
+        prepare();
+        return *this;
+      }
+
+      frame_builder& frame_builder::udp(uint16_t sport, uint16_t dport)
+      {
+        struct udphdr hdr;
+        const char* p = reinterpret_cast<const char*>(&hdr);
+
+        if(m_ip_version == 0 || m_l4_proto != 0)
+        {
+          throw std::logic_error("UDP must follow an IP header");
+        }
+
+        memset(&hdr, 0x00, sizeof(hdr));
+        hdr.source = htons(sport);
+        hdr.dest = htons(dport);
+
+        set_l4_proto(IPPROTO_UDP);
+        m_header.insert(m_header.end(), p, p + sizeof(hdr));
+        prepare();
+        return *this;
+      }
+
+      frame_builder& frame_builder::tcp(uint16_t sport, uint16_t dport,
+          uint32_t seq, uint32_t ack, uint8_t flags, uint16_t window)
+      {
+        struct tcphdr hdr;
+        char* p = reinterpret_cast<char*>(&hdr);
+
+        if(m_ip_version == 0 || m_l4_proto != 0)
+        {
+          throw std::logic_error("TCP must follow an IP header");
+        }
+
+        memset(&hdr, 0x00, sizeof(hdr));
+        hdr.th_sport = htons(sport);
+        hdr.th_dport = htons(dport);
+        hdr.th_seq = htonl(seq);
+        hdr.th_ack = htonl(ack);
+        hdr.th_off = 5;
+        hdr.th_flags = flags;
+        hdr.th_win = htons(window);
+
+        set_l4_proto(IPPROTO_TCP);
+        m_header.insert(m_header.end(), p, p + sizeof(hdr));
+        prepare();
+        return *this;
+      }
+
+      size_t frame_builder::header_len() const
+      {
+        return m_header.size();
+      }
+
+      size_t frame_builder::l3_offset() const
+      {
+        return m_l3;
+      }
+
+      size_t frame_builder::l4_offset() const
+      {
+        return m_l4;
+      }
+
+      const std::vector<char>& frame_builder::header() const
+      {
+        return m_header;
+      }
+
+      void frame_builder::set_ethertype(uint16_t type)
+      {
+        store16(&m_header[m_type_offset], type);
+      }
+
+      void frame_builder::set_l4_proto(int proto)
+      {
+        char* l3 = &m_header[m_l3];
+
+        if(m_ip_version == 4)
+        {
+          l3[offsetof(struct iphdr, protocol)] = static_cast<char>(proto);
+        }
+        else
+        {
+          l3[offsetof(struct ip6_hdr, ip6_nxt)] = static_cast<char>(proto);
+        }
+
+        m_l4 = m_header.size();
+        m_l4_proto = proto;
+      }
+
+      void frame_builder::check_l3() const
+      {
+        if(m_type_offset == 0 || m_ip_version != 0)
+        {
+          throw std::logic_error("header must follow ethernet or a tag");
+        }
+      }
+
+      void frame_builder::prepare()
+      {
+        const char* l3 = m_header.data() + m_l3;
+
+        if(m_ip_version == 4)
+        {
+          // total length and checksum are still zero in the template
+          m_ip_sum = checksum::partial(l3, sizeof(struct iphdr));
+        }
+
+        if(m_l4_proto)
+        {
+          uint16_t proto = htons(static_cast<uint16_t>(m_l4_proto));
+
+          // addresses are contiguous in both IPv4 and IPv6 headers
+          if(m_ip_version == 4)
+          {
+            m_l4_sum = checksum::partial(l3 + offsetof(struct iphdr, saddr),
+                8);
+          }
+          else
+          {
+            m_l4_sum = checksum::partial(l3 + offsetof(struct ip6_hdr,
+                  ip6_src), 32);
+          }
+
+          m_l4_sum = checksum::partial(&proto, 2, m_l4_sum);
+          m_l4_sum = checksum::partial(m_header.data() + m_l4,
+              m_header.size() - m_l4, m_l4_sum);
+
+          // keep room to add length words without overflow
+          m_l4_sum = (m_l4_sum & 0xffff) + (m_l4_sum >> 16);
+          m_l4_sum = (m_l4_sum & 0xffff) + (m_l4_sum >> 16);
+        }
+      }
+
+      size_t frame_builder::build(char* frame, size_t payload_len) const
+      {
+        const size_t hlen = m_header.size();
+        size_t l4_len = 0;
+
+        memcpy(frame, m_header.data(), hlen);
+
+        if(m_ip_version == 4)
+        {
+          uint16_t tot_len = static_cast<uint16_t>(hlen - m_l3 +
+              payload_len);
+
+          store16(frame + m_l3 + offsetof(struct iphdr, tot_len), tot_len);
+          store16(frame + m_l3 + offsetof(struct iphdr, check),
+              checksum::fold(m_ip_sum + tot_len));
+        }
+        else if(m_ip_version == 6)
+        {
+          store16(frame + m_l3 + offsetof(struct ip6_hdr, ip6_plen),
+              static_cast<uint16_t>(hlen - m_l3 - sizeof(struct ip6_hdr) +
+                payload_len));
+        }
+
+        if(m_l4_proto)
+        {
+          uint32_t sum = m_l4_sum;
+          uint16_t csum = 0;
+
+          l4_len = hlen - m_l4 + payload_len;
+
+          // pseudo-header length, plus UDP length field
+          sum += static_cast<uint32_t>(l4_len & 0xffff);
+          if(m_l4_proto == IPPROTO_UDP)
+          {
+            sum += static_cast<uint32_t>(l4_len & 0xffff);
+          }
+
+          // L4 header length is even, payload keeps word alignment
+          sum = checksum::partial(frame + hlen, payload_len, sum);
+
+          if(m_l4_proto == IPPROTO_UDP)
+          {
+            store16(frame + m_l4 + offsetof(struct udphdr, len),
+                static_cast<uint16_t>(l4_len));
+            csum = checksum::fold(sum);
+            store16(frame + m_l4 + offsetof(struct udphdr, check),
+                csum ? csum : 0xffff);
+          }
+          else
+          {
+            csum = checksum::fold(sum);
+            store16(frame + m_l4 + offsetof(struct tcphdr, th_sum), csum);
+          }
+        }
+
+        return hlen + payload_len;
+      }
+
+      size_t frame_builder::build(char* frame, size_t frame_size,
+          const void* payload, size_t payload_len) const
+      {
+        if(frame_size < m_header.size() + payload_len)
+        {
+          throw std::length_error("frame buffer too small");
+        }
+
+        memcpy(frame + m_header.size(), payload, payload_len);
+        return build(frame, payload_len);
+      }
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
@@ -0,0 +1,326 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file frame_dedup.cpp
+ * \brief Duplicate frame filter.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <new>
+#include <stdexcept>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#include "frame_dedup.hpp"
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \brief Fingerprint function.
+       */
+      typedef uint64_t (*hash_fn)(const void* data, size_t len);
+
+      /**
+       * \brief Reads 8 bytes.
+       * \param p data.
+       * \return word.
+       */
+      static uint64_t load(const uint8_t* p)
+      {
+        uint64_t w = 0;
+
+        memcpy(&w, p, sizeof(w));
+        return w;
+      }
+
+      /**
+       * \brief Reads the last 1 to 7 bytes of data, zero padded.
+       * \param p tail.
+       * \param n number of bytes.
+       * \param len total data length.
+       * \return word.
+       */
+      static uint64_t load_tail(const uint8_t* p, size_t n, size_t len)
+      {
+        uint64_t w = 0;
+
+        if(len >= 8)
+        {
+          // one load ending at the last byte, instead of a memcpy() call
+          // of variable length
+          w = load(p + n - 8);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+          return w >> (64 - 8 * n);
+#else
+          return w << (64 - 8 * n);
+#endif
+        }
+
+        memcpy(&w, p, n);
+        return w;
+      }
+
+#if defined(__x86_64__)
+      /**
+       * \brief CRC32C fingerprint: two independent chains over alternate
+       * words, to keep two CRC instructions in flight.
+       * \param data data.
+       * \param len data length.
+       * \return fingerprint.
+       */
+      __attribute__((target("sse4.2")))
+      static uint64_t hash_sse42(const void* data, size_t len)
+      {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        const size_t total = len;
+        uint64_t a = len;
+        uint64_t b = 0xffffffff;
+        uint64_t ret = 0;
+
+        while(len >= 16)
+        {
+          a = _mm_crc32_u64(a, load(p));
+          b = _mm_crc32_u64(b, load(p + 8));
+          p += 16;
+          len -= 16;
+        }
+
+        if(len >= 8)
+        {
+          a = _mm_crc32_u64(a, load(p));
+          p += 8;
+          len -= 8;
+        }
+
+        if(len)
+        {
+          b = _mm_crc32_u64(b, load_tail(p, len, total));
+        }
+
+        // low half indexes tables: make it depend on both chains
+        b = _mm_crc32_u64(b, a);
+        ret = a << 32 | (b & 0xffffffff);
+        return ret ? ret : 1;
+      }
+#endif
+
+      /**
+       * \brief Multiply-rotate fingerprint.
+       * \param data data.
+       * \param len data length.
+       * \return fingerprint.
+       */
+      static uint64_t hash_mix(const void* data, size_t len)
+      {
+        const uint64_t k1 = 0x9e3779b97f4a7c15ULL;
+        const uint64_t k2 = 0xc2b2ae3d27d4eb4fULL;
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        const size_t total = len;
+        uint64_t a = len * k1;
+        uint64_t b = ~len;
+
+        while(len >= 16)
+        {
+          a = ((a ^ load(p)) * k1);
+          a = a << 31 | a >> 33;
+          b = ((b ^ load(p + 8)) * k2);
+          b = b << 29 | b >> 35;
+          p += 16;
+          len -= 16;
+        }
+
+        if(len >= 8)
+        {
+          a = ((a ^ load(p)) * k1);
+          a = a << 31 | a >> 33;
+          p += 8;
+          len -= 8;
+        }
+
+        if(len)
+        {
+          b = ((b ^ load_tail(p, len, total)) * k2);
+        }
+
+        // final avalanche (MurmurHash3 fmix64)
+        a ^= b << 32 | b >> 32;
+        a ^= a >> 33;
+        a *= 0xff51afd7ed558ccdULL;
+        a ^= a >> 33;
+        a *= 0xc4ceb9fe1a85ec53ULL;
+        a ^= a >> 33;
+        return a ? a : 1;
+      }
+
+      /**
+       * \brief Selected fingerprint implementation.
+       */
+      struct hash_impl
+      {
+        /**
+         * \brief Function.
+         */
+        hash_fn fn;
+
+        /**
+         * \brief Name.
+         */
+        const char* name;
+      };
+
+      /**
+       * \brief Selects the best fingerprint implementation for this CPU.
+       * \return implementation.
+       */
+      static const hash_impl& hash_select()
+      {
+        static const hash_impl impl = []()
+        {
+          hash_impl ret = {hash_mix, "scalar"};
+
+#if defined(__x86_64__)
+          if(__builtin_cpu_supports("sse4.2"))
+          {
+            ret.fn = hash_sse42;
+            ret.name = "sse4.2";
+          }
+#endif
+          return ret;
+        }();
+
+        return impl;
+      }
+
+      frame_dedup::statistics::statistics()
+        : frames(0),
+        dropped(0),
+        evicted(0)
+      {
+      }
+
+      frame_dedup::frame_dedup(size_t entries, uint64_t window_ns,
+          size_t offset, size_t length)
+        : m_entries(nullptr),
+        m_set_mask(entries / ways - 1),
+        m_window(window_ns),
+        m_offset(offset),
+        m_length(length)
+      {
+        void* mem = nullptr;
+
+        if(entries < ways || (entries & (entries - 1)))
+        {
+          throw std::invalid_argument("entries must be a power of 2");
+        }
+
+        if(posix_memalign(&mem, 64, entries * sizeof(entry)) != 0)
+        {
+          throw std::bad_alloc();
+        }
+        m_entries = static_cast<entry*>(mem);
+        clear();
+      }
+
+      frame_dedup::~frame_dedup()
+      {
+        free(m_entries);
+      }
+
+      bool frame_dedup::duplicate(const void* data, size_t len)
+      {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return duplicate(data, len, static_cast<uint64_t>(ts.tv_sec) *
+            1000000000ULL + static_cast<uint64_t>(ts.tv_nsec));
+      }
+
+      bool frame_dedup::duplicate(const void* data, size_t len,
+          uint64_t now_ns)
+      {
+        size_t begin = m_offset < len ? m_offset : len;
+        size_t end = (m_length && m_length < len - begin) ?
+          begin + m_length : len;
+        uint64_t fp = hash_select().fn(static_cast<const uint8_t*>(data) +
+            begin, end - begin);
+        entry* set = m_entries + (fp & m_set_mask) * ways;
+        entry* victim = set;
+
+        m_stats.frames++;
+
+        for(size_t i = 0 ; i < ways ; i++)
+        {
+          if(set[i].fingerprint == fp)
+          {
+            if(now_ns - set[i].time <= m_window)
+            {
+              // window counts from the first copy: a frame repeated
+              // forever still goes through once per window
+              m_stats.dropped++;
+              return true;
+            }
+
+            victim = &set[i];
+            break;
+          }
+
+          if(set[i].time < victim->time)
+          {
+            victim = &set[i];
+          }
+        }
+
+        if(victim->fingerprint && now_ns - victim->time <= m_window)
+        {
+          m_stats.evicted++;
+        }
+
+        victim->fingerprint = fp;
+        victim->time = now_ns;
+        return false;
+      }
+
+      void frame_dedup::clear()
+      {
+        memset(m_entries, 0x00, (m_set_mask + 1) * ways * sizeof(entry));
+      }
+
+      const frame_dedup::statistics& frame_dedup::stats() const
+      {
+        return m_stats;
+      }
+
+      uint64_t frame_dedup::hash(const void* data, size_t len)
+      {
+        return hash_select().fn(data, len);
+      }
+
+      uint64_t frame_dedup::hash_scalar(const void* data, size_t len)
+      {
+        return hash_mix(data, len);
+      }
+
+      const char* frame_dedup::implementation()
+      {
+        return hash_select().name;
+      }
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
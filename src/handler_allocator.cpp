@@ -0,0 +1,116 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file handler_allocator.cpp
+ * \brief Preallocated memory for asynchronous operations.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <new>
+
+#include "handler_allocator.hpp"
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      handler_memory::handler_memory()
+        : m_in_use(false)
+      {
+      }
+
+      void* handler_memory::allocate(size_t n)
+      {
+        if(!m_in_use && n <= sizeof(m_storage))
+        {
+          m_in_use = true;
+          return &m_storage;
+        }
+
+        return ::operator new(n);
+      }
+
+      void handler_memory::deallocate(void* p)
+      {
+        if(p == &m_storage)
+        {
+          m_in_use = false;
+          return;
+        }
+
+        ::operator delete(p);
+      }
+
+      send_pool::send_pool()
+        : m_slot_size(0)
+      {
+      }
+
+      send_pool::send_pool(size_t slots, size_t slot_size, bool handlers)
+        : m_slot_size(0)
+      {
+        reset(slots, slot_size, handlers);
+      }
+
+      void send_pool::reset(size_t slots, size_t slot_size, bool handlers)
+      {
+        m_slot_size = slot_size;
+        m_buffers.assign(slots * slot_size, 0);
+        m_memory.reset(handlers ? new handler_memory[slots] : nullptr);
+        m_free.clear();
+        m_free.reserve(slots);
+
+        for(size_t i = slots ; i > 0 ; i--)
+        {
+          m_free.push_back(static_cast<uint32_t>(i - 1));
+        }
+      }
+
+      char* send_pool::acquire(size_t len, uint32_t& slot)
+      {
+        if(len > m_slot_size || m_free.empty())
+        {
+          return nullptr;
+        }
+
+        slot = m_free.back();
+        m_free.pop_back();
+        return data(slot);
+      }
+
+      void send_pool::release(uint32_t slot)
+      {
+        m_free.push_back(slot);
+      }
+
+      char* send_pool::data(uint32_t slot)
+      {
+        return &m_buffers[slot * m_slot_size];
+      }
+
+      char* send_pool::data()
+      {
+        return m_buffers.data();
+      }
+
+      size_t send_pool::size() const
+      {
+        return m_buffers.size();
+      }
+
+      size_t send_pool::slot_size() const
+      {
+        return m_slot_size;
+      }
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
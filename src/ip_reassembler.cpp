@@ -0,0 +1,710 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file ip_reassembler.cpp
+ * \brief IPv4 and IPv6 fragment reassembly.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <cstring>
+#include <ctime>
+
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <net/ethernet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "checksum.hpp"
+#include "frame_dedup.hpp"
+#include "ip_reassembler.hpp"
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \brief No context or buffer.
+       */
+      static const uint32_t npos = ~static_cast<uint32_t>(0);
+
+      /**
+       * \brief Maximum IP datagram length.
+       */
+      static const size_t max_datagram = 65535;
+
+      /**
+       * \brief IPv6 header length.
+       */
+      static const size_t ipv6_header_len = 40;
+
+      /**
+       * \brief Reads a big-endian 16-bit integer.
+       * \param p data.
+       * \return value.
+       */
+      static uint16_t read16(const char* p)
+      {
+        const uint8_t* b = reinterpret_cast<const uint8_t*>(p);
+
+        return static_cast<uint16_t>(b[0] << 8 | b[1]);
+      }
+
+      size_t ip_reassembler::datagram::copy(void* out, size_t size) const
+      {
+        char* dst = static_cast<char*>(out);
+        size_t ret = 0;
+
+        for(size_t i = 0 ; i < iovcnt && ret < size ; i++)
+        {
+          size_t n = iov[i].iov_len < size - ret ? iov[i].iov_len :
+            size - ret;
+
+          memcpy(dst + ret, iov[i].iov_base, n);
+          ret += n;
+        }
+        return ret;
+      }
+
+      ip_reassembler::statistics::statistics()
+        : fragments(0),
+        datagrams(0),
+        timeouts(0),
+        evicted(0),
+        dropped(0)
+      {
+      }
+
+      ip_reassembler::ip_reassembler(size_t contexts, size_t buffers,
+          size_t buffer_size, uint64_t timeout_ns, size_t max_fragments)
+        : m_buffer_size(buffer_size),
+        m_max_fragments(max_fragments),
+        m_tick_ns(timeout_ns / (wheel_size / 2)),
+        m_timeout_ticks(wheel_size / 2),
+        m_tick(~static_cast<uint64_t>(0))
+      {
+        size_t buckets = 1;
+
+        if(contexts == 0 || contexts >= npos || buffers == 0 ||
+            buffers >= npos || buffer_size < 8 || max_fragments == 0 ||
+            max_fragments > 8192 || timeout_ns < wheel_size / 2)
+        {
+          throw std::invalid_argument("invalid reassembly parameters");
+        }
+
+        m_contexts.resize(contexts);
+        m_fragments.resize(contexts * max_fragments);
+        m_memory.resize(buffers * buffer_size);
+        m_iov.resize(max_fragments + 1);
+
+        // context 0 and buffer 0 taken first
+        m_free_contexts.reserve(contexts);
+        for(size_t i = contexts ; i > 0 ; i--)
+        {
+          m_free_contexts.push_back(static_cast<uint32_t>(i - 1));
+        }
+
+        m_free_buffers.reserve(buffers);
+        for(size_t i = buffers ; i > 0 ; i--)
+        {
+          m_free_buffers.push_back(static_cast<uint32_t>(i - 1));
+        }
+
+        // at most 1/2 load, chains stay short
+        while(buckets < 2 * contexts)
+        {
+          buckets <<= 1;
+        }
+        m_buckets.assign(buckets, npos);
+
+        for(size_t i = 0 ; i < wheel_size ; i++)
+        {
+          m_wheel_head[i] = npos;
+          m_wheel_tail[i] = npos;
+        }
+      }
+
+      void ip_reassembler::set_handler(const handler& h)
+      {
+        m_handler = h;
+      }
+
+      ip_reassembler::result ip_reassembler::add_frame(const char* data,
+          size_t len)
+      {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return add_frame(data, len, static_cast<uint64_t>(ts.tv_sec) *
+            1000000000ULL + static_cast<uint64_t>(ts.tv_nsec));
+      }
+
+      ip_reassembler::result ip_reassembler::add_frame(const char* data,
+          size_t len, uint64_t now_ns)
+      {
+        size_t off = sizeof(struct ether_header);
+        uint16_t type = 0;
+
+        if(len < off)
+        {
+          return not_fragment;
+        }
+
+        type = read16(data + 12);
+        while(type == ETH_P_8021Q || type == ETH_P_8021AD)
+        {
+          if(len < off + 4)
+          {
+            return not_fragment;
+          }
+
+          type = read16(data + off + 2);
+          off += 4;
+        }
+
+        if(type != ETH_P_IP && type != ETH_P_IPV6)
+        {
+          return not_fragment;
+        }
+
+        return add_packet(data + off, len - off, now_ns);
+      }
+
+      ip_reassembler::result ip_reassembler::add_packet(const char* data,
+          size_t len, uint64_t now_ns)
+      {
+        parsed p;
+        result ret = not_fragment;
+        size_t bucket = 0;
+        uint32_t c = npos;
+
+        if(len == 0)
+        {
+          return not_fragment;
+        }
+
+        switch(static_cast<uint8_t>(data[0]) >> 4)
+        {
+          case 4:
+            ret = parse_ipv4(data, len, p);
+            break;
+          case 6:
+            ret = parse_ipv6(data, len, p);
+            break;
+          default:
+            break;
+        }
+
+        if(ret == not_fragment)
+        {
+          return ret;
+        }
+
+        m_stats.fragments++;
+
+        if(ret == dropped || p.payload_len > m_buffer_size)
+        {
+          m_stats.dropped++;
+          return dropped;
+        }
+
+        expire(now_ns);
+
+        bucket = frame_dedup::hash(&p.k, sizeof(key)) &
+          (m_buckets.size() - 1);
+        c = find(p.k, bucket);
+        if(c == npos)
+        {
+          c = create(p.k, bucket, now_ns);
+          if(c == npos)
+          {
+            m_stats.dropped++;
+            return dropped;
+          }
+        }
+
+        return insert(c, p);
+      }
+
+      void ip_reassembler::expire(uint64_t now_ns)
+      {
+        uint64_t t = now_ns / m_tick_ns;
+        uint64_t steps = 0;
+
+        if(m_tick == ~static_cast<uint64_t>(0))
+        {
+          m_tick = t;
+          return;
+        }
+
+        if(t <= m_tick)
+        {
+          return;
+        }
+
+        // after a long pause each slot is visited once
+        steps = t - m_tick < wheel_size ? t - m_tick : wheel_size;
+
+        for(uint64_t i = 1 ; i <= steps ; i++)
+        {
+          uint32_t c = m_wheel_head[(m_tick + i) % wheel_size];
+
+          while(c != npos)
+          {
+            uint32_t next = m_contexts[c].wheel_next;
+
+            if(m_contexts[c].expires <= t)
+            {
+              release(c);
+              m_stats.timeouts++;
+            }
+            c = next;
+          }
+        }
+
+        m_tick = t;
+      }
+
+      const ip_reassembler::statistics& ip_reassembler::stats() const
+      {
+        return m_stats;
+      }
+
+      size_t ip_reassembler::pending() const
+      {
+        return m_contexts.size() - m_free_contexts.size();
+      }
+
+      size_t ip_reassembler::free_buffers() const
+      {
+        return m_free_buffers.size();
+      }
+
+      ip_reassembler::result ip_reassembler::parse_ipv4(const char* data,
+          size_t len, parsed& p) const
+      {
+        size_t hl = 0;
+        size_t total = 0;
+        uint16_t frag = 0;
+
+        if(len < 20)
+        {
+          return not_fragment;
+        }
+
+        hl = (static_cast<uint8_t>(data[0]) & 0x0f) * 4;
+        total = read16(data + 2);
+        if(hl < 20 || total < hl || total > len)
+        {
+          return not_fragment;
+        }
+
+        frag = read16(data + 6);
+        p.offset = (frag & 0x1fff) * 8;
+        p.more = (frag & 0x2000) != 0;
+        if(p.offset == 0 && !p.more)
+        {
+          return not_fragment;
+        }
+
+        p.header = data;
+        p.header_len = hl;
+        p.next_header_offset = 0;
+        p.payload = data + hl;
+        p.payload_len = total - hl;
+
+        // all fragments but the last carry multiples of 8 bytes
+        if((p.more && (p.payload_len == 0 || p.payload_len % 8)) ||
+            p.offset + p.payload_len > max_datagram - hl)
+        {
+          return dropped;
+        }
+
+        memset(&p.k, 0x00, sizeof(key));
+        memcpy(p.k.src, data + 12, 4);
+        memcpy(p.k.dst, data + 16, 4);
+        p.k.id = read16(data + 4);
+        p.k.protocol = static_cast<uint8_t>(data[9]);
+        p.k.family = AF_INET;
+        return queued;
+      }
+
+      ip_reassembler::result ip_reassembler::parse_ipv6(const char* data,
+          size_t len, parsed& p) const
+      {
+        size_t end = 0;
+        size_t off = ipv6_header_len;
+        size_t nh_off = 6;
+        uint8_t nh = 0;
+        uint16_t frag = 0;
+
+        if(len < ipv6_header_len)
+        {
+          return not_fragment;
+        }
+
+        // frame padding is not part of the packet
+        end = ipv6_header_len + read16(data + 4);
+        if(end > len)
+        {
+          return not_fragment;
+        }
+
+        // extension headers that may precede the fragment header
+        nh = static_cast<uint8_t>(data[6]);
+        while(nh == IPPROTO_HOPOPTS || nh == IPPROTO_ROUTING ||
+            nh == IPPROTO_DSTOPTS)
+        {
+          if(off + 8 > end)
+          {
+            return not_fragment;
+          }
+
+          nh_off = off;
+          nh = static_cast<uint8_t>(data[off]);
+          off += (static_cast<uint8_t>(data[off + 1]) + 1) * 8;
+        }
+
+        if(nh != IPPROTO_FRAGMENT || off > end)
+        {
+          return not_fragment;
+        }
+
+        if(off + 8 > end || off > max_header)
+        {
+          return dropped;
+        }
+
+        frag = read16(data + off + 2);
+        p.offset = frag & 0xfff8;
+        p.more = (frag & 0x0001) != 0;
+
+        // atomic fragment (RFC 6946): nothing to reassemble
+        if(p.offset == 0 && !p.more)
+        {
+          return not_fragment;
+        }
+
+        p.header = data;
+        p.header_len = off;
+        p.next_header_offset = nh_off;
+        p.payload = data + off + 8;
+        p.payload_len = end - off - 8;
+
+        if((p.more && (p.payload_len == 0 || p.payload_len % 8)) ||
+            p.offset + p.payload_len > max_datagram -
+            (off - ipv6_header_len))
+        {
+          return dropped;
+        }
+
+        memset(&p.k, 0x00, sizeof(key));
+        memcpy(p.k.src, data + 8, 16);
+        memcpy(p.k.dst, data + 24, 16);
+        memcpy(&p.k.id, data + off + 4, 4);
+        p.k.protocol = static_cast<uint8_t>(data[off]);
+        p.k.family = AF_INET6;
+        return queued;
+      }
+
+      uint32_t ip_reassembler::find(const key& k, size_t bucket) const
+      {
+        uint32_t c = m_buckets[bucket];
+
+        while(c != npos && memcmp(&m_contexts[c].k, &k, sizeof(key)) != 0)
+        {
+          c = m_contexts[c].hash_next;
+        }
+        return c;
+      }
+
+      uint32_t ip_reassembler::create(const key& k, size_t bucket,
+          uint64_t now_ns)
+      {
+        uint32_t c = npos;
+        size_t slot = 0;
+
+        if(m_free_contexts.empty())
+        {
+          uint32_t victim = oldest(npos);
+
+          if(victim == npos)
+          {
+            return npos;
+          }
+
+          release(victim);
+          m_stats.evicted++;
+        }
+
+        c = m_free_contexts.back();
+        m_free_contexts.pop_back();
+
+        context& ctx = m_contexts[c];
+
+        ctx.k = k;
+        ctx.expires = now_ns / m_tick_ns + m_timeout_ticks;
+        ctx.total = 0;
+        ctx.received = 0;
+        ctx.count = 0;
+        ctx.header_len = 0;
+        ctx.next_header_offset = 0;
+
+        ctx.hash_next = m_buckets[bucket];
+        m_buckets[bucket] = c;
+
+        // expiry never moves: appending keeps each slot oldest first
+        slot = ctx.expires % wheel_size;
+        ctx.wheel_next = npos;
+        ctx.wheel_prev = m_wheel_tail[slot];
+        if(ctx.wheel_prev != npos)
+        {
+          m_contexts[ctx.wheel_prev].wheel_next = c;
+        }
+        else
+        {
+          m_wheel_head[slot] = c;
+        }
+        m_wheel_tail[slot] = c;
+
+        return c;
+      }
+
+      uint32_t ip_reassembler::take_buffer(uint32_t keep)
+      {
+        uint32_t ret = npos;
+
+        while(m_free_buffers.empty())
+        {
+          uint32_t victim = oldest(keep);
+
+          if(victim == npos)
+          {
+            return npos;
+          }
+
+          release(victim);
+          m_stats.evicted++;
+        }
+
+        ret = m_free_buffers.back();
+        m_free_buffers.pop_back();
+        return ret;
+      }
+
+      uint32_t ip_reassembler::oldest(uint32_t keep) const
+      {
+        // slots after the current tick, in expiry order
+        for(size_t i = 1 ; i <= wheel_size ; i++)
+        {
+          uint32_t c = m_wheel_head[(m_tick + i) % wheel_size];
+
+          while(c != npos)
+          {
+            if(c != keep)
+            {
+              return c;
+            }
+            c = m_contexts[c].wheel_next;
+          }
+        }
+        return npos;
+      }
+
+      ip_reassembler::result ip_reassembler::insert(uint32_t c,
+          const parsed& p)
+      {
+        context& ctx = m_contexts[c];
+        fragment* frags = &m_fragments[c * m_max_fragments];
+        size_t end = p.offset + p.payload_len;
+        size_t i = ctx.count;
+        uint32_t b = npos;
+
+        // in order arrival is the common case: search from the end
+        while(i > 0 && frags[i - 1].offset > p.offset)
+        {
+          i--;
+        }
+
+        if(i > 0 && frags[i - 1].offset == p.offset &&
+            frags[i - 1].len == p.payload_len)
+        {
+          // retransmitted copy
+          m_stats.dropped++;
+          return dropped;
+        }
+
+        if((i > 0 && frags[i - 1].offset + frags[i - 1].len > p.offset) ||
+            (i < ctx.count && end > frags[i].offset) ||
+            (ctx.total && (end > ctx.total || (!p.more &&
+              end != ctx.total))) ||
+            (!p.more && ctx.count &&
+             frags[ctx.count - 1].offset + frags[ctx.count - 1].len > end) ||
+            ctx.count == m_max_fragments)
+        {
+          // overlap, inconsistent length or too many fragments
+          release(c);
+          m_stats.dropped++;
+          return dropped;
+        }
+
+        b = take_buffer(c);
+        if(b == npos)
+        {
+          release(c);
+          m_stats.dropped++;
+          return dropped;
+        }
+
+        memcpy(&m_memory[b * m_buffer_size], p.payload, p.payload_len);
+        memmove(&frags[i + 1], &frags[i], (ctx.count - i) * sizeof(fragment));
+        frags[i].offset = static_cast<uint32_t>(p.offset);
+        frags[i].len = static_cast<uint32_t>(p.payload_len);
+        frags[i].buffer = b;
+        ctx.count++;
+        ctx.received += static_cast<uint32_t>(p.payload_len);
+
+        if(!p.more)
+        {
+          ctx.total = static_cast<uint32_t>(end);
+        }
+
+        if(p.offset == 0)
+        {
+          memcpy(ctx.header, p.header, p.header_len);
+          ctx.header_len = static_cast<uint32_t>(p.header_len);
+          ctx.next_header_offset = static_cast<uint32_t>(
+              p.next_header_offset);
+        }
+
+        // fragments are checked against their own header but the first
+        // one's is kept: the rebuilt datagram must fit too
+        if(ctx.total && ctx.header_len && (ctx.k.family == AF_INET ?
+              ctx.header_len : ctx.header_len - ipv6_header_len) +
+            ctx.total > max_datagram)
+        {
+          release(c);
+          m_stats.dropped++;
+          return dropped;
+        }
+
+        // no overlap: as many bytes as the length means no hole
+        if(ctx.total && ctx.header_len && ctx.received == ctx.total)
+        {
+          deliver(c);
+          release(c);
+          return completed;
+        }
+
+        return queued;
+      }
+
+      void ip_reassembler::deliver(uint32_t c)
+      {
+        context& ctx = m_contexts[c];
+        const fragment* frags = &m_fragments[c * m_max_fragments];
+        datagram d;
+        size_t n = 1;
+
+        if(ctx.k.family == AF_INET)
+        {
+          uint16_t total = htons(static_cast<uint16_t>(ctx.header_len +
+                ctx.total));
+          uint16_t csum = 0;
+
+          memcpy(ctx.header + 2, &total, sizeof(total));
+          memset(ctx.header + 6, 0x00, 2);
+          memset(ctx.header + 10, 0x00, 2);
+          csum = htons(checksum::compute(ctx.header, ctx.header_len));
+          memcpy(ctx.header + 10, &csum, sizeof(csum));
+        }
+        else
+        {
+          uint16_t plen = htons(static_cast<uint16_t>(ctx.header_len -
+                ipv6_header_len + ctx.total));
+
+          memcpy(ctx.header + 4, &plen, sizeof(plen));
+          ctx.header[ctx.next_header_offset] = ctx.k.protocol;
+        }
+
+        m_iov[0].iov_base = ctx.header;
+        m_iov[0].iov_len = ctx.header_len;
+
+        for(size_t i = 0 ; i < ctx.count ; i++)
+        {
+          if(frags[i].len)
+          {
+            m_iov[n].iov_base = &m_memory[frags[i].buffer * m_buffer_size];
+            m_iov[n].iov_len = frags[i].len;
+            n++;
+          }
+        }
+
+        d.family = ctx.k.family;
+        d.protocol = ctx.k.protocol;
+        d.iov = m_iov.data();
+        d.iovcnt = n;
+        d.len = ctx.header_len + ctx.total;
+
+        m_stats.datagrams++;
+
+        if(m_handler)
+        {
+          m_handler(d);
+        }
+      }
+
+      void ip_reassembler::release(uint32_t c)
+      {
+        context& ctx = m_contexts[c];
+        const fragment* frags = &m_fragments[c * m_max_fragments];
+        size_t bucket = frame_dedup::hash(&ctx.k, sizeof(key)) &
+          (m_buckets.size() - 1);
+        uint32_t* link = &m_buckets[bucket];
+        size_t slot = ctx.expires % wheel_size;
+
+        while(*link != c)
+        {
+          link = &m_contexts[*link].hash_next;
+        }
+        *link = ctx.hash_next;
+
+        if(ctx.wheel_prev != npos)
+        {
+          m_contexts[ctx.wheel_prev].wheel_next = ctx.wheel_next;
+        }
+        else
+        {
+          m_wheel_head[slot] = ctx.wheel_next;
+        }
+
+        if(ctx.wheel_next != npos)
+        {
+          m_contexts[ctx.wheel_next].wheel_prev = ctx.wheel_prev;
+        }
+        else
+        {
+          m_wheel_tail[slot] = ctx.wheel_prev;
+        }
+
+        for(size_t i = 0 ; i < ctx.count ; i++)
+        {
+          m_free_buffers.push_back(frags[i].buffer);
+        }
+        ctx.count = 0;
+
+        m_free_contexts.push_back(c);
+      }
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
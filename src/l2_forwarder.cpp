@@ -0,0 +1,469 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file l2_forwarder.cpp
+ * \brief Link-layer forwarder between two interfaces.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+#include <stdexcept>
+
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+
+#include "l2_forwarder.hpp"
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \brief Room kept before each frame to put back a VLAN tag.
+       */
+      static const size_t vlan_headroom = 4;
+
+      /**
+       * \brief Control message space per frame.
+       */
+      static const size_t control_size =
+        CMSG_SPACE(sizeof(packet_auxdata)) +
+        CMSG_SPACE(sizeof(struct timespec));
+
+      /**
+       * \brief Maximum number of batches per direction before giving the
+       * other direction a chance.
+       */
+      static const size_t batch_budget = 8;
+
+      /**
+       * \brief Returns time of a clock.
+       * \param clock clock identifier.
+       * \return time in nanoseconds.
+       */
+      static uint64_t clock_ns(clockid_t clock)
+      {
+        struct timespec ts;
+
+        clock_gettime(clock, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL +
+          static_cast<uint64_t>(ts.tv_nsec);
+      }
+
+      l2_forwarder::statistics::statistics()
+        : received(0),
+        forwarded(0),
+        dropped(0),
+        tx_dropped(0),
+        truncated(0),
+        batches(0),
+        elapsed_ns(0),
+        latency_samples(0),
+        latency_sum_ns(0),
+        latency_max_ns(0)
+      {
+      }
+
+      double l2_forwarder::statistics::pps() const
+      {
+        return elapsed_ns ? forwarded * 1e9 / elapsed_ns : 0;
+      }
+
+      double l2_forwarder::statistics::mean_latency_ns() const
+      {
+        return latency_samples ?
+          static_cast<double>(latency_sum_ns) / latency_samples : 0;
+      }
+
+      l2_forwarder::l2_forwarder(boost::asio::io_service& ios,
+          const std::string& ifname_a, const std::string& ifname_b,
+          size_t batch, size_t frame_size, bool promiscuous)
+        : m_ios(ios),
+        m_endpoint_a(ifname_a),
+        m_endpoint_b(ifname_b),
+        m_socket_a(ios, m_endpoint_a),
+        m_socket_b(ios, m_endpoint_b),
+        m_batch(batch),
+        m_frame_size(frame_size),
+        m_slot_size(0),
+        m_start_ns(0),
+        m_stop_ns(0),
+        m_running(false)
+      {
+        int ifindex_a = m_endpoint_a.ifindex();
+        int ifindex_b = m_endpoint_b.ifindex();
+
+        if(ifindex_a == 0 || ifindex_b == 0 || ifindex_a == ifindex_b)
+        {
+          throw std::invalid_argument("two distinct interfaces are needed");
+        }
+
+        if(batch == 0 || batch > 1024)
+        {
+          throw std::invalid_argument("batch must be 1 to 1024");
+        }
+
+        if(frame_size < sizeof(struct ether_header))
+        {
+          throw std::invalid_argument("invalid frame size");
+        }
+
+        // cache line aligned slots, with room to put back a VLAN tag
+        m_slot_size = (vlan_headroom + frame_size + 63) &
+          ~static_cast<size_t>(63);
+
+        setup(m_socket_a, ifindex_a, promiscuous);
+        setup(m_socket_b, ifindex_b, promiscuous);
+
+        m_paths[a_to_b].dir = a_to_b;
+        m_paths[a_to_b].rx = &m_socket_a;
+        m_paths[a_to_b].tx = &m_socket_b;
+        m_paths[b_to_a].dir = b_to_a;
+        m_paths[b_to_a].rx = &m_socket_b;
+        m_paths[b_to_a].tx = &m_socket_a;
+
+        prepare(m_paths[a_to_b]);
+        prepare(m_paths[b_to_a]);
+      }
+
+      void l2_forwarder::setup(asio::raw::ll::ll_protocol::socket& socket,
+          int ifindex, bool promiscuous)
+      {
+        boost::system::error_code ec;
+
+        // frames we send on this interface must not come back to us;
+        // before Linux 4.20 they are skipped by packet type instead
+        socket.set_option(ll_protocol::ignore_outgoing(true), ec);
+
+        socket.set_option(ll_protocol::auxdata(true));
+        socket.set_option(ll_protocol::timestamp_ns(true));
+
+        if(promiscuous)
+        {
+          // membership is dropped by the kernel when the socket is closed
+          socket.set_option(ll_protocol::add_membership(ifindex));
+        }
+      }
+
+      void l2_forwarder::prepare(path& p)
+      {
+        p.slots.assign(m_slot_size * m_batch, 0);
+        p.rx_iovecs.resize(m_batch);
+        p.rx_msgs.resize(m_batch);
+        p.names.resize(m_batch);
+        p.control.assign(control_size * m_batch, 0);
+        p.tx_iovecs.resize(m_batch);
+        p.tx_msgs.resize(m_batch);
+        p.rx_ns.resize(m_batch);
+
+        for(size_t i = 0 ; i < m_batch ; i++)
+        {
+          p.rx_iovecs[i].iov_base = &p.slots[i * m_slot_size + vlan_headroom];
+          p.rx_iovecs[i].iov_len = m_frame_size;
+
+          memset(&p.rx_msgs[i], 0x00, sizeof(struct mmsghdr));
+          p.rx_msgs[i].msg_hdr.msg_iov = &p.rx_iovecs[i];
+          p.rx_msgs[i].msg_hdr.msg_iovlen = 1;
+
+          // socket is bound to the output interface, no destination needed
+          memset(&p.tx_msgs[i], 0x00, sizeof(struct mmsghdr));
+          p.tx_msgs[i].msg_hdr.msg_iov = &p.tx_iovecs[i];
+          p.tx_msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+      }
+
+      void l2_forwarder::set_inspector(const inspector& f)
+      {
+        m_inspector = f;
+      }
+
+      void l2_forwarder::start()
+      {
+        if(m_running)
+        {
+          return;
+        }
+
+        m_paths[a_to_b].stats = statistics();
+        m_paths[b_to_a].stats = statistics();
+        m_error = boost::system::error_code();
+        m_start_ns = clock_ns(CLOCK_MONOTONIC);
+        m_running = true;
+
+        arm(m_paths[a_to_b]);
+        arm(m_paths[b_to_a]);
+      }
+
+      void l2_forwarder::stop()
+      {
+        if(!m_running)
+        {
+          return;
+        }
+
+        m_running = false;
+        m_stop_ns = clock_ns(CLOCK_MONOTONIC);
+        m_socket_a.cancel();
+        m_socket_b.cancel();
+      }
+
+      boost::system::error_code l2_forwarder::error() const
+      {
+        return m_error;
+      }
+
+      void l2_forwarder::fail(const boost::system::error_code& error)
+      {
+        m_error = error;
+        stop();
+      }
+
+      l2_forwarder::statistics l2_forwarder::stats(direction dir) const
+      {
+        statistics s = m_paths[dir].stats;
+
+        s.elapsed_ns = (m_running ? clock_ns(CLOCK_MONOTONIC) : m_stop_ns) -
+          m_start_ns;
+        return s;
+      }
+
+      size_t l2_forwarder::frame_size() const
+      {
+        return m_frame_size;
+      }
+
+      void l2_forwarder::arm(path& p)
+      {
+        p.rx->async_wait(boost::asio::socket_base::wait_read,
+            make_allocating_handler(p.memory,
+              boost::bind(&l2_forwarder::handle_readable, this, &p,
+                boost::asio::placeholders::error)));
+      }
+
+      void l2_forwarder::handle_readable(path* p,
+          const boost::system::error_code& error)
+      {
+        boost::system::error_code ec;
+        size_t n = 0;
+
+        if(error == boost::asio::error::operation_aborted || !m_running)
+        {
+          return;
+        }
+
+        if(error)
+        {
+          // other users of the IO service go on
+          fail(error);
+          return;
+        }
+
+        while(forward_batch(*p, ec))
+        {
+          if(++n == batch_budget)
+          {
+            // still busy: come back after the other direction had a turn
+            m_ios.post(make_allocating_handler(p->memory,
+                  boost::bind(&l2_forwarder::handle_readable, this, p,
+                    boost::system::error_code())));
+            return;
+          }
+        }
+
+        if(ec)
+        {
+          fail(ec);
+          return;
+        }
+
+        arm(*p);
+      }
+
+      bool l2_forwarder::forward_batch(path& p,
+          boost::system::error_code& error)
+      {
+        int ret = 0;
+        size_t count = 0;
+
+        for(size_t i = 0 ; i < m_batch ; i++)
+        {
+          // updated by the kernel on each receive
+          p.rx_msgs[i].msg_hdr.msg_name = &p.names[i];
+          p.rx_msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_ll);
+          p.rx_msgs[i].msg_hdr.msg_control = &p.control[i * control_size];
+          p.rx_msgs[i].msg_hdr.msg_controllen = control_size;
+        }
+
+        ret = recvmmsg(p.rx->native_handle(), p.rx_msgs.data(),
+            static_cast<unsigned int>(m_batch), MSG_DONTWAIT, nullptr);
+        if(ret < 0)
+        {
+          if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ||
+              errno == ENETDOWN)
+          {
+            return false;
+          }
+
+          error = boost::system::error_code(errno,
+              boost::system::system_category());
+          return false;
+        }
+
+        p.stats.batches++;
+
+        for(int i = 0 ; i < ret ; i++)
+        {
+          struct msghdr& msg = p.rx_msgs[i].msg_hdr;
+          char* data = static_cast<char*>(p.rx_iovecs[i].iov_base);
+          size_t len = p.rx_msgs[i].msg_len;
+          uint64_t rx_ns = 0;
+
+          if(p.names[i].sll_pkttype == PACKET_OUTGOING)
+          {
+            continue;
+          }
+
+          p.stats.received++;
+
+          if(msg.msg_flags & MSG_TRUNC)
+          {
+            p.stats.truncated++;
+            continue;
+          }
+
+          for(struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg) ; cmsg != nullptr ;
+              cmsg = CMSG_NXTHDR(&msg, cmsg))
+          {
+            if(cmsg->cmsg_level == SOL_SOCKET &&
+                cmsg->cmsg_type == SO_TIMESTAMPNS)
+            {
+              struct timespec ts;
+
+              memcpy(&ts, CMSG_DATA(cmsg), sizeof(struct timespec));
+              rx_ns = static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL +
+                static_cast<uint64_t>(ts.tv_nsec);
+            }
+            else if(cmsg->cmsg_level == SOL_PACKET &&
+                cmsg->cmsg_type == PACKET_AUXDATA &&
+                len >= 2 * ETH_ALEN)
+            {
+              packet_auxdata aux;
+              uint16_t tag[2];
+
+              memcpy(&aux, CMSG_DATA(cmsg), sizeof(packet_auxdata));
+
+              if(!(aux.tp_status & TP_STATUS_VLAN_VALID))
+              {
+                continue;
+              }
+
+              // put back the tag stripped by the NIC after the addresses
+              tag[0] = htons((aux.tp_status & TP_STATUS_VLAN_TPID_VALID) ?
+                  aux.tp_vlan_tpid : ETH_P_8021Q);
+              tag[1] = htons(aux.tp_vlan_tci);
+              memmove(data - vlan_headroom, data, 2 * ETH_ALEN);
+              data -= vlan_headroom;
+              memcpy(data + 2 * ETH_ALEN, tag, sizeof(tag));
+              len += vlan_headroom;
+            }
+          }
+
+          if(m_inspector)
+          {
+            const char* end = &p.slots[(i + 1) * m_slot_size];
+
+            // a frame grown past its slot is dropped too
+            if(m_inspector(p.dir, data, len) == drop ||
+                len > static_cast<size_t>(end - data))
+            {
+              p.stats.dropped++;
+              continue;
+            }
+          }
+
+          p.tx_iovecs[count].iov_base = data;
+          p.tx_iovecs[count].iov_len = len;
+          p.rx_ns[count] = rx_ns;
+          count++;
+        }
+
+        if(count)
+        {
+          send_batch(p, count);
+        }
+
+        return static_cast<size_t>(ret) == m_batch;
+      }
+
+      void l2_forwarder::send_batch(path& p, size_t count)
+      {
+        size_t sent = 0;
+
+        while(sent < count)
+        {
+          int ret = sendmmsg(p.tx->native_handle(), &p.tx_msgs[sent],
+              static_cast<unsigned int>(count - sent), MSG_DONTWAIT);
+          uint64_t now = 0;
+
+          if(ret < 0)
+          {
+            if(errno == EINTR)
+            {
+              continue;
+            }
+
+            if(errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+            {
+              // output queue full: drop the rest rather than stall input
+              p.stats.tx_dropped += count - sent;
+              return;
+            }
+
+            // this frame is rejected (i.e. larger than MTU), go on
+            p.stats.tx_dropped++;
+            sent++;
+            continue;
+          }
+
+          now = clock_ns(CLOCK_REALTIME);
+
+          for(size_t i = sent ; i < sent + static_cast<size_t>(ret) ; i++)
+          {
+            uint64_t latency = 0;
+
+            if(p.rx_ns[i] == 0 || now < p.rx_ns[i])
+            {
+              continue;
+            }
+
+            latency = now - p.rx_ns[i];
+            p.stats.latency_samples++;
+            p.stats.latency_sum_ns += latency;
+            if(latency > p.stats.latency_max_ns)
+            {
+              p.stats.latency_max_ns = latency;
+            }
+          }
+
+          p.stats.forwarded += static_cast<size_t>(ret);
+          sent += static_cast<size_t>(ret);
+        }
+      }
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
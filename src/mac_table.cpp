@@ -0,0 +1,450 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file mac_table.cpp
+ * \brief Concurrent MAC learning table.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <cstdlib>
+#include <cstring>
+
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "mac_table.hpp"
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \brief Slot never used, ends a probe chain.
+       */
+      static const uint64_t empty_slot = 0;
+
+      /**
+       * \brief Slot of a removed entry, probe chains go on (address 0 is
+       * never learnt).
+       */
+      static const uint64_t tombstone = 1;
+
+      /**
+       * \brief Slot not found.
+       */
+      static const size_t npos = ~static_cast<size_t>(0);
+
+      /**
+       * \brief Returns whether a slot holds an entry.
+       * \param w slot content.
+       * \return true for an entry.
+       */
+      static bool live(uint64_t w)
+      {
+        return w != empty_slot && w != tombstone;
+      }
+
+      mac_table::mac_table(size_t capacity, size_t shards)
+        : m_slots(nullptr),
+        m_seen(nullptr),
+        m_shards(nullptr),
+        m_shard_count(shards),
+        m_groups(1),
+        m_shard_max(0)
+      {
+        size_t per_shard = 0;
+        size_t slots = group_size;
+        void* mem = nullptr;
+
+        if(shards == 0 || (shards & (shards - 1)))
+        {
+          throw std::invalid_argument("shards must be a power of 2");
+        }
+
+        // at most 3/4 full so that probe chains stay short
+        per_shard = (capacity * 4 / 3 + shards - 1) / shards;
+        while(slots < per_shard)
+        {
+          slots <<= 1;
+        }
+        m_groups = slots / group_size;
+        m_shard_max = static_cast<uint32_t>(slots * 3 / 4);
+
+        if(posix_memalign(&mem, 64, shards * slots * sizeof(uint64_t)) != 0)
+        {
+          throw std::bad_alloc();
+        }
+        m_slots = static_cast<uint64_t*>(mem);
+        memset(m_slots, 0x00, shards * slots * sizeof(uint64_t));
+
+        if(posix_memalign(&mem, 64, shards * sizeof(shard)) != 0)
+        {
+          free(m_slots);
+          throw std::bad_alloc();
+        }
+        m_shards = static_cast<shard*>(mem);
+
+        for(size_t i = 0 ; i < shards ; i++)
+        {
+          new(&m_shards[i]) shard;
+          m_shards[i].lock.clear();
+          m_shards[i].count = 0;
+          m_shards[i].tombstones = 0;
+        }
+
+        try
+        {
+          m_seen = new uint32_t[shards * slots]();
+        }
+        catch(...)
+        {
+          free(m_shards);
+          free(m_slots);
+          throw;
+        }
+      }
+
+      mac_table::~mac_table()
+      {
+        delete[] m_seen;
+
+        for(size_t i = 0 ; i < m_shard_count ; i++)
+        {
+          m_shards[i].~shard();
+        }
+        free(m_shards);
+        free(m_slots);
+      }
+
+      bool mac_table::lookup(uint64_t k, uint16_t& port) const
+      {
+        uint64_t h = hash(k);
+        size_t s = (h >> 40) & (m_shard_count - 1);
+        size_t i = 0;
+        uint64_t w = 0;
+
+        // multicast and broadcast are flooded, never learnt
+        if(!learnable(k))
+        {
+          return false;
+        }
+
+        i = find(s, h, k << 16);
+        if(i == npos)
+        {
+          return false;
+        }
+
+        // slot may have been reused since find() compared it
+        w = __atomic_load_n(&m_slots[i], __ATOMIC_ACQUIRE);
+        if((w >> 16) != k)
+        {
+          return false;
+        }
+
+        port = static_cast<uint16_t>(w & 0xffff);
+        return true;
+      }
+
+      bool mac_table::learn(uint64_t k, uint16_t port, uint32_t now)
+      {
+        uint64_t h = hash(k);
+        size_t s = (h >> 40) & (m_shard_count - 1);
+        uint64_t entry = k << 16 | port;
+        size_t i = 0;
+        bool ret = false;
+
+        if(!learnable(k))
+        {
+          return false;
+        }
+
+        // known on the same port: refresh without lock, and without
+        // dirtying the cache line more than once per time unit
+        i = find(s, h, k << 16);
+        if(i != npos && __atomic_load_n(&m_slots[i], __ATOMIC_RELAXED) ==
+            entry)
+        {
+          if(__atomic_load_n(&m_seen[i], __ATOMIC_RELAXED) != now)
+          {
+            __atomic_store_n(&m_seen[i], now, __ATOMIC_RELAXED);
+          }
+          return true;
+        }
+
+        // new address or station moved to another port
+        lock(s);
+        ret = insert(s, h, entry, now);
+        unlock(s);
+        return ret;
+      }
+
+      bool mac_table::remove(uint64_t k)
+      {
+        uint64_t h = hash(k);
+        size_t s = (h >> 40) & (m_shard_count - 1);
+        size_t i = 0;
+
+        if(!learnable(k))
+        {
+          return false;
+        }
+
+        lock(s);
+
+        i = find(s, h, k << 16);
+        if(i != npos)
+        {
+          __atomic_store_n(&m_slots[i], tombstone, __ATOMIC_RELEASE);
+          m_shards[s].count--;
+          m_shards[s].tombstones++;
+        }
+
+        unlock(s);
+        return i != npos;
+      }
+
+      size_t mac_table::age(uint32_t now, uint32_t max_age)
+      {
+        size_t ret = 0;
+
+        for(size_t s = 0 ; s < m_shard_count ; s++)
+        {
+          ret += age_shard(s, now, max_age);
+        }
+        return ret;
+      }
+
+      size_t mac_table::age_shard(size_t shard_index, uint32_t now,
+          uint32_t max_age)
+      {
+        size_t s = shard_index & (m_shard_count - 1);
+        size_t slots = m_groups * group_size;
+        uint64_t* base = m_slots + s * slots;
+        uint32_t* seen = m_seen + s * slots;
+        size_t ret = 0;
+
+        lock(s);
+
+        for(size_t i = 0 ; i < slots ; i++)
+        {
+          // unsigned difference copes with time wrapping around
+          if(live(base[i]) && now - __atomic_load_n(&seen[i],
+                __ATOMIC_RELAXED) > max_age)
+          {
+            __atomic_store_n(&base[i], tombstone, __ATOMIC_RELEASE);
+            ret++;
+          }
+        }
+
+        m_shards[s].count -= static_cast<uint32_t>(ret);
+        m_shards[s].tombstones += static_cast<uint32_t>(ret);
+
+        // tombstones lengthen every probe chain of the shard
+        if(m_shards[s].tombstones > slots / 4)
+        {
+          rebuild(s);
+        }
+
+        unlock(s);
+        return ret;
+      }
+
+      size_t mac_table::size() const
+      {
+        size_t ret = 0;
+
+        for(size_t s = 0 ; s < m_shard_count ; s++)
+        {
+          ret += m_shards[s].count.load(std::memory_order_relaxed);
+        }
+        return ret;
+      }
+
+      size_t mac_table::shards() const
+      {
+        return m_shard_count;
+      }
+
+      size_t mac_table::find(size_t s, uint64_t h, uint64_t word) const
+      {
+        const uint64_t* base = m_slots + s * m_groups * group_size;
+        size_t g = (h >> 20) & (m_groups - 1);
+#if defined(__SSE2__)
+        const __m128i mask = _mm_set1_epi64x(
+            static_cast<long long>(~static_cast<uint64_t>(0xffff)));
+        const __m128i want = _mm_set1_epi64x(static_cast<long long>(word));
+        const __m128i zero = _mm_setzero_si128();
+#endif
+
+        for(size_t n = 0 ; n < m_groups ; n++)
+        {
+          const uint64_t* grp = base + g * group_size;
+          unsigned int match = 0;
+          unsigned int empty = 0;
+
+#if defined(__SSE2__)
+          // aligned 16-byte loads: each 64-bit entry is read atomically
+          for(size_t i = 0 ; i < group_size / 2 ; i++)
+          {
+            __m128i v = _mm_load_si128(reinterpret_cast<const __m128i*>(
+                  grp + 2 * i));
+            __m128i eq = _mm_cmpeq_epi32(_mm_and_si128(v, mask), want);
+            __m128i ez = _mm_cmpeq_epi32(v, zero);
+
+            // 64-bit equality from 32-bit: both halves must match
+            eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq,
+                  _MM_SHUFFLE(2, 3, 0, 1)));
+            ez = _mm_and_si128(ez, _mm_shuffle_epi32(ez,
+                  _MM_SHUFFLE(2, 3, 0, 1)));
+            match |= static_cast<unsigned int>(_mm_movemask_pd(
+                  _mm_castsi128_pd(eq))) << (2 * i);
+            empty |= static_cast<unsigned int>(_mm_movemask_pd(
+                  _mm_castsi128_pd(ez))) << (2 * i);
+          }
+#else
+          for(size_t i = 0 ; i < group_size ; i++)
+          {
+            uint64_t w = __atomic_load_n(&grp[i], __ATOMIC_ACQUIRE);
+
+            match |= static_cast<unsigned int>(
+                (w & ~static_cast<uint64_t>(0xffff)) == word) << i;
+            empty |= static_cast<unsigned int>(w == empty_slot) << i;
+          }
+#endif
+
+          // entries are never placed after an empty slot of their chain
+          if(match)
+          {
+            return static_cast<size_t>(grp - m_slots) +
+              static_cast<size_t>(__builtin_ctz(match));
+          }
+
+          if(empty)
+          {
+            return npos;
+          }
+
+          g = (g + 1) & (m_groups - 1);
+        }
+
+        return npos;
+      }
+
+      bool mac_table::insert(size_t s, uint64_t h, uint64_t entry,
+          uint32_t now)
+      {
+        uint64_t* base = m_slots + s * m_groups * group_size;
+        size_t g = (h >> 20) & (m_groups - 1);
+        uint64_t* slot = nullptr;
+        bool end = false;
+
+        for(size_t n = 0 ; n < m_groups && !end ; n++)
+        {
+          uint64_t* grp = base + g * group_size;
+
+          for(size_t i = 0 ; i < group_size ; i++)
+          {
+            uint64_t w = grp[i];
+
+            if(live(w) && (w >> 16) == (entry >> 16))
+            {
+              // station moved
+              m_seen[&grp[i] - m_slots] = now;
+              __atomic_store_n(&grp[i], entry, __ATOMIC_RELEASE);
+              return true;
+            }
+
+            if(!live(w) && slot == nullptr)
+            {
+              slot = &grp[i];
+            }
+
+            if(w == empty_slot)
+            {
+              end = true;
+              break;
+            }
+          }
+
+          g = (g + 1) & (m_groups - 1);
+        }
+
+        if(slot == nullptr || m_shards[s].count >= m_shard_max)
+        {
+          return false;
+        }
+
+        if(*slot == tombstone)
+        {
+          m_shards[s].tombstones--;
+        }
+
+        __atomic_store_n(&m_seen[slot - m_slots], now, __ATOMIC_RELAXED);
+        __atomic_store_n(slot, entry, __ATOMIC_RELEASE);
+        m_shards[s].count++;
+        return true;
+      }
+
+      void mac_table::rebuild(size_t s)
+      {
+        size_t slots = m_groups * group_size;
+        uint64_t* base = m_slots + s * slots;
+        uint32_t* seen = m_seen + s * slots;
+        std::vector<std::pair<uint64_t, uint32_t>> entries;
+
+        entries.reserve(m_shards[s].count);
+
+        for(size_t i = 0 ; i < slots ; i++)
+        {
+          if(live(base[i]))
+          {
+            entries.push_back(std::make_pair(base[i], seen[i]));
+          }
+          // lookups running meanwhile may miss and flood, as for an
+          // unknown address
+          __atomic_store_n(&base[i], empty_slot, __ATOMIC_RELEASE);
+        }
+
+        m_shards[s].count = 0;
+        m_shards[s].tombstones = 0;
+
+        for(size_t i = 0 ; i < entries.size() ; i++)
+        {
+          insert(s, hash(entries[i].first >> 16), entries[i].first,
+              entries[i].second);
+        }
+      }
+
+      void mac_table::lock(size_t s)
+      {
+        while(m_shards[s].lock.test_and_set(std::memory_order_acquire))
+        {
+#if defined(__x86_64__) || defined(__i386__)
+          _mm_pause();
+#endif
+        }
+      }
+
+      void mac_table::unlock(size_t s)
+      {
+        m_shards[s].lock.clear(std::memory_order_release);
+      }
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
@@ -0,0 +1,221 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file socket_profile.cpp
+ * \brief Packet socket tuning profiles.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <cerrno>
+
+#include <boost/system/system_error.hpp>
+
+#include "socket_profile.hpp"
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \brief Sets an option, throws unless the kernel does not know it.
+       * \param socket socket.
+       * \param option option.
+       * \param what name for the exception.
+       * \param privileged whether the option is also skipped when it
+       * needs a capability the process lacks.
+       */
+      template <typename Option>
+      static void set_optional(asio::raw::ll::ll_protocol::socket& socket,
+          const Option& option, const char* what, bool privileged = false)
+      {
+        boost::system::error_code ec;
+
+        socket.set_option(option, ec);
+        if(ec && ec.value() != ENOPROTOOPT &&
+            !(privileged && ec.value() == EPERM))
+        {
+          throw boost::system::system_error(ec, what);
+        }
+      }
+
+      /**
+       * \brief Sets a buffer size, forced if allowed.
+       * \param socket socket.
+       * \param size size in bytes.
+       */
+      template <typename Forced, typename Limited>
+      static void set_buffer(asio::raw::ll::ll_protocol::socket& socket,
+          int size)
+      {
+        boost::system::error_code ec;
+
+        socket.set_option(Forced(size), ec);
+        if(ec == boost::system::errc::operation_not_permitted)
+        {
+          // capped to net.core.[rw]mem_max
+          socket.set_option(Limited(size));
+        }
+        else if(ec)
+        {
+          throw boost::system::system_error(ec, "buffer size");
+        }
+      }
+
+      socket_profile::socket_profile()
+        : m_receive_buffer(0),
+        m_send_buffer(0),
+        m_promiscuous(false),
+        m_ignore_outgoing(false),
+        m_qdisc_bypass(false),
+        m_busy_poll(0)
+      {
+      }
+
+      socket_profile socket_profile::capture()
+      {
+        socket_profile ret;
+
+        // 32 MB hold about 20 ms of minimum size frames at 10 Gbit/s
+        ret.set_receive_buffer(32 * 1024 * 1024);
+        ret.set_promiscuous(true);
+        return ret;
+      }
+
+      socket_profile socket_profile::low_latency()
+      {
+        socket_profile ret;
+
+        ret.set_ignore_outgoing(true);
+        ret.set_busy_poll(50);
+        return ret;
+      }
+
+      socket_profile socket_profile::generator()
+      {
+        socket_profile ret;
+
+        ret.set_send_buffer(4 * 1024 * 1024);
+        ret.set_ignore_outgoing(true);
+        ret.set_qdisc_bypass(true);
+        return ret;
+      }
+
+      socket_profile& socket_profile::set_receive_buffer(int size)
+      {
+        m_receive_buffer = size;
+        return *this;
+      }
+
+      socket_profile& socket_profile::set_send_buffer(int size)
+      {
+        m_send_buffer = size;
+        return *this;
+      }
+
+      socket_profile& socket_profile::set_promiscuous(bool enable)
+      {
+        m_promiscuous = enable;
+        return *this;
+      }
+
+      socket_profile& socket_profile::set_ignore_outgoing(bool enable)
+      {
+        m_ignore_outgoing = enable;
+        return *this;
+      }
+
+      socket_profile& socket_profile::set_qdisc_bypass(bool enable)
+      {
+        m_qdisc_bypass = enable;
+        return *this;
+      }
+
+      socket_profile& socket_profile::set_busy_poll(int usec)
+      {
+        m_busy_poll = usec;
+        return *this;
+      }
+
+      void socket_profile::apply(asio::raw::ll::ll_protocol::socket& socket,
+          const asio::raw::ll::ll_protocol::endpoint& endpoint) const
+      {
+        if(m_receive_buffer > 0)
+        {
+          set_buffer<ll_protocol::receive_buffer_force,
+            boost::asio::socket_base::receive_buffer_size>(socket,
+                m_receive_buffer);
+        }
+
+        if(m_send_buffer > 0)
+        {
+          set_buffer<ll_protocol::send_buffer_force,
+            boost::asio::socket_base::send_buffer_size>(socket,
+                m_send_buffer);
+        }
+
+        if(m_ignore_outgoing)
+        {
+          set_optional(socket, ll_protocol::ignore_outgoing(true),
+              "PACKET_IGNORE_OUTGOING");
+        }
+
+        if(m_qdisc_bypass)
+        {
+          socket.set_option(ll_protocol::qdisc_bypass(true));
+        }
+
+        if(m_busy_poll > 0)
+        {
+          // raising it above net.core.busy_read needs CAP_NET_ADMIN
+          set_optional(socket, ll_protocol::busy_poll(m_busy_poll),
+              "SO_BUSY_POLL", true);
+        }
+
+        if(m_promiscuous && endpoint.ifindex() != 0)
+        {
+          // membership is dropped by the kernel when the socket is closed
+          socket.set_option(ll_protocol::add_membership(endpoint.ifindex()));
+        }
+      }
+
+      int socket_profile::receive_buffer() const
+      {
+        return m_receive_buffer;
+      }
+
+      int socket_profile::send_buffer() const
+      {
+        return m_send_buffer;
+      }
+
+      bool socket_profile::promiscuous() const
+      {
+        return m_promiscuous;
+      }
+
+      bool socket_profile::ignore_outgoing() const
+      {
+        return m_ignore_outgoing;
+      }
+
+      bool socket_profile::qdisc_bypass() const
+      {
+        return m_qdisc_bypass;
+      }
+
+      int socket_profile::busy_poll() const
+      {
+        return m_busy_poll;
+      }
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
@@ -0,0 +1,468 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file traffic_generator.cpp
+ * \brief Rate-paced link-layer traffic generator.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+#include <sys/socket.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+#include "checksum.hpp"
+#include "traffic_generator.hpp"
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \brief Returns CLOCK_MONOTONIC time.
+       * \return time in nanoseconds.
+       */
+      static uint64_t monotonic_ns()
+      {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL +
+          static_cast<uint64_t>(ts.tv_nsec);
+      }
+
+      /**
+       * \brief Waits before trying again: spins briefly, then leaves the
+       * CPU to other threads.
+       * \param attempt number of attempts so far.
+       */
+      static void backoff(size_t attempt)
+      {
+        if(attempt < 64)
+        {
+#if defined(__x86_64__) || defined(__i386__)
+          _mm_pause();
+#endif
+        }
+        else if(attempt < 1024)
+        {
+          std::this_thread::yield();
+        }
+        else
+        {
+          std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+      }
+
+      /**
+       * \brief Reads a big-endian integer.
+       * \param p data.
+       * \param width width in bytes.
+       * \return value.
+       */
+      static uint64_t load_be(const char* p, size_t width)
+      {
+        uint64_t v = 0;
+
+        for(size_t i = 0 ; i < width ; i++)
+        {
+          v = (v << 8) | static_cast<uint8_t>(p[i]);
+        }
+        return v;
+      }
+
+      /**
+       * \brief Writes a big-endian integer.
+       * \param p data.
+       * \param width width in bytes.
+       * \param v value.
+       */
+      static void store_be(char* p, size_t width, uint64_t v)
+      {
+        for(size_t i = width ; i > 0 ; i--)
+        {
+          p[i - 1] = static_cast<char>(v & 0xff);
+          v >>= 8;
+        }
+      }
+
+      traffic_generator::field::field(size_t offset, size_t width,
+          uint64_t step, uint64_t count)
+        : m_offset(offset),
+        m_width(width),
+        m_step(step),
+        m_count(count),
+        m_base(0)
+      {
+        if(width == 0 || width > 8)
+        {
+          throw std::invalid_argument("field width must be 1 to 8 bytes");
+        }
+      }
+
+      traffic_generator::field& traffic_generator::field::add_checksum(
+          size_t csum_offset, size_t start, bool udp)
+      {
+        checksum_ref ref;
+
+        if(m_offset < start)
+        {
+          throw std::invalid_argument(
+              "field is not covered by the checksum");
+        }
+
+        ref.offset = csum_offset;
+        ref.odd = (m_offset - start) & 1;
+        ref.udp = udp;
+        m_checksums.push_back(ref);
+        return *this;
+      }
+
+      traffic_generator::statistics::statistics()
+        : frames(0),
+        bytes(0),
+        batches(0),
+        retries(0),
+        elapsed_ns(0),
+        max_late_ns(0),
+        late_mean(0),
+        late_m2(0)
+      {
+      }
+
+      double traffic_generator::statistics::pps() const
+      {
+        return elapsed_ns ? frames * 1e9 / elapsed_ns : 0;
+      }
+
+      double traffic_generator::statistics::bps() const
+      {
+        return elapsed_ns ? bytes * 8e9 / elapsed_ns : 0;
+      }
+
+      double traffic_generator::statistics::jitter_ns() const
+      {
+        return batches > 1 ? std::sqrt(late_m2 / (batches - 1)) : 0;
+      }
+
+      traffic_generator::traffic_generator(boost::asio::io_service& ios,
+          const std::string& ifname)
+        : m_endpoint(ifname, 0),
+        m_socket(ios, m_endpoint),
+        m_batch(32),
+        m_pps(0),
+        m_bps(0),
+        m_tsc_per_ns(0),
+        m_tsc_base(0),
+        m_ns_base(0),
+        m_running(true)
+      {
+        // protocol 0 on the bound endpoint: transmit only, the kernel
+        // does not queue any received frame to this socket
+
+#if defined(__x86_64__) || defined(__i386__)
+        unsigned int eax = 0;
+        unsigned int ebx = 0;
+        unsigned int ecx = 0;
+        unsigned int edx = 0;
+
+        // invariant TSC: constant rate across P-/C-states
+        if(__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) &&
+            (edx & (1 << 8)))
+        {
+          uint64_t ns0 = monotonic_ns();
+          uint64_t tsc0 = __rdtsc();
+          uint64_t ns1 = 0;
+
+          do
+          {
+            ns1 = monotonic_ns();
+          }
+          while(ns1 - ns0 < 10000000);
+
+          m_tsc_per_ns = static_cast<double>(__rdtsc() - tsc0) /
+            (ns1 - ns0);
+          m_tsc_base = tsc0;
+          m_ns_base = ns0;
+        }
+#endif
+      }
+
+      void traffic_generator::set_template(const char* data,
+          size_t data_len)
+      {
+        if(data_len < sizeof(struct ether_header))
+        {
+          throw std::invalid_argument("template too small");
+        }
+
+        m_template.assign(data, data + data_len);
+        m_fields.clear();
+      }
+
+      void traffic_generator::add_field(const field& f)
+      {
+        field copy = f;
+
+        if(f.m_offset + f.m_width > m_template.size())
+        {
+          throw std::invalid_argument("field out of template");
+        }
+
+        for(const field::checksum_ref& ref : f.m_checksums)
+        {
+          if(ref.offset + 2 > m_template.size())
+          {
+            throw std::invalid_argument("checksum out of template");
+          }
+        }
+
+        copy.m_base = load_be(m_template.data() + f.m_offset, f.m_width);
+        m_fields.push_back(copy);
+      }
+
+      void traffic_generator::set_rate_pps(double pps)
+      {
+        m_pps = pps;
+        m_bps = 0;
+      }
+
+      void traffic_generator::set_rate_bps(double bps)
+      {
+        m_bps = bps;
+        m_pps = 0;
+      }
+
+      void traffic_generator::set_batch(size_t batch)
+      {
+        if(batch == 0 || batch > 1024)
+        {
+          throw std::invalid_argument("batch must be 1 to 1024");
+        }
+
+        m_batch = batch;
+      }
+
+      void traffic_generator::prepare()
+      {
+        size_t len = m_template.size();
+
+        m_slots.resize(len * m_batch);
+        m_iovecs.resize(m_batch);
+        m_msgs.resize(m_batch);
+
+        for(size_t i = 0 ; i < m_batch ; i++)
+        {
+          char* slot = m_slots.data() + i * len;
+
+          memcpy(slot, m_template.data(), len);
+          m_iovecs[i].iov_base = slot;
+          m_iovecs[i].iov_len = len;
+
+          memset(&m_msgs[i], 0x00, sizeof(struct mmsghdr));
+          // socket is bound to the interface, no destination needed
+          m_msgs[i].msg_hdr.msg_iov = &m_iovecs[i];
+          m_msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+      }
+
+      void traffic_generator::mutate(char* slot, uint64_t n)
+      {
+        for(const field& f : m_fields)
+        {
+          char* p = slot + f.m_offset;
+          char old_data[8];
+          char new_data[8];
+          uint64_t idx = f.m_count ? n % f.m_count : n;
+
+          store_be(new_data, f.m_width, f.m_base + idx * f.m_step);
+          memcpy(old_data, p, f.m_width);
+
+          for(const field::checksum_ref& ref : f.m_checksums)
+          {
+            char* c = slot + ref.offset;
+            uint16_t csum = static_cast<uint16_t>(load_be(c, 2));
+
+            if(ref.udp && csum == 0)
+            {
+              continue;
+            }
+
+            csum = checksum::update(csum, old_data, new_data, f.m_width,
+                ref.odd);
+
+            if(ref.udp && csum == 0)
+            {
+              // RFC 768: computed zero is transmitted as all ones
+              csum = 0xffff;
+            }
+
+            store_be(c, 2, csum);
+          }
+
+          memcpy(p, new_data, f.m_width);
+        }
+      }
+
+      uint64_t traffic_generator::now() const
+      {
+#if defined(__x86_64__) || defined(__i386__)
+        if(m_tsc_per_ns > 0)
+        {
+          return m_ns_base + static_cast<uint64_t>(
+              (__rdtsc() - m_tsc_base) / m_tsc_per_ns);
+        }
+#endif
+        return monotonic_ns();
+      }
+
+      const traffic_generator::statistics& traffic_generator::run(
+          uint64_t count)
+      {
+        const size_t len = m_template.size();
+        const int fd = m_socket.native_handle();
+        double interval = 0;
+        uint64_t start = 0;
+        uint64_t n = 0;
+
+        if(m_template.empty())
+        {
+          throw std::logic_error("no template set");
+        }
+
+        prepare();
+        m_stats = statistics();
+
+        // interval between two full batches
+        if(m_pps > 0)
+        {
+          interval = m_batch * 1e9 / m_pps;
+        }
+        else if(m_bps > 0)
+        {
+          interval = m_batch * len * 8e9 / m_bps;
+        }
+
+        start = now();
+
+        while(m_running && (count == 0 || n < count))
+        {
+          size_t nb = m_batch;
+          size_t sent = 0;
+          size_t attempts = 0;
+
+          if(count && count - n < nb)
+          {
+            nb = static_cast<size_t>(count - n);
+          }
+
+          for(size_t i = 0 ; i < nb ; i++)
+          {
+            mutate(m_slots.data() + i * len, n + i);
+          }
+
+          if(interval > 0)
+          {
+            uint64_t deadline = start + static_cast<uint64_t>(
+                m_stats.batches * interval);
+            uint64_t t = now();
+            double late = 0;
+            double delta = 0;
+
+            // a low rate puts the deadline seconds away: keep stop() quick
+            while(t < deadline && m_running)
+            {
+#if defined(__x86_64__) || defined(__i386__)
+              _mm_pause();
+#endif
+              t = now();
+            }
+
+            if(t < deadline)
+            {
+              break;
+            }
+
+            late = static_cast<double>(t - deadline);
+            if(t - deadline > m_stats.max_late_ns)
+            {
+              m_stats.max_late_ns = t - deadline;
+            }
+
+            // Welford online variance
+            delta = late - m_stats.late_mean;
+            m_stats.late_mean += delta / (m_stats.batches + 1);
+            m_stats.late_m2 += delta * (late - m_stats.late_mean);
+          }
+
+          while(sent < nb && m_running)
+          {
+            int ret = sendmmsg(fd, &m_msgs[sent],
+                static_cast<unsigned int>(nb - sent), 0);
+
+            if(ret < 0)
+            {
+              if(errno == ENOBUFS || errno == EAGAIN || errno == EINTR)
+              {
+                // qdisc or device queue full: retry the remaining frames
+                m_stats.retries++;
+                backoff(attempts++);
+                continue;
+              }
+
+              throw boost::system::system_error(
+                  boost::system::error_code(errno,
+                    boost::system::system_category()), "sendmmsg");
+            }
+
+            if(static_cast<size_t>(ret) < nb - sent)
+            {
+              m_stats.retries++;
+            }
+            sent += static_cast<size_t>(ret);
+            attempts = 0;
+          }
+
+          // stopped with the queue still full: only count what went out
+          n += sent;
+          m_stats.frames += sent;
+          m_stats.bytes += sent * len;
+          m_stats.batches++;
+        }
+
+        m_stats.elapsed_ns = now() - start;
+        return m_stats;
+      }
+
+      void traffic_generator::stop()
+      {
+        m_running = false;
+      }
+
+      const traffic_generator::statistics& traffic_generator::stats() const
+      {
+        return m_stats;
+      }
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
@@ -0,0 +1,552 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file tx_engine.cpp
+ * \brief Multi-socket transmit engine.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <cerrno>
+#include <cstring>
+
+#include <chrono>
+#include <functional>
+#include <stdexcept>
+
+#include <net/ethernet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "frame_dedup.hpp"
+#include "tx_engine.hpp"
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \brief Flow hash input, no padding so that it can be hashed as
+       * bytes.
+       */
+      struct flow_key
+      {
+        /**
+         * \brief Source address, or MAC addresses for non-IP frames.
+         */
+        uint8_t src[16];
+
+        /**
+         * \brief Destination address.
+         */
+        uint8_t dst[16];
+
+        /**
+         * \brief Source and destination ports.
+         */
+        uint8_t ports[4];
+
+        /**
+         * \brief EtherType.
+         */
+        uint16_t type;
+
+        /**
+         * \brief Protocol.
+         */
+        uint8_t protocol;
+
+        /**
+         * \brief Padding, zero.
+         */
+        uint8_t pad;
+      };
+
+      /**
+       * \brief Reads a big-endian 16-bit integer.
+       * \param p data.
+       * \return value.
+       */
+      static uint16_t read16(const char* p)
+      {
+        const uint8_t* b = reinterpret_cast<const uint8_t*>(p);
+
+        return static_cast<uint16_t>(b[0] << 8 | b[1]);
+      }
+
+      /**
+       * \brief Whether a protocol has ports right after the IP header.
+       * \param protocol protocol.
+       * \return true for TCP, UDP and SCTP.
+       */
+      static bool has_ports(uint8_t protocol)
+      {
+        return protocol == IPPROTO_TCP || protocol == IPPROTO_UDP ||
+          protocol == IPPROTO_SCTP;
+      }
+
+      /**
+       * \brief Waits before trying again: spins briefly, then leaves the
+       * CPU to other threads.
+       * \param attempt number of attempts so far.
+       */
+      static void backoff(size_t attempt)
+      {
+        if(attempt < 64)
+        {
+#if defined(__x86_64__) || defined(__i386__)
+          _mm_pause();
+#endif
+        }
+        else if(attempt < 1024)
+        {
+          std::this_thread::yield();
+        }
+        else
+        {
+          std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+      }
+
+      /**
+       * \brief Send attempts of a batch once stopped, about 50 ms.
+       */
+      static const size_t drain_attempts = 2048;
+
+      tx_engine::statistics::statistics()
+        : frames(0),
+        bytes(0),
+        batches(0),
+        retries(0),
+        errors(0),
+        rejected(0)
+      {
+      }
+
+      tx_engine::lane_state::lane_state(boost::asio::io_service& ios,
+          const ll_protocol::endpoint& endpoint)
+        : socket(ios, endpoint),
+        cpu(-1),
+        abandoned(false),
+        enqueue_pos(0),
+        dequeue_pos(0),
+        sent(0),
+        bytes(0),
+        batches(0),
+        retries(0),
+        errors(0),
+        rejected(0)
+      {
+      }
+
+      tx_engine::tx_engine(boost::asio::io_service& ios,
+          const std::string& ifname, size_t lanes,
+          const socket_profile& profile, size_t queue_size,
+          size_t frame_size, size_t batch)
+        : m_endpoint(ifname, 0),
+        m_mask(queue_size - 1),
+        m_frame_size(frame_size),
+        m_batch(batch),
+        m_running(false)
+      {
+        // protocol 0 on the bound endpoint: transmit only, the kernel
+        // does not queue any received frame to these sockets
+
+        if(ifname.empty())
+        {
+          throw std::invalid_argument("interface required");
+        }
+
+        if(lanes == 0 || lanes > 1024)
+        {
+          throw std::invalid_argument("lanes must be 1 to 1024");
+        }
+
+        if(queue_size < 2 || (queue_size & (queue_size - 1)))
+        {
+          throw std::invalid_argument("queue size must be a power of 2");
+        }
+
+        if(frame_size < sizeof(struct ether_header) || frame_size > 65536)
+        {
+          throw std::invalid_argument("invalid frame size");
+        }
+
+        if(batch == 0 || batch > 1024)
+        {
+          throw std::invalid_argument("batch must be 1 to 1024");
+        }
+
+        for(size_t i = 0 ; i < lanes ; i++)
+        {
+          std::unique_ptr<lane_state> l(new lane_state(ios, m_endpoint));
+
+          profile.apply(l->socket, m_endpoint);
+
+          l->frames.assign(queue_size * frame_size, 0);
+          l->cells.reset(new cell[queue_size]);
+          for(size_t j = 0 ; j < queue_size ; j++)
+          {
+            l->cells[j].sequence.store(j, std::memory_order_relaxed);
+            l->cells[j].len = 0;
+          }
+
+          l->iovecs.resize(batch);
+          l->msgs.resize(batch);
+          for(size_t j = 0 ; j < batch ; j++)
+          {
+            memset(&l->msgs[j], 0x00, sizeof(struct mmsghdr));
+            // socket is bound to the interface, no destination needed
+            l->msgs[j].msg_hdr.msg_iov = &l->iovecs[j];
+            l->msgs[j].msg_hdr.msg_iovlen = 1;
+          }
+
+          m_lanes.push_back(std::move(l));
+        }
+      }
+
+      tx_engine::~tx_engine()
+      {
+        stop();
+      }
+
+      void tx_engine::set_affinity(const std::vector<int>& cpus)
+      {
+        for(size_t i = 0 ; i < m_lanes.size() ; i++)
+        {
+          m_lanes[i]->cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+        }
+      }
+
+      void tx_engine::start()
+      {
+        if(m_running)
+        {
+          throw std::logic_error("already started");
+        }
+
+        m_running = true;
+
+        for(std::unique_ptr<lane_state>& l : m_lanes)
+        {
+          l->abandoned = false;
+          l->thread = std::thread(&tx_engine::run, this, std::ref(*l));
+        }
+      }
+
+      void tx_engine::stop()
+      {
+        m_running.store(false, std::memory_order_release);
+
+        for(std::unique_ptr<lane_state>& l : m_lanes)
+        {
+          if(l->thread.joinable())
+          {
+            l->thread.join();
+          }
+        }
+      }
+
+      bool tx_engine::send(const char* data, size_t data_len)
+      {
+        return send(lane(data, data_len), data, data_len);
+      }
+
+      bool tx_engine::send(size_t lane, const char* data, size_t data_len)
+      {
+        lane_state& l = *m_lanes[lane];
+        uint64_t pos = l.enqueue_pos.load(std::memory_order_relaxed);
+        cell* c = nullptr;
+
+        if(data_len > m_frame_size)
+        {
+          l.rejected.fetch_add(1, std::memory_order_relaxed);
+          return false;
+        }
+
+        // bounded multi-producer queue: a cell is free for position pos
+        // when its sequence is pos, the lane sets it back after sending
+        for(;;)
+        {
+          uint64_t seq = 0;
+          int64_t diff = 0;
+
+          c = &l.cells[pos & m_mask];
+          seq = c->sequence.load(std::memory_order_acquire);
+          diff = static_cast<int64_t>(seq - pos);
+
+          if(diff == 0)
+          {
+            if(l.enqueue_pos.compare_exchange_weak(pos, pos + 1,
+                  std::memory_order_relaxed))
+            {
+              break;
+            }
+          }
+          else if(diff < 0)
+          {
+            l.rejected.fetch_add(1, std::memory_order_relaxed);
+            return false;
+          }
+          else
+          {
+            pos = l.enqueue_pos.load(std::memory_order_relaxed);
+          }
+        }
+
+        memcpy(&l.frames[(pos & m_mask) * m_frame_size], data, data_len);
+        c->len = static_cast<uint32_t>(data_len);
+        c->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+      }
+
+      size_t tx_engine::lane(const char* data, size_t data_len) const
+      {
+        return m_lanes.size() == 1 ? 0 :
+          static_cast<size_t>(flow_hash(data, data_len) % m_lanes.size());
+      }
+
+      size_t tx_engine::lanes() const
+      {
+        return m_lanes.size();
+      }
+
+      tx_engine::statistics tx_engine::stats(size_t lane) const
+      {
+        const lane_state& l = *m_lanes[lane];
+        statistics s;
+
+        s.frames = l.sent.load(std::memory_order_relaxed);
+        s.bytes = l.bytes.load(std::memory_order_relaxed);
+        s.batches = l.batches.load(std::memory_order_relaxed);
+        s.retries = l.retries.load(std::memory_order_relaxed);
+        s.errors = l.errors.load(std::memory_order_relaxed);
+        s.rejected = l.rejected.load(std::memory_order_relaxed);
+        return s;
+      }
+
+      tx_engine::statistics tx_engine::stats() const
+      {
+        statistics ret;
+
+        for(size_t i = 0 ; i < m_lanes.size() ; i++)
+        {
+          statistics s = stats(i);
+
+          ret.frames += s.frames;
+          ret.bytes += s.bytes;
+          ret.batches += s.batches;
+          ret.retries += s.retries;
+          ret.errors += s.errors;
+          ret.rejected += s.rejected;
+        }
+        return ret;
+      }
+
+      uint64_t tx_engine::flow_hash(const char* data, size_t data_len)
+      {
+        flow_key k;
+        size_t off = sizeof(struct ether_header);
+        uint16_t type = 0;
+
+        memset(&k, 0x00, sizeof(flow_key));
+
+        if(data_len < off)
+        {
+          return frame_dedup::hash(data, data_len);
+        }
+
+        type = read16(data + 12);
+        for(size_t i = 0 ; i < 2 && (type == ETH_P_8021Q ||
+              type == ETH_P_8021AD) && data_len >= off + 4 ; i++)
+        {
+          type = read16(data + off + 2);
+          off += 4;
+        }
+        k.type = type;
+
+        if(type == ETH_P_IP && data_len >= off + 20)
+        {
+          const char* ip = data + off;
+          size_t hl = (static_cast<uint8_t>(ip[0]) & 0x0f) * 4;
+
+          k.protocol = static_cast<uint8_t>(ip[9]);
+          memcpy(k.src, ip + 12, 4);
+          memcpy(k.dst, ip + 16, 4);
+
+          // fragments have no ports, all of them hash alike
+          if(has_ports(k.protocol) && (read16(ip + 6) & 0x3fff) == 0 &&
+              hl >= 20 && data_len >= off + hl + 4)
+          {
+            memcpy(k.ports, ip + hl, 4);
+          }
+        }
+        else if(type == ETH_P_IPV6 && data_len >= off + 40)
+        {
+          const char* ip = data + off;
+
+          k.protocol = static_cast<uint8_t>(ip[6]);
+          memcpy(k.src, ip + 8, 16);
+          memcpy(k.dst, ip + 24, 16);
+
+          if(has_ports(k.protocol) && data_len >= off + 44)
+          {
+            memcpy(k.ports, ip + 40, 4);
+          }
+        }
+        else
+        {
+          memcpy(k.src, data, 2 * ETH_ALEN);
+        }
+
+        return frame_dedup::hash(&k, sizeof(flow_key));
+      }
+
+      void tx_engine::run(lane_state& l)
+      {
+        size_t idle = 0;
+
+        if(l.cpu >= 0)
+        {
+          cpu_set_t set;
+
+          // best effort, the lane still runs if the CPU is not allowed
+          CPU_ZERO(&set);
+          CPU_SET(l.cpu, &set);
+          pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set);
+        }
+
+        for(;;)
+        {
+          if(flush(l))
+          {
+            idle = 0;
+            continue;
+          }
+
+          if(!m_running.load(std::memory_order_acquire))
+          {
+            // frames queued before stop() are visible now
+            while(flush(l))
+            {
+            }
+            break;
+          }
+
+          backoff(idle++);
+        }
+      }
+
+      size_t tx_engine::flush(lane_state& l)
+      {
+        const int fd = l.socket.native_handle();
+        const uint64_t pos = l.dequeue_pos;
+        size_t n = 0;
+        size_t sent = 0;
+        uint64_t bytes = 0;
+        uint64_t batches = 0;
+        size_t attempts = 0;
+
+        // contiguous ready frames, sent from the queue memory
+        while(n < m_batch)
+        {
+          const cell& c = l.cells[(pos + n) & m_mask];
+
+          if(c.sequence.load(std::memory_order_acquire) != pos + n + 1)
+          {
+            break;
+          }
+
+          l.iovecs[n].iov_base = &l.frames[((pos + n) & m_mask) *
+            m_frame_size];
+          l.iovecs[n].iov_len = c.len;
+          n++;
+        }
+
+        if(n == 0)
+        {
+          return 0;
+        }
+
+        while(sent < n)
+        {
+          int ret = 0;
+
+          if(l.abandoned)
+          {
+            // stopped while the device does not take frames
+            l.errors.fetch_add(n - sent, std::memory_order_relaxed);
+            break;
+          }
+
+          ret = sendmmsg(fd, &l.msgs[sent],
+              static_cast<unsigned int>(n - sent), 0);
+
+          if(ret < 0)
+          {
+            if(errno == ENOBUFS || errno == EAGAIN || errno == EINTR)
+            {
+              // qdisc or device queue full (or TX queue stopped, i.e.
+              // link down with qdisc bypass): retry the remaining frames,
+              // for a bounded time once stopped
+              l.retries.fetch_add(1, std::memory_order_relaxed);
+              if(!m_running.load(std::memory_order_acquire) &&
+                  attempts >= drain_attempts)
+              {
+                l.abandoned = true;
+                continue;
+              }
+
+              backoff(attempts++);
+              continue;
+            }
+
+            // frame refused (i.e. larger than the MTU): skip it
+            l.errors.fetch_add(1, std::memory_order_relaxed);
+            sent++;
+            continue;
+          }
+
+          attempts = 0;
+          for(int i = 0 ; i < ret ; i++)
+          {
+            bytes += l.iovecs[sent + i].iov_len;
+          }
+
+          if(static_cast<size_t>(ret) < n - sent)
+          {
+            l.retries.fetch_add(1, std::memory_order_relaxed);
+          }
+          sent += static_cast<size_t>(ret);
+          l.sent.fetch_add(static_cast<uint64_t>(ret),
+              std::memory_order_relaxed);
+          batches++;
+        }
+
+        for(size_t i = 0 ; i < n ; i++)
+        {
+          l.cells[(pos + i) & m_mask].sequence.store(pos + i + m_mask + 1,
+              std::memory_order_release);
+        }
+        l.dequeue_pos = pos + n;
+
+        l.bytes.fetch_add(bytes, std::memory_order_relaxed);
+        l.batches.fetch_add(batches, std::memory_order_relaxed);
+        return n;
+      }
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
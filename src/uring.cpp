@@ -0,0 +1,287 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file uring.cpp
+ * \brief Minimal io_uring instance.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <cerrno>
+#include <cstring>
+
+#include <vector>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <boost/system/system_error.hpp>
+
+#include "uring.hpp"
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \brief Returns pointer at an offset of a mapping.
+       * \param base mapping.
+       * \param offset offset.
+       * \return pointer.
+       */
+      template <typename T>
+      static T* at(void* base, size_t offset)
+      {
+        return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+      }
+
+      uring::uring(unsigned entries, unsigned cq_entries)
+        : m_fd(-1),
+        m_sq_ring(MAP_FAILED),
+        m_sq_ring_size(0),
+        m_cq_ring(MAP_FAILED),
+        m_cq_ring_size(0),
+        m_sqes(static_cast<struct io_uring_sqe*>(MAP_FAILED)),
+        m_sqes_size(0),
+        m_sqe_head(0),
+        m_sqe_tail(0)
+      {
+        struct io_uring_params params;
+        std::vector<char> probe(sizeof(struct io_uring_probe) +
+            256 * sizeof(struct io_uring_probe_op));
+        struct io_uring_probe* p =
+          reinterpret_cast<struct io_uring_probe*>(probe.data());
+
+        memset(&params, 0x00, sizeof(struct io_uring_params));
+        memset(m_ops, 0x00, sizeof(m_ops));
+
+        if(cq_entries)
+        {
+          params.flags |= IORING_SETUP_CQSIZE;
+          params.cq_entries = cq_entries;
+        }
+
+        m_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries,
+              &params));
+        if(m_fd < 0)
+        {
+          throw boost::system::system_error(errno,
+              boost::system::system_category(), "io_uring_setup");
+        }
+
+        m_sq_ring_size = params.sq_off.array +
+          params.sq_entries * sizeof(unsigned);
+        m_cq_ring_size = params.cq_off.cqes +
+          params.cq_entries * sizeof(struct io_uring_cqe);
+
+        // kernel 5.4+ maps both rings at once
+        if(params.features & IORING_FEAT_SINGLE_MMAP)
+        {
+          if(m_cq_ring_size > m_sq_ring_size)
+          {
+            m_sq_ring_size = m_cq_ring_size;
+          }
+          m_cq_ring_size = m_sq_ring_size;
+        }
+
+        m_sq_ring = mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+        if(m_sq_ring != MAP_FAILED)
+        {
+          m_cq_ring = (params.features & IORING_FEAT_SINGLE_MMAP) ?
+            m_sq_ring : mmap(nullptr, m_cq_ring_size,
+                PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd,
+                IORING_OFF_CQ_RING);
+        }
+
+        if(m_cq_ring != MAP_FAILED)
+        {
+          m_sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+          m_sqes = static_cast<struct io_uring_sqe*>(mmap(nullptr,
+                m_sqes_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES));
+        }
+
+        if(m_sqes == MAP_FAILED)
+        {
+          int err = errno;
+
+          release();
+          throw boost::system::system_error(err,
+              boost::system::system_category(), "io_uring mmap");
+        }
+
+        m_sq_khead = at<unsigned>(m_sq_ring, params.sq_off.head);
+        m_sq_ktail = at<unsigned>(m_sq_ring, params.sq_off.tail);
+        m_sq_mask = *at<unsigned>(m_sq_ring, params.sq_off.ring_mask);
+        m_sq_entries = params.sq_entries;
+        m_cq_khead = at<unsigned>(m_cq_ring, params.cq_off.head);
+        m_cq_ktail = at<unsigned>(m_cq_ring, params.cq_off.tail);
+        m_cq_mask = *at<unsigned>(m_cq_ring, params.cq_off.ring_mask);
+        m_cqes = at<struct io_uring_cqe>(m_cq_ring, params.cq_off.cqes);
+
+        m_sqe_head = *m_sq_ktail;
+        m_sqe_tail = m_sqe_head;
+
+        // identity mapping between ring slots and entries
+        for(unsigned i = 0 ; i < m_sq_entries ; i++)
+        {
+          at<unsigned>(m_sq_ring, params.sq_off.array)[i] = i;
+        }
+
+        // probe appeared in 5.6, older kernels report nothing supported
+        if(syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PROBE, p,
+              256) == 0)
+        {
+          for(unsigned i = 0 ; i < p->ops_len && i < 256 ; i++)
+          {
+            if(p->ops[i].flags & IO_URING_OP_SUPPORTED)
+            {
+              m_ops[p->ops[i].op] = 1;
+            }
+          }
+        }
+      }
+
+      uring::~uring()
+      {
+        release();
+      }
+
+      void uring::release()
+      {
+        if(m_sqes != MAP_FAILED)
+        {
+          munmap(m_sqes, m_sqes_size);
+        }
+
+        if(m_cq_ring != MAP_FAILED && m_cq_ring != m_sq_ring)
+        {
+          munmap(m_cq_ring, m_cq_ring_size);
+        }
+
+        if(m_sq_ring != MAP_FAILED)
+        {
+          munmap(m_sq_ring, m_sq_ring_size);
+        }
+
+        if(m_fd != -1)
+        {
+          close(m_fd);
+        }
+      }
+
+      bool uring::supports(uint8_t op) const
+      {
+        return m_ops[op] != 0;
+      }
+
+      struct io_uring_sqe* uring::get_sqe()
+      {
+        struct io_uring_sqe* sqe = nullptr;
+        unsigned head = __atomic_load_n(m_sq_khead, __ATOMIC_ACQUIRE);
+
+        if(m_sqe_tail - head >= m_sq_entries)
+        {
+          return nullptr;
+        }
+
+        sqe = &m_sqes[m_sqe_tail & m_sq_mask];
+        memset(sqe, 0x00, sizeof(struct io_uring_sqe));
+        m_sqe_tail++;
+        return sqe;
+      }
+
+      unsigned uring::submit()
+      {
+        unsigned count = m_sqe_tail - m_sqe_head;
+        long ret = 0;
+
+        if(count == 0)
+        {
+          return 0;
+        }
+
+        __atomic_store_n(m_sq_ktail, m_sqe_tail, __ATOMIC_RELEASE);
+
+        ret = syscall(__NR_io_uring_enter, m_fd, count, 0, 0, nullptr, 0);
+        if(ret < 0)
+        {
+          // entries stay in the ring and go with the next submit
+          if(errno == EINTR || errno == EAGAIN || errno == EBUSY)
+          {
+            return 0;
+          }
+
+          throw boost::system::system_error(errno,
+              boost::system::system_category(), "io_uring_enter");
+        }
+
+        m_sqe_head += static_cast<unsigned>(ret);
+        return static_cast<unsigned>(ret);
+      }
+
+      const struct io_uring_cqe* uring::peek() const
+      {
+        unsigned head = *m_cq_khead;
+
+        if(head == __atomic_load_n(m_cq_ktail, __ATOMIC_ACQUIRE))
+        {
+          return nullptr;
+        }
+
+        return &m_cqes[head & m_cq_mask];
+      }
+
+      void uring::advance()
+      {
+        __atomic_store_n(m_cq_khead, *m_cq_khead + 1, __ATOMIC_RELEASE);
+      }
+
+      void uring::register_files(const int* fds, unsigned count)
+      {
+        do_register(IORING_REGISTER_FILES, fds, count,
+            "IORING_REGISTER_FILES");
+      }
+
+      void uring::register_buffers(const struct iovec* iovs, unsigned count)
+      {
+        do_register(IORING_REGISTER_BUFFERS, iovs, count,
+            "IORING_REGISTER_BUFFERS");
+      }
+
+      void uring::register_buf_ring(struct io_uring_buf_ring* ring,
+          unsigned entries, uint16_t group)
+      {
+        struct io_uring_buf_reg reg;
+
+        memset(&reg, 0x00, sizeof(struct io_uring_buf_reg));
+        reg.ring_addr = reinterpret_cast<uintptr_t>(ring);
+        reg.ring_entries = entries;
+        reg.bgid = group;
+
+        do_register(IORING_REGISTER_PBUF_RING, &reg, 1,
+            "IORING_REGISTER_PBUF_RING");
+      }
+
+      void uring::do_register(unsigned opcode, const void* arg,
+          unsigned nr_args, const char* what)
+      {
+        if(syscall(__NR_io_uring_register, m_fd, opcode, arg, nr_args) < 0)
+        {
+          throw boost::system::system_error(errno,
+              boost::system::system_category(), what);
+        }
+      }
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
@@ -0,0 +1,130 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file vlan_dispatcher.cpp
+ * \brief Per-VLAN frame dispatch.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <stdexcept>
+
+#include <net/ethernet.h>
+
+#include "vlan_dispatcher.hpp"
+
+#ifndef ETHERTYPE_8021AD
+/**
+ * \def ETHERTYPE_8021AD
+ * \brief 802.1ad service VLAN tag protocol identifier.
+ */
+#define ETHERTYPE_8021AD 0x88a8
+#endif
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      vlan_dispatcher::vlan_dispatcher()
+        : m_handlers(1)
+      {
+        m_index.fill(0);
+      }
+
+      void vlan_dispatcher::add(uint16_t vid, const handler& h)
+      {
+        size_t idx = 0;
+
+        if(vid >= vid_count)
+        {
+          throw std::out_of_range("VLAN identifier out of range");
+        }
+
+        if(m_index[vid] != 0)
+        {
+          m_handlers[m_index[vid]] = h;
+          return;
+        }
+
+        // reuse a slot freed by remove()
+        for(idx = 1 ; idx < m_handlers.size() ; idx++)
+        {
+          if(!m_handlers[idx])
+          {
+            break;
+          }
+        }
+
+        if(idx == m_handlers.size())
+        {
+          m_handlers.push_back(h);
+        }
+        else
+        {
+          m_handlers[idx] = h;
+        }
+
+        m_index[vid] = static_cast<uint16_t>(idx);
+      }
+
+      void vlan_dispatcher::remove(uint16_t vid)
+      {
+        if(vid >= vid_count || m_index[vid] == 0)
+        {
+          return;
+        }
+
+        m_handlers[m_index[vid]] = nullptr;
+        m_index[vid] = 0;
+      }
+
+      void vlan_dispatcher::set_untagged(const handler& h)
+      {
+        m_untagged = h;
+      }
+
+      void vlan_dispatcher::set_default(const handler& h)
+      {
+        m_handlers[0] = h;
+      }
+
+      bool vlan_dispatcher::dispatch(const vlan_tag& tag, const char* data,
+          size_t len) const
+      {
+        vlan_tag t = tag;
+        const handler* h = nullptr;
+
+        if(!t.valid && len >= sizeof(struct ether_header) + 4)
+        {
+          const uint8_t* p = reinterpret_cast<const uint8_t*>(data) +
+            ETH_ALEN * 2;
+          uint16_t type = static_cast<uint16_t>(p[0] << 8 | p[1]);
+
+          // tag not stripped by the NIC
+          if(type == ETHERTYPE_VLAN || type == ETHERTYPE_8021AD)
+          {
+            t = vlan_tag(static_cast<uint16_t>(p[2] << 8 | p[3]), type);
+          }
+        }
+
+        h = t.valid ? &m_handlers[m_index[t.vid()]] : &m_untagged;
+
+        if(!*h)
+        {
+          return false;
+        }
+
+        (*h)(t, data, len);
+        return true;
+      }
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */
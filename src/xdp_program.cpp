@@ -0,0 +1,261 @@
+/*
+ * Asio-Raw-LinkLayer - Boost.Asio raw link-layer socket.
+ * Copyright (c) 2017, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file xdp_program.cpp
+ * \brief XDP program redirecting frames to AF_XDP sockets.
+ * \author Sebastien Vincent
+ * \date 2017
+ */
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <arpa/inet.h>
+
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+
+#include <boost/system/system_error.hpp>
+
+#include "xdp_program.hpp"
+
+namespace asio
+{
+  namespace raw
+  {
+    namespace ll
+    {
+      /**
+       * \brief Calls bpf().
+       * \param cmd command.
+       * \param attr attributes.
+       * \return result, -1 on error (errno set).
+       */
+      static int sys_bpf(int cmd, union bpf_attr* attr)
+      {
+        return static_cast<int>(syscall(__NR_bpf, cmd, attr,
+              sizeof(union bpf_attr)));
+      }
+
+      /**
+       * \brief Builds an eBPF instruction.
+       * \param code opcode.
+       * \param dst destination register.
+       * \param src source register.
+       * \param off offset.
+       * \param imm immediate.
+       * \return instruction.
+       */
+      static struct bpf_insn insn(uint8_t code, uint8_t dst, uint8_t src,
+          int16_t off, int32_t imm)
+      {
+        struct bpf_insn i;
+
+        i.code = code;
+        i.dst_reg = dst & 0x0f;
+        i.src_reg = src & 0x0f;
+        i.off = off;
+        i.imm = imm;
+        return i;
+      }
+
+      xdp_program::xdp_program(uint32_t ifindex, uint16_t eth_protocol,
+          attach_mode mode, uint32_t queues)
+        : m_ifindex(ifindex),
+        m_eth_protocol(eth_protocol),
+        m_map(-1),
+        m_prog(-1),
+        m_link(-1),
+        m_native(false)
+      {
+        union bpf_attr attr;
+        int err = 0;
+
+        memset(&attr, 0x00, sizeof(union bpf_attr));
+        attr.map_type = BPF_MAP_TYPE_XSKMAP;
+        attr.key_size = sizeof(uint32_t);
+        attr.value_size = sizeof(int);
+        attr.max_entries = queues;
+
+        m_map = sys_bpf(BPF_MAP_CREATE, &attr);
+        if(m_map < 0)
+        {
+          throw boost::system::system_error(errno,
+              boost::system::system_category(), "BPF_MAP_CREATE");
+        }
+
+        try
+        {
+          load(eth_protocol);
+        }
+        catch(...)
+        {
+          close(m_map);
+          throw;
+        }
+
+        if(mode != mode_generic)
+        {
+          m_link = attach(XDP_FLAGS_DRV_MODE);
+          m_native = m_link >= 0;
+        }
+
+        if(m_link < 0 && mode != mode_native)
+        {
+          m_link = attach(XDP_FLAGS_SKB_MODE);
+        }
+
+        if(m_link < 0)
+        {
+          err = errno;
+          close(m_prog);
+          close(m_map);
+          throw boost::system::system_error(err,
+              boost::system::system_category(), "BPF_LINK_CREATE");
+        }
+      }
+
+      xdp_program::~xdp_program()
+      {
+        close(m_link);
+        close(m_prog);
+        close(m_map);
+      }
+
+      void xdp_program::add_socket(uint32_t queue_id, int fd)
+      {
+        union bpf_attr attr;
+
+        memset(&attr, 0x00, sizeof(union bpf_attr));
+        attr.map_fd = static_cast<uint32_t>(m_map);
+        attr.key = reinterpret_cast<uintptr_t>(&queue_id);
+        attr.value = reinterpret_cast<uintptr_t>(&fd);
+        attr.flags = BPF_ANY;
+
+        if(sys_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0)
+        {
+          throw boost::system::system_error(errno,
+              boost::system::system_category(), "BPF_MAP_UPDATE_ELEM");
+        }
+      }
+
+      void xdp_program::remove_socket(uint32_t queue_id)
+      {
+        union bpf_attr attr;
+
+        memset(&attr, 0x00, sizeof(union bpf_attr));
+        attr.map_fd = static_cast<uint32_t>(m_map);
+        attr.key = reinterpret_cast<uintptr_t>(&queue_id);
+
+        sys_bpf(BPF_MAP_DELETE_ELEM, &attr);
+      }
+
+      void xdp_program::load(uint16_t eth_protocol)
+      {
+        std::vector<struct bpf_insn> prog;
+        std::vector<size_t> to_pass;
+        union bpf_attr attr;
+        char log[4096];
+        const char license[] = "Dual BSD/GPL";
+
+        if(eth_protocol != ETH_P_ALL)
+        {
+          // r2 = data; r3 = data_end; if data + 14 > data_end goto pass
+          prog.push_back(insn(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_2,
+                BPF_REG_1, offsetof(struct xdp_md, data), 0));
+          prog.push_back(insn(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_3,
+                BPF_REG_1, offsetof(struct xdp_md, data_end), 0));
+          prog.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4,
+                BPF_REG_2, 0, 0));
+          prog.push_back(insn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0,
+                ETH_HLEN));
+          to_pass.push_back(prog.size());
+          prog.push_back(insn(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4,
+                BPF_REG_3, 0, 0));
+
+          // if ethertype (network order load) != protocol goto pass
+          prog.push_back(insn(BPF_LDX | BPF_H | BPF_MEM, BPF_REG_4,
+                BPF_REG_2, 12, 0));
+          to_pass.push_back(prog.size());
+          prog.push_back(insn(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_4, 0, 0,
+                htons(eth_protocol)));
+        }
+
+        // return bpf_redirect_map(&xsks, rx_queue_index, XDP_PASS)
+        prog.push_back(insn(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_2, BPF_REG_1,
+              offsetof(struct xdp_md, rx_queue_index), 0));
+        prog.push_back(insn(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1,
+              BPF_PSEUDO_MAP_FD, 0, m_map));
+        prog.push_back(insn(0, 0, 0, 0, 0));
+        prog.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0,
+              XDP_PASS));
+        prog.push_back(insn(BPF_JMP | BPF_CALL, 0, 0, 0,
+              BPF_FUNC_redirect_map));
+        prog.push_back(insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0));
+
+        // pass: return XDP_PASS, only when jumped to (the verifier
+        // rejects unreachable instructions)
+        if(!to_pass.empty())
+        {
+          for(size_t i = 0 ; i < to_pass.size() ; i++)
+          {
+            prog[to_pass[i]].off = static_cast<int16_t>(prog.size() -
+                to_pass[i] - 1);
+          }
+          prog.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0,
+                XDP_PASS));
+          prog.push_back(insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0));
+        }
+
+        memset(&attr, 0x00, sizeof(union bpf_attr));
+        log[0] = 0;
+        attr.prog_type = BPF_PROG_TYPE_XDP;
+        attr.expected_attach_type = BPF_XDP;
+        attr.insn_cnt = static_cast<uint32_t>(prog.size());
+        attr.insns = reinterpret_cast<uintptr_t>(prog.data());
+        attr.license = reinterpret_cast<uintptr_t>(license);
+
+        m_prog = sys_bpf(BPF_PROG_LOAD, &attr);
+        if(m_prog < 0)
+        {
+          int err = errno;
+
+          // load again only to get the verifier message
+          attr.log_level = 1;
+          attr.log_size = sizeof(log);
+          attr.log_buf = reinterpret_cast<uintptr_t>(log);
+          sys_bpf(BPF_PROG_LOAD, &attr);
+          log[sizeof(log) - 1] = 0;
+          throw boost::system::system_error(err,
+              boost::system::system_category(),
+              std::string("BPF_PROG_LOAD: ") + log);
+        }
+      }
+
+      int xdp_program::attach(uint32_t flags)
+      {
+        union bpf_attr attr;
+
+        memset(&attr, 0x00, sizeof(union bpf_attr));
+        attr.link_create.prog_fd = static_cast<uint32_t>(m_prog);
+        attr.link_create.target_ifindex = m_ifindex;
+        attr.link_create.attach_type = BPF_XDP;
+        attr.link_create.flags = flags;
+
+        return sys_bpf(BPF_LINK_CREATE, &attr);
+      }
+    } /* namespace ll */
+  } /* namespace raw */
+} /* namespace asio */